@@ -0,0 +1,190 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <regex>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+#include <unistd.h>
+
+/**
+ * Minimal microbenchmark harness, with the same command-line options and JSON output format as
+ * Google Benchmark (so that results of different commits can be compared with its tools):
+ *
+ *   --benchmark_filter=REGEX --benchmark_min_time=SECONDS --benchmark_repetitions=N
+ *   --benchmark_format=console|json --benchmark_out=FILE (always JSON)
+ *
+ * A benchmark is a function that runs its body `iterations` times. The number of iterations is
+ * increased until the run takes at least min_time seconds, and times are reported per iteration.
+ */
+namespace bench {
+
+// prevents the compiler from optimizing away the computation of `value`
+template<class T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Result {
+    std::string name;
+    long long iterations;
+    double real_time; // nanoseconds per iteration
+    double cpu_time;
+    int repetition;
+};
+
+class Runner {
+    typedef std::function<void(long long)> Function;
+
+    struct Benchmark {
+        std::string name;
+        Function function;
+        std::function<void()> setup; // called before the first run (not measured)
+    };
+
+    std::vector<Benchmark> benchmarks;
+    std::string filter;
+    double min_time;
+    int repetitions;
+    std::string format;
+    std::string out_file;
+
+    Result run(const std::string& name, const Function& function, int repetition) const {
+        long long iterations = 1;
+
+        while (true) {
+            auto start = std::chrono::steady_clock::now();
+            std::clock_t cpu_start = std::clock();
+            function(iterations);
+            std::clock_t cpu_end = std::clock();
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (elapsed >= min_time || iterations >= 1000000000LL) {
+                double cpu = static_cast<double>(cpu_end - cpu_start) / CLOCKS_PER_SEC;
+                return {name, iterations, elapsed * 1e9 / iterations, cpu * 1e9 / iterations, repetition};
+            }
+
+            // next number of iterations, from the current time per iteration (like Google Benchmark)
+            double multiplier = elapsed > 0 ? min_time * 1.4 / elapsed : 10;
+            multiplier = std::max(2.0, std::min(multiplier, 10.0));
+            iterations = static_cast<long long>(iterations * multiplier);
+        }
+    }
+
+    static std::string context() {
+        char hostname[256] = "";
+        gethostname(hostname, sizeof(hostname) - 1);
+        std::time_t now = std::time(0);
+        char date[64];
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+        std::ostringstream json;
+        json << "  \"context\": {\n"
+             << "    \"date\": \"" << date << "\",\n"
+             << "    \"host_name\": \"" << hostname << "\",\n"
+             << "    \"executable\": \"multivec-bench\",\n"
+             << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+#ifdef NDEBUG
+             << "    \"library_build_type\": \"release\"\n"
+#else
+             << "    \"library_build_type\": \"debug\"\n"
+#endif
+             << "  },\n";
+        return json.str();
+    }
+
+    static std::string toJSON(const std::vector<Result>& results, int repetitions) {
+        std::ostringstream json;
+        json << "{\n" << context() << "  \"benchmarks\": [\n";
+        for (int i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            json << "    {\n"
+                 << "      \"name\": \"" << r.name << "\",\n"
+                 << "      \"family_index\": " << i / repetitions << ",\n"
+                 << "      \"run_name\": \"" << r.name << "\",\n"
+                 << "      \"run_type\": \"iteration\",\n"
+                 << "      \"repetitions\": " << repetitions << ",\n"
+                 << "      \"repetition_index\": " << r.repetition << ",\n"
+                 << "      \"threads\": 1,\n"
+                 << "      \"iterations\": " << r.iterations << ",\n"
+                 << "      \"real_time\": " << r.real_time << ",\n"
+                 << "      \"cpu_time\": " << r.cpu_time << ",\n"
+                 << "      \"time_unit\": \"ns\"\n"
+                 << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        json << "  ]\n}\n";
+        return json.str();
+    }
+
+    static bool option(const char* arg, const char* name, std::string& value) {
+        size_t n = std::strlen(name);
+        if (std::strncmp(arg, name, n) != 0 || arg[n] != '=') return false;
+        value = arg + n + 1;
+        return true;
+    }
+
+public:
+    Runner(int argc, char** argv) : filter("."), min_time(0.5), repetitions(1), format("console") {
+        for (int i = 1; i < argc; ++i) {
+            std::string value;
+            if (option(argv[i], "--benchmark_filter", value)) filter = value;
+            else if (option(argv[i], "--benchmark_min_time", value)) min_time = std::atof(value.c_str());
+            else if (option(argv[i], "--benchmark_repetitions", value)) repetitions = std::max(1, std::atoi(value.c_str()));
+            else if (option(argv[i], "--benchmark_format", value)) format = value;
+            else if (option(argv[i], "--benchmark_out", value)) out_file = value;
+            else throw std::runtime_error(std::string("unknown option ") + argv[i]);
+        }
+    }
+
+    void add(const std::string& name, const Function& function,
+             const std::function<void()>& setup = std::function<void()>()) {
+        benchmarks.push_back({name, function, setup});
+    }
+
+    bool selected(const std::string& name) const {
+        return std::regex_search(name, std::regex(filter));
+    }
+
+    int runAll() const {
+        std::vector<Result> results;
+
+        if (format == "console")
+            fprintf(stdout, "%-40s %15s %15s %12s\n", "Benchmark", "Time (ns)", "CPU (ns)", "Iterations");
+
+        for (auto it = benchmarks.begin(); it != benchmarks.end(); ++it) {
+            if (!selected(it->name)) continue;
+            if (it->setup) it->setup();
+
+            for (int k = 0; k < repetitions; ++k) {
+                Result result = run(it->name, it->function, k);
+                results.push_back(result);
+                if (format == "console") {
+                    fprintf(stdout, "%-40s %15.1f %15.1f %12lld\n", result.name.c_str(), result.real_time,
+                            result.cpu_time, result.iterations);
+                    fflush(stdout);
+                }
+            }
+        }
+
+        std::string json = toJSON(results, repetitions);
+        if (format == "json")
+            std::cout << json;
+        if (!out_file.empty()) {
+            std::ofstream outfile(out_file);
+            if (!outfile.is_open()) throw std::runtime_error("couldn't open file " + out_file);
+            outfile << json;
+        }
+        return 0;
+    }
+};
+
+}
@@ -0,0 +1,162 @@
+#include "benchmark.hpp"
+#include "model_internals.hpp"
+
+/**
+ * Microbenchmarks of the vector kernels, and of the training and query primitives of MonolingualModel,
+ * on a synthetic model (Zipf-distributed vocabulary, random weights). No data needs to be downloaded.
+ *
+ *   bin/multivec-bench --benchmark_out=results.json
+ */
+
+const int VOCAB_SIZE = 10000;
+const int DIMENSION = 100;
+
+class ModelBenchmark {
+    Config config;
+    MonolingualModel model;
+    vector<HuffmanNode> nodes; // a few vocabulary nodes, sampled from the unigram distribution
+    string sentence;
+
+public:
+    ModelBenchmark() : model(&config) {
+        config.dimension = DIMENSION;
+        config.negative = 5;
+
+        vector<pair<string, int>> words;
+        for (int i = 0; i < VOCAB_SIZE; ++i) {
+            words.push_back({"w" + std::to_string(i), static_cast<int>(1e07 / (i + 1))});
+        }
+        ModelInternals::initVocab(model, words);
+        ModelInternals::initNet(model);
+
+        mat& output_weights = ModelInternals::outputWeights(model);
+        for (auto it = output_weights.begin(); it != output_weights.end(); ++it) {
+            for (int i = 0; i < DIMENSION; ++i) (*it)[i] = (multivec::randf() - 0.5f) / DIMENSION;
+        }
+        mat& output_weights_hs = ModelInternals::outputWeightsHS(model);
+        for (auto it = output_weights_hs.begin(); it != output_weights_hs.end(); ++it) {
+            for (int i = 0; i < DIMENSION; ++i) (*it)[i] = (multivec::randf() - 0.5f) / DIMENSION;
+        }
+
+        for (int i = 0; i < 1024; ++i) {
+            nodes.push_back(*ModelInternals::getRandomHuffmanNode(model));
+        }
+        for (int i = 0; i < 25; ++i) { // with a few OOV words
+            sentence += (i > 0 ? " " : "") + (i % 10 == 9 ? string("oov") : nodes[i].word);
+        }
+    }
+
+    static ModelBenchmark& instance() { // built on first use (the unigram table is large)
+        static ModelBenchmark benchmark;
+        return benchmark;
+    }
+
+    MonolingualModel& getModel() { return model; }
+
+    void negSamplingUpdate(long long iterations, bool update) {
+        const vec& hidden = ModelInternals::inputWeights(model)[0];
+        for (long long i = 0; i < iterations; ++i) {
+            bench::doNotOptimize(ModelInternals::negSamplingUpdate(model, nodes[i % nodes.size()], hidden, 0.025, update));
+        }
+    }
+
+    void hierarchicalUpdate(long long iterations, bool update) {
+        const vec& hidden = ModelInternals::inputWeights(model)[0];
+        for (long long i = 0; i < iterations; ++i) {
+            bench::doNotOptimize(ModelInternals::hierarchicalUpdate(model, nodes[i % nodes.size()], hidden, 0.025, update));
+        }
+    }
+
+    void getNodes(long long iterations) {
+        for (long long i = 0; i < iterations; ++i) {
+            bench::doNotOptimize(ModelInternals::getNodes(model, sentence));
+        }
+    }
+
+    void getRandomHuffmanNode(long long iterations) {
+        for (long long i = 0; i < iterations; ++i) {
+            bench::doNotOptimize(ModelInternals::getRandomHuffmanNode(model));
+        }
+    }
+};
+
+static void addVecBenchmarks(bench::Runner& runner, int dimension) {
+    string suffix = "/" + std::to_string(dimension);
+
+    runner.add("BM_VecDot" + suffix, [dimension](long long iterations) {
+        vec x(dimension, 0.5f), y(dimension, 0.25f);
+        for (long long i = 0; i < iterations; ++i) {
+            bench::doNotOptimize(x.dot(y));
+        }
+    });
+    runner.add("BM_VecAxpy" + suffix, [dimension](long long iterations) {
+        vec x(dimension, 0.5f), y(dimension, 0.25f);
+        for (long long i = 0; i < iterations; ++i) {
+            y += 1e-06f * x;
+            bench::doNotOptimize(y[0]);
+        }
+    });
+    runner.add("BM_VecNorm" + suffix, [dimension](long long iterations) {
+        vec x(dimension, 0.5f);
+        for (long long i = 0; i < iterations; ++i) {
+            bench::doNotOptimize(x.norm());
+        }
+    });
+}
+
+int main(int argc, char** argv) {
+    bench::Runner runner(argc, argv);
+
+    int dimensions[] = {50, 100, 300};
+    for (int k = 0; k < 3; ++k) {
+        addVecBenchmarks(runner, dimensions[k]);
+    }
+
+    auto setup = []() { ModelBenchmark::instance(); };
+
+    runner.add("BM_NegSamplingUpdate", [](long long iterations) {
+        ModelBenchmark::instance().negSamplingUpdate(iterations, true);
+    }, setup);
+    runner.add("BM_NegSamplingForward", [](long long iterations) {
+        ModelBenchmark::instance().negSamplingUpdate(iterations, false);
+    }, setup);
+    runner.add("BM_HierarchicalUpdate", [](long long iterations) {
+        ModelBenchmark::instance().hierarchicalUpdate(iterations, true);
+    }, setup);
+    runner.add("BM_HierarchicalForward", [](long long iterations) {
+        ModelBenchmark::instance().hierarchicalUpdate(iterations, false);
+    }, setup);
+    runner.add("BM_GetNodes", [](long long iterations) {
+        ModelBenchmark::instance().getNodes(iterations);
+    }, setup);
+    runner.add("BM_GetRandomHuffmanNode", [](long long iterations) {
+        ModelBenchmark::instance().getRandomHuffmanNode(iterations);
+    }, setup);
+    runner.add("BM_Closest", [](long long iterations) {
+        MonolingualModel& model = ModelBenchmark::instance().getModel();
+        for (long long i = 0; i < iterations; ++i) {
+            bench::doNotOptimize(model.closest("w" + std::to_string(i % 100), 10));
+        }
+    }, setup);
+
+    string model_file = "/tmp/multivec-bench-" + std::to_string(getpid()) + ".bin";
+    runner.add("BM_Save", [&model_file](long long iterations) {
+        MonolingualModel& model = ModelBenchmark::instance().getModel();
+        for (long long i = 0; i < iterations; ++i) {
+            model.save(model_file);
+        }
+    }, setup);
+    runner.add("BM_Load", [&model_file](long long iterations) {
+        ModelBenchmark::instance().getModel().save(model_file);
+        Config config;
+        for (long long i = 0; i < iterations; ++i) {
+            MonolingualModel model(&config);
+            model.load(model_file);
+            bench::doNotOptimize(model.getWords().size());
+        }
+    }, setup);
+
+    int res = runner.runAll();
+    std::remove(model_file.c_str());
+    return res;
+}
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+from __future__ import division, print_function
+import argparse
+import json
+import multiprocessing
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+
+help_msg = """\
+End-to-end training throughput of multivec-mono and multivec-bi, on synthetic
+Zipf corpora (generated with scripts/generate-corpus.py, no download needed).
+
+For each thread count, reports the training speed (words/sec, from the --metrics
+output), the wall time and the peak RSS of the process. The time to load the
+trained model (--load) is also measured.
+
+Run from the root directory of the project:
+    benchmarks/throughput.py --tokens 10000000 --threads 1 2 4 8
+"""
+
+
+def run(command):
+    """ Run `command`, and return its wall time (seconds) and peak RSS (MB) """
+    start = time.time()
+    # stderr goes to a file rather than a pipe, which nothing reads until the end (the child would block on a full pipe)
+    with open(os.devnull, 'w') as devnull, tempfile.TemporaryFile() as stderr:
+        process = subprocess.Popen(command, stdout=devnull, stderr=stderr)
+        _, status, usage = os.wait4(process.pid, 0)
+        process.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -os.WTERMSIG(status)
+        if process.returncode != 0:
+            stderr.seek(0)
+            sys.exit('error: {} failed\n{}'.format(' '.join(command), stderr.read().decode(errors='replace')))
+    return time.time() - start, usage.ru_maxrss / 1024
+
+
+def training_speed(metrics_file):
+    with open(metrics_file) as f:
+        report = json.loads(f.readlines()[-1])  # last report: cumulative counts
+    words = sum(thread['words'] for thread in report['threads'])
+    return words / report['time']
+
+
+def generate(filename, args, parallel=None, seed=1):
+    command = [sys.executable, 'scripts/generate-corpus.py', filename, '--tokens', str(args.tokens),
+               '--vocab-size', str(args.vocab_size), '--mean-length', str(args.mean_length), '--seed', str(seed)]
+    if parallel:
+        command += ['--parallel', parallel]
+    if not os.path.exists(filename) or (parallel and not os.path.exists(parallel)):
+        print('generating {}'.format(filename), file=sys.stderr)
+        subprocess.check_call(command)
+
+
+def benchmark(name, command, threads, tmp_dir, args):
+    model = os.path.join(tmp_dir, name + '.bin')
+    results = []
+
+    for n in threads:
+        metrics = os.path.join(tmp_dir, 'metrics.jsonl')
+        wall_time, rss = run(command + ['--threads', str(n), '--metrics', metrics, '--save', model])
+        words_per_sec = training_speed(metrics)
+        results.append({'model': name, 'threads': n, 'words_per_sec': words_per_sec,
+                        'words_per_sec_per_thread': words_per_sec / n, 'wall_time': wall_time, 'peak_rss_mb': rss})
+
+    load_times = [run([command[0], '--load', model]) for _ in range(args.load_runs)]
+    load_time, load_rss = min(load_times)
+    for result in results:
+        result['load_time'] = load_time
+        result['load_peak_rss_mb'] = load_rss
+
+    return results
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description=help_msg, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--threads', type=int, nargs='+', help='thread counts (default: 1, 2, 4... up to the number of CPUs)')
+    parser.add_argument('--tokens', type=int, default=5000000, help='size of the synthetic corpora')
+    parser.add_argument('--vocab-size', type=int, default=50000)
+    parser.add_argument('--mean-length', type=int, default=20, help='mean sentence length')
+    parser.add_argument('--dimension', type=int, default=100)
+    parser.add_argument('--iter', type=int, default=1)
+    parser.add_argument('--sg', action='store_true', help='skip-gram model (default: CBOW)')
+    parser.add_argument('--load-runs', type=int, default=3, help='number of load measurements (the best is kept)')
+    parser.add_argument('--data-dir', default='data/synthetic')
+    parser.add_argument('--bin-dir', default='bin')
+    parser.add_argument('--models', nargs='+', choices=['mono', 'bi'], default=['mono', 'bi'])
+    parser.add_argument('--output', help='also write the results to this file (JSON)')
+    args = parser.parse_args()
+
+    threads = args.threads
+    if not threads:
+        threads = [1]
+        while threads[-1] * 2 <= multiprocessing.cpu_count():
+            threads.append(threads[-1] * 2)
+
+    if not os.path.isdir(args.data_dir):
+        os.makedirs(args.data_dir)
+    prefix = os.path.join(args.data_dir, 'zipf.{}.{}.{}'.format(args.tokens, args.vocab_size, args.mean_length))
+    generate(prefix + '.src', args, parallel=prefix + '.trg')
+
+    options = ['--dimension', str(args.dimension), '--iter', str(args.iter), '--min-count', '1']
+    if args.sg:
+        options.append('--sg')
+
+    tmp_dir = tempfile.mkdtemp()
+    results = []
+    try:
+        if 'mono' in args.models:
+            command = [os.path.join(args.bin_dir, 'multivec-mono'), '--train', prefix + '.src'] + options
+            results += benchmark('mono', command, threads, tmp_dir, args)
+        if 'bi' in args.models:
+            command = [os.path.join(args.bin_dir, 'multivec-bi'), '--train-src', prefix + '.src',
+                       '--train-trg', prefix + '.trg'] + options
+            results += benchmark('bi', command, threads, tmp_dir, args)
+    finally:
+        for filename in os.listdir(tmp_dir):
+            os.remove(os.path.join(tmp_dir, filename))
+        os.rmdir(tmp_dir)
+
+    print('{:<6} {:>8} {:>14} {:>18} {:>12} {:>14} {:>12}'.format(
+        'model', 'threads', 'words/sec', 'words/sec/thread', 'wall (s)', 'peak RSS (MB)', 'load (s)'))
+    for r in results:
+        print('{:<6} {:>8} {:>14.0f} {:>18.0f} {:>12.2f} {:>14.1f} {:>12.3f}'.format(
+            r['model'], r['threads'], r['words_per_sec'], r['words_per_sec_per_thread'], r['wall_time'],
+            r['peak_rss_mb'], r['load_time']))
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump({'tokens': args.tokens, 'vocab_size': args.vocab_size, 'dimension': args.dimension,
+                       'iter': args.iter, 'sg': args.sg, 'results': results}, f, indent=2)
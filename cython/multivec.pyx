@@ -1,3 +1,4 @@
+import json
 import numpy as np
 from libcpp.string cimport string
 from libcpp.vector cimport vector
@@ -27,6 +28,17 @@ cdef extern from "utils.hpp":
         int skip_gram
         int negative
         int sent_vector
+        int dbow
+        int dbow_words
+        float online_tolerance
+        string sent_weights_file
+        int adagrad
+        string heldout_file
+        long long heldout_words
+        float heldout_tolerance
+        string metrics_file
+        float metrics_interval
+        int index_ef
 
     cdef cppclass BilingualConfig(Config):
         BilingualConfig()
@@ -39,11 +51,22 @@ cdef extern from "monolingual.hpp":
         Vec wordVec(const string&, int) except +
         Vec sentVec(const string&) except +
         void train(const string&, bool) except +
-        void load(const string&) except +
+        float heldoutLoss(const string&) except +
+        const string& lastMetrics()
+        void load(const string&, bool) except +
         void save(const string&) except +
+        void saveFlat(const string&) except +
+        void importVectors(const string&, bool, long long) except +
+        void saveQuantized(const string&, bool, int) except +
+        void buildIndex(int, int) except +
+        void saveIndex(const string&) except +
+        bool loadIndex(const string&) except +
+        void clearIndex()
+        bool hasIndex()
         void saveVectors(const string&, int) except +
         void saveVectorsBin(const string&, int) except +
-        void saveSentVectors(const string&) except +
+        void saveSentVectors(const string&, bool) except +
+        void saveOnlineSentVectors(const string&, const string&, bool) except +
         float similarity(const string&, const string&, int) except +
         float distance(const string&, const string&, int) except +
         float similarityNgrams(const string&, const string&, int) except +
@@ -58,12 +81,68 @@ cdef extern from "monolingual.hpp":
         Config* config
 
 
+cdef extern from "flat_model.hpp":
+    cdef cppclass FlatModelCpp "FlatModel":
+        FlatModelCpp(const string&) except +
+        int getDimension()
+        long long size()
+        int index(const string&)
+        Vec wordVec(const string&, int) except +
+        float similarity(const string&, const string&, int) except +
+        vector[pair[string, float]] closest(const Vec&, int, int) except +
+        vector[pair[string, float]] closest(const string&, int, int) except +
+        vector[pair[string, int]] getWords() except +
+
+
+cdef extern from "quantized.hpp":
+    cdef cppclass QuantizedModelCpp "QuantizedModel":
+        QuantizedModelCpp(const string&) except +
+        void setRescoring(const FlatModelCpp*) except +
+        int getDimension()
+        long long size()
+        int index(const string&)
+        Vec wordVec(const string&) except +
+        float similarity(const string&, const string&) except +
+        vector[pair[string, float]] closest(const Vec&, int, int) except +
+        vector[pair[string, float]] closest(const string&, int, int) except +
+        vector[pair[string, int]] getWords() except +
+
+
+cdef extern from "pq_index.hpp":
+    cdef cppclass PQConfig:
+        PQConfig()
+        int subquantizers
+        int lists
+        int iterations
+        long long training_size
+        int threads
+
+    cdef cppclass PQIndexCpp "PQIndex":
+        PQIndexCpp(const string&) except +
+        @staticmethod
+        void build(const MonolingualModelCpp&, const string&, const PQConfig&) except +
+        int getDimension()
+        long long size()
+        int subquantizers()
+        int lists()
+        int index(const string&)
+        Vec reconstruct(int)
+        vector[pair[string, float]] closest(const Vec&, int, int) except +
+        vector[pair[string, float]] closest(const string&, int, int) except +
+        vector[pair[string, int]] getWords() except +
+
+
 cdef extern from "bilingual.hpp":
     cdef cppclass BilingualModelCpp "BilingualModel":
         BilingualModelCpp(BilingualConfig*) except +
         void train(const string&, const string&, bool) except +
+        void trainCorpus(const string&, bool) except +
+        void buildCorpus(const string&, const string&, const string&, bool) except +
+        void alignCorpus(const string&, int) except +
+        void mapModels(const string&, int) except +
         void load(const string&) except +
         void save(const string&) except +
+        const string& lastMetrics()
         float similarity(const string&, const string&, int) except +
         float distance(const string&, const string&, int) except +
         float similarityNgrams(const string&, const string&, int) except +
@@ -72,19 +151,35 @@ cdef extern from "bilingual.hpp":
                                        const vector[float]&, const vector[float]&, float, int) except +
         vector[pair[string, float]] trg_closest(const string&, int, int) except +
         vector[pair[string, float]] src_closest(const string&, int, int) except +
+        vector[vector[pair[string, float]]] trg_closest(const vector[string]&, int, bint, int) except +
+        vector[vector[pair[string, float]]] src_closest(const vector[string]&, int, bint, int) except +
         MonolingualModelCpp src_model
         MonolingualModelCpp trg_model
         BilingualConfig* config
 
 
+cdef extern from "multilingual.hpp":
+    cdef cppclass MultilingualModelCpp "MultilingualModel":
+        MultilingualModelCpp(BilingualConfig*) except +
+        void addCorpus(const string&, const string&, const string&, const string&) except +
+        void train(bool) except +
+        void load(const string&) except +
+        void save(const string&) except +
+        const vector[string]& getLanguages()
+        MonolingualModelCpp& model(const string&) except +
+        float similarity(const string&, const string&, const string&, const string&, int) except +
+        vector[pair[string, float]] closest(const string&, const string&, const string&, int, int) except +
+
+
 cdef class MonolingualModel:
     """
-    MonolingualModel(name=None, **kwargs)
+    MonolingualModel(name=None, query_only=False, **kwargs)
     
     Parameters
     ----------
     name : path to an existing model. This model and its parameters
         (including vocabulary and configuration) will be loaded.
+    query_only : only load what queries need (see `load`)
     kwargs : overwrite configuration of the model (see attributes)
     
     Attributes
@@ -103,6 +198,24 @@ cdef class MonolingualModel:
         0 to disable negative sampling) (default: 5)
     sent_vector : include sentence vectors in training. This is an implementation of
         batch paragraph vector (default: False)
+    dbow : use the distributed bag of words (DBOW) paragraph vector model instead of
+        the distributed memory (DM) model, for batch and online paragraph vector (default: False)
+    dbow_words : in DBOW mode, also train word vectors (default: False)
+    online_tolerance : online paragraph vector (`sent_vec`) stops early when an iteration
+        changes the vector by less than this relative amount (set to 0 to disable) (default: 1e-03)
+    sent_weights_file : if set, the sentence vectors of batch paragraph vector are stored in this
+        memory-mapped file instead of the model, which makes it possible to train on collections
+        whose sentence vectors don't fit in memory (default: '')
+    adagrad : per-row AdaGrad, the learning rate of each embedding decreases with the magnitude
+        of its past updates, which converges in fewer iterations (default: False)
+    heldout_file : held-out corpus, whose loss is evaluated during training (default: '')
+    heldout_words : number of training words between two held-out evaluations (set to 0 to
+        evaluate about once per iteration) (default: 0)
+    heldout_tolerance : training stops early when the held-out loss improves by less than this
+        relative amount between two evaluations (set to 0 to disable) (default: 1e-03)
+    metrics_file : training metrics (words per second and loss of each thread, time spent
+        in I/O...) are written to this file as JSON lines (default: '')
+    metrics_interval : seconds between two metrics reports (default: 5)
     
     Examples
     --------
@@ -131,9 +244,9 @@ cdef class MonolingualModel:
         self.alloc = False
         return self
     
-    def __init__(self, name=None, **kwargs):
+    def __init__(self, name=None, query_only=False, **kwargs):
         if name is not None:
-            self.model.load(name)
+            self.model.load(name, query_only)
         
         # overwrites previous configuration
         for key, value in kwargs.items():
@@ -190,17 +303,40 @@ cdef class MonolingualModel:
         """
         self.model.train(name, initialize)
         
-    def load(self, name):
+    def heldout_loss(self, name):
         """
-        load(name)
+        heldout_loss(name)
+        
+        Mean loss per prediction of the model on the corpus of path `name` (without updating the model).
+        """
+        return self.model.heldoutLoss(name)
+        
+    def load(self, name, query_only=False):
+        """
+        load(name, query_only=False)
 
         Load model from disk (path `name`). This model must have been saved with `MonolingualModel.save`.
-        This function cannot load files in the word2vec format.
+        Files in the word2vec format can be loaded with `MonolingualModel.import_vectors`.
 
         The entire model, including configuration and vocabulary is loaded, and the existing
         parameters are overwritten.
+
+        With `query_only`, only the vocabulary and input weights are loaded, which is faster and uses
+        less memory. The rest of the model is loaded when it is needed (training, `sent_vec`...).
         """
-        self.model.load(name)
+        self.model.load(name, query_only)
+
+    def import_vectors(self, name, binary=False, max_vocab=0):
+        """
+        import_vectors(name, binary=False, max_vocab=0)
+
+        Load word vectors in the word2vec text (or binary) format, e.g., saved by another toolkit.
+        Only the first `max_vocab` words are kept (if it is non-zero).
+
+        The resulting model can be queried (`closest`, `similarity`...) and saved, but not trained,
+        as it has no output weights.
+        """
+        self.model.importVectors(name, binary, max_vocab)
 
     def save(self, name):
         """
@@ -212,6 +348,67 @@ cdef class MonolingualModel:
         """
         self.model.save(name)
 
+    def save_flat(self, name):
+        """
+        save_flat(name)
+
+        Save entire model to disk (path `name`) in the flat format. Those models can be loaded
+        with `MonolingualModel.load`, or opened read-only with `FlatModel` (memory-mapped, instant start).
+        """
+        self.model.saveFlat(name)
+
+    def save_quantized(self, name, fp16=False, policy=0):
+        """
+        save_quantized(name, fp16=False, policy=0)
+
+        Save the word vectors to disk (path `name`) quantized to 8-bit integers (or 16-bit floats
+        with `fp16`), for `QuantizedModel`.
+        """
+        self.model.saveQuantized(name, fp16, policy)
+
+    def build_index(self, links=16, ef_construction=200):
+        """
+        build_index(links=16, ef_construction=200)
+
+        Build an HNSW index of the word vectors, with which `closest` (with policy 0) returns approximate
+        results much faster (see `index_ef`). The index is saved next to the model by `save` and
+        `save_flat`, and loaded with it.
+        """
+        self.model.buildIndex(links, ef_construction)
+
+    def save_index(self, name):
+        self.model.saveIndex(name)
+
+    def load_index(self, name):
+        """
+        load_index(name)
+
+        Load an HNSW index saved with `save_index`. Return False if it was built for other vectors.
+        """
+        return self.model.loadIndex(name)
+
+    def clear_index(self):
+        self.model.clearIndex()
+
+    def has_index(self):
+        return self.model.hasIndex()
+
+    def save_pq(self, name, subquantizers=0, lists=0, iterations=10, training_size=100000):
+        """
+        save_pq(name, subquantizers=0, lists=0, iterations=10, training_size=100000)
+
+        Build a product quantization index of the word vectors, and save it to disk (path `name`),
+        for `PQIndex`. Each vector is encoded with `subquantizers` bytes (default: dimension / 4).
+        With `lists` > 0, the vectors are also partitioned into inverted lists (IVF).
+        """
+        cdef PQConfig config
+        config.subquantizers = subquantizers
+        config.lists = lists
+        config.iterations = iterations
+        config.training_size = training_size
+        config.threads = self.config.threads
+        PQIndexCpp.build(self.model[0], name, config)
+
     def save_vectors(self, name, policy=0):
         """
         save_vectors(name)
@@ -234,8 +431,27 @@ cdef class MonolingualModel:
         """
         self.model.saveVectorsBin(name, policy)
 
-    def save_sent_vectors(self, name):
-        self.model.saveSentVectors(name)
+    def save_sent_vectors(self, name, binary=False):
+        """
+        save_sent_vectors(name, binary=False)
+
+        Save the sentence vectors learned by batch paragraph vector (`sent_vector=True`)
+        to disk (path `name`), one vector per line. If `binary` is True, the vectors are
+        saved as a float32 matrix with no header (see `numpy.fromfile`).
+        """
+        self.model.saveSentVectors(name, binary)
+
+    def save_online_sent_vectors(self, name, output_name, binary=False):
+        """
+        save_online_sent_vectors(name, output_name, binary=False)
+
+        Perform paragraph vector inference on each line of file `name`, and save the
+        vectors to `output_name` in the same order (same format as `save_sent_vectors`).
+        Inference is performed in parallel with `threads` threads.
+
+        Lines that are empty or only contain OOV words get a vector of zeros.
+        """
+        self.model.saveOnlineSentVectors(name, output_name, binary)
     
     def similarity(self, word1, word2, policy=0):
         return self.model.similarity(word1, word2, policy)
@@ -269,6 +485,14 @@ cdef class MonolingualModel:
     def get_counts(self):
         cdef vector[pair[string, int]] word_counts = self.model.getWords()
         return dict(word_counts)
+    def get_metrics(self):
+        """
+        get_metrics()
+        
+        Last training metrics report (see `metrics_file`), as a dict (None if metrics were disabled).
+        """
+        metrics = self.model.lastMetrics()
+        return json.loads(metrics) if metrics else None
         
     property learning_rate:
         def __get__(self): return self.config.learning_rate
@@ -306,7 +530,175 @@ cdef class MonolingualModel:
     property sent_vector:
         def __get__(self): return self.config.sent_vector
         def __set__(self, sent_vector): self.config.sent_vector = sent_vector
+    property dbow:
+        def __get__(self): return self.config.dbow
+        def __set__(self, dbow): self.config.dbow = dbow
+    property dbow_words:
+        def __get__(self): return self.config.dbow_words
+        def __set__(self, dbow_words): self.config.dbow_words = dbow_words
+    property online_tolerance:
+        def __get__(self): return self.config.online_tolerance
+        def __set__(self, online_tolerance): self.config.online_tolerance = online_tolerance
+    property sent_weights_file:
+        def __get__(self): return self.config.sent_weights_file
+        def __set__(self, sent_weights_file): self.config.sent_weights_file = sent_weights_file
+    property adagrad:
+        def __get__(self): return self.config.adagrad
+        def __set__(self, adagrad): self.config.adagrad = adagrad
+    property heldout_file:
+        def __get__(self): return self.config.heldout_file
+        def __set__(self, heldout_file): self.config.heldout_file = heldout_file
+    property heldout_words:
+        def __get__(self): return self.config.heldout_words
+        def __set__(self, heldout_words): self.config.heldout_words = heldout_words
+    property heldout_tolerance:
+        def __get__(self): return self.config.heldout_tolerance
+        def __set__(self, heldout_tolerance): self.config.heldout_tolerance = heldout_tolerance
+    property metrics_file:
+        def __get__(self): return self.config.metrics_file
+        def __set__(self, metrics_file): self.config.metrics_file = metrics_file
+    property metrics_interval:
+        def __get__(self): return self.config.metrics_interval
+        def __set__(self, metrics_interval): self.config.metrics_interval = metrics_interval
+    property index_ef:
+        def __get__(self): return self.config.index_ef
+        def __set__(self, index_ef): self.config.index_ef = index_ef
+
+
+cdef class FlatModel:
+    """
+    FlatModel(name)
+
+    Read-only model, saved with `MonolingualModel.save_flat`. The file is mapped in memory
+    instead of being read: opening is instantaneous, and processes that open the same model
+    share its memory. Supports the same queries as `MonolingualModel`.
+    """
+    cdef FlatModelCpp* model
+
+    def __cinit__(self, name):
+        self.model = new FlatModelCpp(name)
+
+    def __dealloc__(self):
+        del self.model
+
+    def __len__(self):
+        return self.model.size()
+
+    def __contains__(self, word):
+        return self.model.index(word) != -1
+
+    def word_vec(self, word, policy=0):
+        cdef Vec vec = self.model.wordVec(word, policy)
+        cdef float* data = vec.data()
+        return np.array([data[i] for i in range(vec.size())])
+
+    def similarity(self, word1, word2, policy=0):
+        return self.model.similarity(word1, word2, policy)
+
+    def closest(self, word, n=10, policy=0):
+        cdef vector[pair[string, float]] res = self.model.closest(<const string&> word, <int> n, <int> policy)
+        return list(res)
+    def closest_to_vec(self, vec, n=10, policy=0):
+        cdef Vec vec_cpp = Vec(<vector[float]> vec)
+        res = self.model.closest(<const Vec&> vec_cpp, <int> n, <int> policy)
+        return list(res)
+    def get_vocabulary(self):
+        cdef vector[pair[string, int]] word_counts = self.model.getWords()
+        return [w for w, _ in word_counts]
+
+    property dimension:
+        def __get__(self): return self.model.getDimension()
+
+
+cdef class QuantizedModel:
+    """
+    QuantizedModel(name, rescoring=None)
+
+    Read-only word vectors, saved with `MonolingualModel.save_quantized`, and mapped in memory
+    like `FlatModel`. Similarities are computed on the int8 (or fp16) vectors.
+
+    `rescoring` is the `FlatModel` from which these vectors were saved: `closest` then
+    rescores its `rescore` best candidates with the exact vectors.
+    """
+    cdef QuantizedModelCpp* model
+    cdef FlatModel rescoring
+
+    def __cinit__(self, name, FlatModel rescoring=None):
+        self.model = new QuantizedModelCpp(name)
+        if rescoring is not None:
+            self.model.setRescoring(rescoring.model)
+            self.rescoring = rescoring  # keeps the flat model open
+
+    def __dealloc__(self):
+        del self.model
+
+    def __len__(self):
+        return self.model.size()
+
+    def __contains__(self, word):
+        return self.model.index(word) != -1
+
+    def word_vec(self, word):
+        cdef Vec vec = self.model.wordVec(word)
+        cdef float* data = vec.data()
+        return np.array([data[i] for i in range(vec.size())])
+
+    def similarity(self, word1, word2):
+        return self.model.similarity(word1, word2)
+
+    def closest(self, word, n=10, rescore=0):
+        cdef vector[pair[string, float]] res = self.model.closest(<const string&> word, <int> n, <int> rescore)
+        return list(res)
+    def closest_to_vec(self, vec, n=10, rescore=0):
+        cdef Vec vec_cpp = Vec(<vector[float]> vec)
+        res = self.model.closest(<const Vec&> vec_cpp, <int> n, <int> rescore)
+        return list(res)
+    def get_vocabulary(self):
+        cdef vector[pair[string, int]] word_counts = self.model.getWords()
+        return [w for w, _ in word_counts]
+
+    property dimension:
+        def __get__(self): return self.model.getDimension()
+
+cdef class PQIndex:
+    """
+    PQIndex(name)
+
+    Product quantization index, saved with `MonolingualModel.save_pq`, and mapped in memory.
+    `closest` returns approximate cosine similarities. With inverted lists, only the
+    `probes` lists that are the closest to the query are searched (0 for all the lists).
+    """
+    cdef PQIndexCpp* model
 
+    def __cinit__(self, name):
+        self.model = new PQIndexCpp(name)
+
+    def __dealloc__(self):
+        del self.model
+
+    def __len__(self):
+        return self.model.size()
+
+    def __contains__(self, word):
+        return self.model.index(word) != -1
+
+    def closest(self, word, n=10, probes=8):
+        cdef vector[pair[string, float]] res = self.model.closest(<const string&> word, <int> n, <int> probes)
+        return list(res)
+    def closest_to_vec(self, vec, n=10, probes=8):
+        cdef Vec vec_cpp = Vec(<vector[float]> vec)
+        res = self.model.closest(<const Vec&> vec_cpp, <int> n, <int> probes)
+        return list(res)
+    def get_vocabulary(self):
+        cdef vector[pair[string, int]] word_counts = self.model.getWords()
+        return [w for w, _ in word_counts]
+
+    property dimension:
+        def __get__(self): return self.model.getDimension()
+    property subquantizers:
+        def __get__(self): return self.model.subquantizers()
+    property lists:
+        def __get__(self): return self.model.lists()
 
 cdef class BilingualModel:
     """
@@ -337,6 +729,9 @@ cdef class BilingualModel:
         0 to disable negative sampling) (default: 5)
     sent_vector : include sentence vectors in training. This is an implementation of
         batch paragraph vector (default: False)
+    adagrad : per-row AdaGrad learning rates (default: False)
+    metrics_file : write training metrics to this file, as JSON lines (default: '')
+    metrics_interval : seconds between two metrics reports (default: 5)
     
     Examples
     --------
@@ -368,6 +763,27 @@ cdef class BilingualModel:
 
     def train(self, src_name, trg_name, initialize=True):
         self.model.train(src_name, trg_name, initialize)
+
+    def build_corpus(self, src_name, trg_name, corpus_name, initialize=True):
+        self.model.buildCorpus(src_name, trg_name, corpus_name, initialize)
+
+    def align_corpus(self, corpus_name, iterations=5):
+        self.model.alignCorpus(corpus_name, iterations)
+
+    def train_corpus(self, corpus_name, initialize=True):
+        self.model.trainCorpus(corpus_name, initialize)
+
+    def map_models(self, dictionary=None, self_learning=0):
+        """
+        map_models(dictionary=None, self_learning=0)
+
+        Map src_model into the space of trg_model (orthogonal Procrustes), for two monolingual
+        models that were trained independently (e.g. loaded with `src_model.load` and `trg_model.load`).
+        `dictionary` is the path to a seed dictionary (one word pair per line), by default words
+        that are identical in both vocabularies are used. `self_learning` is the maximum number of
+        self-learning iterations.
+        """
+        self.model.mapModels(dictionary if dictionary is not None else b'', self_learning)
     
     def save(self, name):
         self.model.save(name)
@@ -375,6 +791,10 @@ cdef class BilingualModel:
     def load(self, name):
         self.model.load(name)
 
+    def get_metrics(self):
+        metrics = self.model.lastMetrics()
+        return json.loads(metrics) if metrics else None
+
     def similarity(self, src_word, trg_word, policy=0):
         return self.model.similarity(src_word, trg_word, policy)
     def distance(self, src_word, trg_word, policy=0):
@@ -394,6 +814,22 @@ cdef class BilingualModel:
         cdef vector[pair[string, float]] res = self.model.src_closest(<const string&> trg_word, <int> n, <int> policy)
         return list(res)
 
+    def trg_closest_batch(self, src_words=None, n=10, csls=False, policy=0):
+        """
+        trg_closest_batch(src_words=None, n=10, csls=False, policy=0)
+
+        Return the `n` closest target words of each word in `src_words` (all source words if None,
+        in the order of src_model.get_vocabulary()), computed with batched matrix products. With `csls`,
+        the scores are cross-domain similarity local scaling (CSLS), which reduces hubness.
+        """
+        cdef vector[string] words = src_words if src_words is not None else []
+        cdef vector[vector[pair[string, float]]] res = self.model.trg_closest(words, <int> n, <bint> csls, <int> policy)
+        return [list(x) for x in res]
+    def src_closest_batch(self, trg_words=None, n=10, csls=False, policy=0):
+        cdef vector[string] words = trg_words if trg_words is not None else []
+        cdef vector[vector[pair[string, float]]] res = self.model.src_closest(words, <int> n, <bint> csls, <int> policy)
+        return [list(x) for x in res]
+
     property src_model:
         def __get__(self):
             # create the model on the fly, because the reference can (in theory) change
@@ -442,4 +878,120 @@ cdef class BilingualModel:
     property sent_vector:
         def __get__(self): return self.config.sent_vector
         def __set__(self, sent_vector): self.config.sent_vector = sent_vector
+    property adagrad:
+        def __get__(self): return self.config.adagrad
+        def __set__(self, adagrad): self.config.adagrad = adagrad
+    property metrics_file:
+        def __get__(self): return self.config.metrics_file
+        def __set__(self, metrics_file): self.config.metrics_file = metrics_file
+    property metrics_interval:
+        def __get__(self): return self.config.metrics_interval
+        def __set__(self, metrics_interval): self.config.metrics_interval = metrics_interval
+
+
+cdef class MultilingualModel:
+    """
+    MultilingualModel(name=None, **kwargs)
+
+    Joint model of several languages, trained with one parallel corpus per language pair.
+    Each language has a single monolingual model, shared by all its language pairs.
+
+    Parameters
+    ----------
+    name : path to an existing model. This model and its parameters
+        (including vocabularies and configuration) will be loaded.
+    kwargs : overwrite configuration of the model (see attributes of BilingualModel)
+
+    Attributes
+    ----------
+    languages : list of the languages of the model
+
+    Examples
+    --------
+    >>> model = MultilingualModel(dimension=300, threads=16)
+    >>> model.add_corpus('en', 'fr', '../data/europarl.en-fr.en', '../data/europarl.en-fr.fr')
+    >>> model.add_corpus('en', 'de', '../data/europarl.en-de.en', '../data/europarl.en-de.de')
+    >>> model.train()
+    >>> model.closest('fr', 'maison', 'de')
+    """
+    cdef BilingualConfig* config
+    cdef MultilingualModelCpp* model
+    def __cinit__(self, name=None, **kwargs):
+        self.config = new BilingualConfig()
+        self.model = new MultilingualModelCpp(self.config)
+        if name is not None:
+            self.model.load(name)
+
+        # overwrites previous configuration
+        for key, value in kwargs.items():
+            if value is not None:
+                setattr(self, key, value)
+
+    def __dealloc__(self):
+        # careful: this will break children monolingual models (because they use the same config and c++ models)
+        del self.model
+        del self.config
+
+    def add_corpus(self, src_lang, trg_lang, src_name, trg_name):
+        self.model.addCorpus(src_lang, trg_lang, src_name, trg_name)
+
+    def train(self, initialize=True):
+        self.model.train(initialize)
+
+    def save(self, name):
+        self.model.save(name)
+
+    def load(self, name):
+        self.model.load(name)
+
+    def lang_model(self, lang):
+        return MonolingualModel().set_members(&self.model.model(lang), self.config)
 
+    def similarity(self, lang1, word1, lang2, word2, policy=0):
+        return self.model.similarity(lang1, word1, lang2, word2, policy)
+
+    def closest(self, src_lang, word, trg_lang, n=10, policy=0):
+        cdef vector[pair[string, float]] res = self.model.closest(src_lang, word, trg_lang, <int> n, <int> policy)
+        return list(res)
+
+    property languages:
+        def __get__(self): return list(self.model.getLanguages())
+    property beta:
+        def __get__(self): return self.config.beta
+        def __set__(self, beta): self.config.beta = beta
+    property learning_rate:
+        def __get__(self): return self.config.learning_rate
+        def __set__(self, learning_rate): self.config.learning_rate = learning_rate
+    property dimension:
+        def __get__(self): return self.config.dimension
+        def __set__(self, dimension): self.config.dimension = dimension
+    property min_count:
+        def __get__(self): return self.config.min_count
+        def __set__(self, min_count): self.config.min_count = min_count
+    property iterations:
+        def __get__(self): return self.config.iterations
+        def __set__(self, iterations): self.config.iterations = iterations
+    property window_size:
+        def __get__(self): return self.config.window_size
+        def __set__(self, window_size): self.config.window_size = window_size
+    property threads:
+        def __get__(self): return self.config.threads
+        def __set__(self, threads): self.config.threads = threads
+    property subsampling:
+        def __get__(self): return self.config.subsampling
+        def __set__(self, subsampling): self.config.subsampling = subsampling
+    property verbose:
+        def __get__(self): return self.config.verbose
+        def __set__(self, verbose): self.config.verbose = verbose
+    property hierarchical_softmax:
+        def __get__(self): return self.config.hierarchical_softmax
+        def __set__(self, hierarchical_softmax): self.config.hierarchical_softmax = hierarchical_softmax
+    property skip_gram:
+        def __get__(self): return self.config.skip_gram
+        def __set__(self, skip_gram): self.config.skip_gram = skip_gram
+    property negative:
+        def __get__(self): return self.config.negative
+        def __set__(self, negative): self.config.negative = negative
+    property adagrad:
+        def __get__(self): return self.config.adagrad
+        def __set__(self, adagrad): self.config.adagrad = adagrad
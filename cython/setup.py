@@ -2,7 +2,12 @@ from distutils.core import setup, Extension
 from Cython.Build import cythonize
 import numpy
 
-sources = ["multivec.pyx", "../multivec/monolingual.cpp", "../multivec/bilingual.cpp", "../multivec/distance.cpp"]
+sources = ["multivec.pyx", "../multivec/monolingual.cpp", "../multivec/bilingual.cpp", "../multivec/distance.cpp",
+           "../multivec/cluster.cpp", "../multivec/metrics.cpp", "../multivec/parallel_corpus.cpp",
+           "../multivec/aligner.cpp", "../multivec/multilingual.cpp",
+           "../multivec/linalg.cpp", "../multivec/mapping.cpp", "../multivec/scaling.cpp",
+           "../multivec/flat_model.cpp", "../multivec/import.cpp",
+           "../multivec/quantized.cpp", "../multivec/pq_index.cpp", "../multivec/hnsw.cpp"]
 module = Extension("multivec", sources, undef_macros=['NDEBUG'], language="c++")
 module.extra_compile_args = ['--std=c++11', '-w', '-I../multivec', '-O3']
 module.libraries = ['m']
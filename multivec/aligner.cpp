@@ -0,0 +1,184 @@
+#include "aligner.hpp"
+
+static double digamma(double x) {
+    double result = 0;
+    for (; x < 7; ++x) result -= 1 / x;
+    x -= 0.5;
+    double xx = 1 / x, xx2 = xx * xx, xx4 = xx2 * xx2;
+    result += log(x) + xx2 / 24 - 7 * xx4 / 960 + 31 * xx4 * xx2 / 8064 - 127 * xx4 * xx4 / 30720;
+    return result;
+}
+
+/**
+ * @brief Run `function` on each chunk id in [0, threads), with one thread per chunk.
+ */
+static void runThreads(int threads, const std::function<void(int)>& function) {
+    if (threads == 1) {
+        function(0);
+        return;
+    }
+
+    vector<thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(thread(function, i));
+    }
+    for (auto it = workers.begin(); it != workers.end(); ++it) {
+        it->join();
+    }
+}
+
+Aligner::Aligner(const ParallelCorpus& corpus, int threads, int iterations, float null_prob, float tension,
+                 float alpha) :
+    corpus(corpus), threads(std::max(threads, 1)), iterations(iterations), null_prob(null_prob),
+    tension(tension), alpha(alpha), src_vocab_size(corpus.srcVocabSize()), trg_vocab_size(corpus.trgVocabSize()),
+    probs(corpus.trgVocabSize() + 2), uniform(true) {
+}
+
+float Aligner::translationProb(int src_word, int trg_index) const {
+    if (uniform) return 1.0f / src_vocab_size;
+
+    auto it = probs[trg_index].find(src_word);
+    return it == probs[trg_index].end() ? 1e-09f : it->second;
+}
+
+float Aligner::diagonalProb(int i, int j, int m, int n) const {
+    // unnormalized
+    return exp(-tension * std::abs(static_cast<float>(i + 1) / m - static_cast<float>(j + 1) / n));
+}
+
+/**
+ * @brief E-step on a chunk of the corpus: collect the expected counts of each (target, source)
+ * word pair into `counts`.
+ * @return log-likelihood of this chunk
+ */
+double Aligner::expectChunk(Table& counts, int chunk_id) const {
+    long long chunk_start = corpus.size() * chunk_id / threads;
+    long long chunk_end = corpus.size() * (chunk_id + 1) / threads;
+
+    double log_likelihood = 0;
+    vector<float> posteriors;
+
+    for (long long k = chunk_start; k < chunk_end; ++k) {
+        const int* src = corpus.src(k);
+        const int* trg = corpus.trg(k);
+        int m = corpus.srcLength(k);
+        int n = corpus.trgLength(k);
+        posteriors.resize(n + 1);
+
+        for (int i = 0; i < m; ++i) {
+            if (src[i] == -1) continue;  // OOV source words are not aligned
+
+            float diagonal_sum = 0;
+            for (int j = 0; j < n; ++j) {
+                posteriors[j] = diagonalProb(i, j, m, n);
+                diagonal_sum += posteriors[j];
+            }
+
+            float sum = posteriors[n] = null_prob * translationProb(src[i], nullIndex());
+            for (int j = 0; j < n; ++j) {
+                posteriors[j] *= (1 - null_prob) / diagonal_sum * translationProb(src[i], trgIndex(trg[j]));
+                sum += posteriors[j];
+            }
+
+            log_likelihood += log(sum);
+
+            for (int j = 0; j < n; ++j) {
+                counts[trgIndex(trg[j])][src[i]] += posteriors[j] / sum;
+            }
+            counts[nullIndex()][src[i]] += posteriors[n] / sum;
+        }
+    }
+
+    return log_likelihood;
+}
+
+/**
+ * @brief M-step on a range of target words: merge the counts of all threads, and update
+ * the translation probabilities (mean-field update with a Dirichlet prior).
+ */
+void Aligner::maximize(const vector<Table>& counts, int chunk_id) {
+    int chunk_start = probs.size() * chunk_id / threads;
+    int chunk_end = probs.size() * (chunk_id + 1) / threads;
+
+    for (int e = chunk_start; e < chunk_end; ++e) {
+        auto& row = probs[e];
+        row.clear();
+
+        for (auto it = counts.begin(); it != counts.end(); ++it) {
+            for (auto count = (*it)[e].begin(); count != (*it)[e].end(); ++count) {
+                row[count->first] += count->second;
+            }
+        }
+
+        double total = 0;
+        for (auto it = row.begin(); it != row.end(); ++it) total += it->second;
+
+        double denominator = digamma(total + alpha * src_vocab_size);
+        for (auto it = row.begin(); it != row.end(); ++it) {
+            it->second = exp(digamma(it->second + alpha) - denominator);
+        }
+    }
+}
+
+void Aligner::train(bool verbose) {
+    for (int k = 0; k < iterations; ++k) {
+        vector<Table> counts(threads, Table(probs.size()));
+        vector<double> log_likelihoods(threads);
+
+        runThreads(threads, [&](int chunk_id) {
+            log_likelihoods[chunk_id] = expectChunk(counts[chunk_id], chunk_id);
+        });
+        runThreads(threads, [&](int chunk_id) {
+            maximize(counts, chunk_id);
+        });
+        uniform = false;
+
+        if (verbose) {
+            double log_likelihood = 0;
+            for (auto it = log_likelihoods.begin(); it != log_likelihoods.end(); ++it) log_likelihood += *it;
+            std::cout << "Alignment iteration " << k + 1 << ", log-likelihood: " << log_likelihood
+                      << ", perplexity: " << exp(-log_likelihood / corpus.srcTokens()) << std::endl;
+        }
+    }
+}
+
+void Aligner::alignChunk(vector<int>& alignment, int chunk_id) const {
+    long long chunk_start = corpus.size() * chunk_id / threads;
+    long long chunk_end = corpus.size() * (chunk_id + 1) / threads;
+
+    for (long long k = chunk_start; k < chunk_end; ++k) {
+        const int* src = corpus.src(k);
+        const int* trg = corpus.trg(k);
+        int m = corpus.srcLength(k);
+        int n = corpus.trgLength(k);
+        int* output = alignment.data() + corpus.srcOffset(k);
+
+        for (int i = 0; i < m; ++i) {
+            output[i] = -1;
+            if (src[i] == -1) continue;
+
+            float diagonal_sum = 0;
+            for (int j = 0; j < n; ++j) diagonal_sum += diagonalProb(i, j, m, n);
+
+            float best = null_prob * translationProb(src[i], nullIndex());
+            for (int j = 0; j < n; ++j) {
+                float prob = (1 - null_prob) * diagonalProb(i, j, m, n) / diagonal_sum *
+                             translationProb(src[i], trgIndex(trg[j]));
+                if (prob > best) {
+                    best = prob;
+                    output[i] = j;
+                }
+            }
+        }
+    }
+}
+
+vector<int> Aligner::align() const {
+    vector<int> alignment(corpus.srcTokens(), -1);
+
+    runThreads(threads, [&](int chunk_id) {
+        alignChunk(alignment, chunk_id);
+    });
+
+    return alignment;
+}
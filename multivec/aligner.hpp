@@ -0,0 +1,49 @@
+#pragma once
+#include "utils.hpp"
+#include "parallel_corpus.hpp"
+
+/**
+ * @brief Unsupervised word aligner (IBM Model 2 with a diagonal prior, as in fast_align),
+ * trained with EM on a binary parallel corpus.
+ *
+ * Each source word is aligned to at most one target word (or to NULL). The probability of
+ * aligning source position i to target position j decreases exponentially with the distance
+ * to the diagonal: exp(-tension * |i / m - j / n|). Translation probabilities t(src | trg) are
+ * estimated with variational Bayes (sparse Dirichlet prior), which works better for rare words.
+ *
+ * The E-step is multi-threaded: each thread collects expected counts on its own part of
+ * the corpus, which are then merged (also in parallel) in the M-step.
+ */
+class Aligner {
+    const ParallelCorpus& corpus;
+
+    int threads;
+    int iterations;
+    float null_prob;       // prior probability of aligning to NULL
+    float tension;         // diagonal tension (the larger, the closer to the diagonal)
+    float alpha;           // Dirichlet prior
+
+    int src_vocab_size;
+    int trg_vocab_size;
+
+    typedef vector<unordered_map<int, float>> Table; // one map per target word, indexed by source word
+    Table probs;           // t(src | trg): target words, then UNK, then NULL
+    bool uniform;          // first iteration: uniform translation probabilities
+
+    int trgIndex(int word) const { return word == -1 ? trg_vocab_size : word; }
+    int nullIndex() const { return trg_vocab_size + 1; }
+
+    float translationProb(int src_word, int trg_index) const;
+    float diagonalProb(int i, int j, int m, int n) const;
+
+    double expectChunk(Table& counts, int chunk_id) const;
+    void maximize(const vector<Table>& counts, int chunk_id);
+    void alignChunk(vector<int>& alignment, int chunk_id) const;
+
+public:
+    Aligner(const ParallelCorpus& corpus, int threads = 4, int iterations = 5,
+            float null_prob = 0.08, float tension = 4.0, float alpha = 0.01);
+
+    void train(bool verbose = false);
+    vector<int> align() const; // most likely target position of each source token in the corpus (or -1)
+};
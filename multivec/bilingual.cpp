@@ -1,5 +1,8 @@
 #include "bilingual.hpp"
 #include "serialization.hpp"
+#include "cluster.hpp"
+#include "aligner.hpp"
+#include "mapping.hpp"
 
 void BilingualModel::train(const string& src_file, const string& trg_file, bool initialize) {
     std::cout << "Training files: " << src_file << ", " << trg_file << std::endl;
@@ -16,28 +19,207 @@ void BilingualModel::train(const string& src_file, const string& trg_file, bool
         // TODO: check that initialization is fine
     }
 
-    words_processed = 0;
-    alpha = config->learning_rate;
-
     // read files to find out the beginning of each chunk
     auto src_chunks = src_model.chunkify(src_file, config->threads);
     auto trg_chunks = trg_model.chunkify(trg_file, config->threads);
 
+    trainThreads([&](int chunk_id) {
+        trainChunk(src_file, trg_file, src_chunks, trg_chunks, chunk_id);
+    });
+}
+
+/**
+ * @brief Convert a parallel corpus to the binary format (see ParallelCorpus), which can then
+ * be used with `trainCorpus`. Word indices depend on the vocabulary of the model, which is created
+ * from the text files if `initialize` is true.
+ */
+void BilingualModel::buildCorpus(const string& src_file, const string& trg_file, const string& corpus_file,
+                                 bool initialize) {
+    if (initialize) {
+        if (config->verbose)
+            std::cout << "Creating new model" << std::endl;
+
+        src_model.readVocab(src_file);
+        trg_model.readVocab(trg_file);
+        src_model.initNet();
+        trg_model.initNet();
+    }
+
+    if (config->verbose)
+        std::cout << "Saving binary corpus to " << corpus_file << std::endl;
+
+    ParallelCorpus::build(src_file, trg_file, src_model.vocabulary, trg_model.vocabulary, corpus_file);
+}
+
+/**
+ * @brief Align a binary parallel corpus with a multi-threaded IBM Model 2 (see Aligner).
+ * The alignment is saved in the corpus file, and used by `trainCorpus` instead of the
+ * uniform alignment.
+ */
+void BilingualModel::alignCorpus(const string& corpus_file, int iterations) {
+    if (config->verbose)
+        std::cout << "Aligning corpus " << corpus_file << std::endl;
+
     high_resolution_clock::time_point start = high_resolution_clock::now();
+
+    vector<int> alignment;
+    {
+        ParallelCorpus corpus(corpus_file);
+        Aligner aligner(corpus, config->threads, iterations);
+        aligner.train(config->verbose);
+        alignment = aligner.align();
+    } // unmap the file before modifying it
+
+    ParallelCorpus::saveAlignment(corpus_file, alignment);
+
+    high_resolution_clock::time_point end = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(end - start).count();
+    std::cout << "Alignment time: " << static_cast<float>(duration) / 1000000 << std::endl;
+}
+
+/**
+ * @brief Map two independently trained monolingual models into the same space. The source
+ * model is transformed (orthogonal mapping), and the target model is unchanged.
+ *
+ * @param dictionary_file seed dictionary (one source word and its translation per line). If empty,
+ * words that are identical in both vocabularies are used.
+ * @param self_learning maximum number of self-learning iterations (0 for no self-learning)
+ */
+void BilingualModel::mapModels(const string& dictionary_file, int self_learning) {
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+
+    CrossLingualMapper mapper(src_model, trg_model, config->threads, config->verbose);
+    auto dictionary = dictionary_file.empty() ? mapper.identicalWords() : mapper.readDictionary(dictionary_file);
+
+    if (self_learning > 0) {
+        mapper.selfLearning(dictionary, self_learning);
+    } else {
+        mapper.fit(dictionary);
+    }
+
+    mapper.apply(src_model);
+
+    high_resolution_clock::time_point end = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(end - start).count();
+    std::cout << "Mapping time: " << static_cast<float>(duration) / 1000000 << std::endl;
+}
+
+/**
+ * @brief Check that the vocabulary of a model is the one that was used to build a corpus.
+ */
+static bool sameVocab(const unordered_map<string, HuffmanNode>& vocabulary, const vector<pair<string, int>>& words) {
+    if (vocabulary.size() != words.size()) return false;
+
+    for (int i = 0; i < words.size(); ++i) {
+        auto it = vocabulary.find(words[i].first);
+        if (it == vocabulary.end() || it->second.index != i) return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Train model with a binary parallel corpus (see `buildCorpus`). The corpus is memory-mapped,
+ * and contains the vocabularies, so no text processing is needed.
+ *
+ * @param corpus_file path of the binary corpus
+ * @param initialize create a new model, with the vocabularies of the corpus. Otherwise, the model
+ * must have the vocabularies that were used to build the corpus.
+ */
+void BilingualModel::trainCorpus(const string& corpus_file, bool initialize) {
+    std::cout << "Training corpus: " << corpus_file << std::endl;
+
+    ParallelCorpus corpus(corpus_file);
+
+    if (initialize) {
+        if (config->verbose)
+            std::cout << "Creating new model" << std::endl;
+
+        src_model.initVocab(corpus.srcVocab());
+        trg_model.initVocab(corpus.trgVocab());
+        src_model.initNet();
+        trg_model.initNet();
+    } else if (!sameVocab(src_model.vocabulary, corpus.srcVocab()) ||
+               !sameVocab(trg_model.vocabulary, corpus.trgVocab())) {
+        throw runtime_error("the vocabulary of the model doesn't match the corpus");
+    }
+
+    src_model.indexVocab();
+    trg_model.indexVocab();
+    src_model.training_lines = trg_model.training_lines = corpus.size();
+    src_model.training_words = corpus.srcTokens();
+    trg_model.training_words = corpus.trgTokens();
+
+    if (config->verbose)
+        std::cout << "Number of sentence pairs: " << corpus.size() << ", words: "
+                  << corpus.srcTokens() + corpus.trgTokens() << std::endl;
+
+    trainThreads([&](int chunk_id) {
+        trainCorpusChunk(corpus, chunk_id);
+    });
+}
+
+/**
+ * @brief Run the training function `train_chunk` on each chunk of the data, with one
+ * thread per chunk.
+ */
+void BilingualModel::trainThreads(const std::function<void(int)>& train_chunk) {
+    words_processed = 0;
+    alpha = config->learning_rate;
+    src_model.initAdaGrad();
+    trg_model.initAdaGrad();
+    src_model.clearIndex(); // built for the old weights
+    trg_model.clearIndex();
+
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+
+    // data-parallel training: synchronize with the other processes in a separate thread
+    std::unique_ptr<Cluster> cluster;
+    std::atomic<bool> training_done(false);
+    thread sync_thread;
+    if (config->cluster_size > 1) {
+        cluster.reset(new Cluster(config->cluster_address, config->cluster_rank, config->cluster_size,
+            {&src_model.input_weights, &src_model.output_weights, &src_model.output_weights_hs,
+             &trg_model.input_weights, &trg_model.output_weights, &trg_model.output_weights_hs},
+            src_model.signature() * 31 + trg_model.signature()));
+        sync_thread = thread(&Cluster::run, cluster.get(), std::cref(words_processed),
+            config->sync_words, std::cref(training_done));
+    }
+
+    // training metrics, reported in a separate thread
+    std::unique_ptr<MetricsReporter> reporter;
+    thread metrics_thread;
+    if (!config->metrics_file.empty() || metrics_callback) {
+        reporter.reset(new MetricsReporter(config->threads, config->metrics_file, metrics_callback,
+            config->metrics_interval));
+        metrics = reporter.get();
+        metrics_thread = thread(&MetricsReporter::run, reporter.get(), std::cref(alpha), std::cref(words_processed),
+            config->iterations * (src_model.training_words + trg_model.training_words), std::cref(training_done));
+    }
+
     if (config->threads == 1) {
-        trainChunk(src_file, trg_file, src_chunks, trg_chunks, 0);
+        train_chunk(0);
     } else {
         vector<thread> threads;
 
         for (int i = 0; i < config->threads; ++i) {
-            threads.push_back(thread(&BilingualModel::trainChunk, this,
-                src_file, trg_file, src_chunks, trg_chunks, i));
+            threads.push_back(thread(train_chunk, i));
         }
 
         for (auto it = threads.begin(); it != threads.end(); ++it) {
             it->join();
         }
     }
+
+    training_done = true;
+    if (cluster) {
+        sync_thread.join();
+    }
+    if (reporter) {
+        metrics_thread.join();
+        last_metrics = reporter->lastReport();
+        metrics = 0;
+    }
     high_resolution_clock::time_point end = high_resolution_clock::now();
     auto duration = duration_cast<microseconds>(end - start).count();
 
@@ -47,6 +229,30 @@ void BilingualModel::train(const string& src_file, const string& trg_file, bool
     std::cout << "Training time: " << static_cast<float>(duration) / 1000000 << std::endl;
 }
 
+/**
+ * @brief Update the global progress and the learning rate (every 10000 words).
+ */
+void BilingualModel::updateProgress(int word_count, int& last_count, long long training_words) {
+    if (word_count - last_count <= 10000) return;
+
+    float starting_alpha = config->learning_rate;
+    int max_iterations = config->iterations;
+
+    long long processed = words_processed.fetch_add(word_count - last_count, std::memory_order_relaxed)
+        + word_count - last_count;
+    last_count = word_count;
+
+    float new_alpha = starting_alpha * (1 - static_cast<float>(processed) / (max_iterations * training_words));
+    new_alpha = std::max(new_alpha, starting_alpha * 0.0001f);
+    alpha.store(new_alpha, std::memory_order_relaxed);
+
+    if (config->verbose) {
+        printf("\rAlpha: %f  Progress: %.2f%%", new_alpha, 100.0 * processed /
+                        (max_iterations * training_words));
+        fflush(stdout);
+    }
+}
+
 void BilingualModel::trainChunk(const string& src_file,
                                 const string& trg_file,
                                 const vector<long long>& src_chunks,
@@ -64,10 +270,12 @@ void BilingualModel::trainChunk(const string& src_file,
         throw;
     }
     
-    float starting_alpha = config->learning_rate;
     int max_iterations = config->iterations;
     long long training_words = src_model.training_words + trg_model.training_words;
 
+    ThreadMetrics* thread_metrics = metrics ? &metrics->threadMetrics(chunk_id) : 0;
+    if (thread_metrics) thread_metrics->last = high_resolution_clock::now();
+
     for (int k = 0; k < max_iterations; ++k) {
         int word_count = 0, last_count = 0;
 
@@ -77,35 +285,78 @@ void BilingualModel::trainChunk(const string& src_file,
         trg_infile.seekg(trg_chunks[chunk_id], trg_infile.beg);
 
         string src_sent, trg_sent;
-        while (getline(src_infile, src_sent) && getline(trg_infile, trg_sent)) {
-            word_count += trainSentence(src_sent, trg_sent);
-
-            // update learning rate
-            if (word_count - last_count > 10000) {
-                words_processed += word_count - last_count; // asynchronous update
-                last_count = word_count;
-
-                alpha = starting_alpha * (1 - static_cast<float>(words_processed) / (max_iterations * training_words));
-                alpha = std::max(alpha, starting_alpha * 0.0001f);
-
-                if (config->verbose) {
-                    printf("\rAlpha: %f  Progress: %.2f%%", alpha, 100.0 * words_processed /
-                                    (max_iterations * training_words));
-                    fflush(stdout);
-                }
+        while (read_line(src_infile, src_sent) && read_line(trg_infile, trg_sent)) {
+            if (thread_metrics) thread_metrics->lap(thread_metrics->io_time);
+            // same size as src_sent and trg_sent, OOV words are replaced by <UNK>
+            auto src_nodes = src_model.getNodes(src_sent);
+            auto trg_nodes = trg_model.getNodes(trg_sent);
+            if (thread_metrics) thread_metrics->lap(thread_metrics->nodes_time);
+
+            float loss = 0;
+            int words = trainSentence(std::move(src_nodes), std::move(trg_nodes), 0, thread_metrics ? &loss : 0);
+            word_count += words;
+
+            if (thread_metrics) {
+                thread_metrics->lap(thread_metrics->train_time);
+                thread_metrics->addSentence(words, loss);
             }
 
+            updateProgress(word_count, last_count, training_words);
+
             // stop when reaching the end of a chunk
             if (chunk_id < src_chunks.size() - 1 && src_infile.tellg() >= src_chunks[chunk_id + 1])
                 break;
         }
 
-        words_processed += word_count - last_count;
+        words_processed.fetch_add(word_count - last_count, std::memory_order_relaxed);
+    }
+}
+
+void BilingualModel::trainCorpusChunk(const ParallelCorpus& corpus, int chunk_id) {
+    int max_iterations = config->iterations;
+    long long training_words = corpus.srcTokens() + corpus.trgTokens();
+
+    // chunks with the same number of sentence pairs
+    long long chunk_start = corpus.size() * chunk_id / config->threads;
+    long long chunk_end = corpus.size() * (chunk_id + 1) / config->threads;
+
+    ThreadMetrics* thread_metrics = metrics ? &metrics->threadMetrics(chunk_id) : 0;
+    if (thread_metrics) thread_metrics->last = high_resolution_clock::now();
+
+    for (int k = 0; k < max_iterations; ++k) {
+        int word_count = 0, last_count = 0;
+
+        for (long long i = chunk_start; i < chunk_end; ++i) {
+            // the corpus is memory-mapped: reading it is part of getNodes
+            auto src_nodes = src_model.getNodes(corpus.src(i), corpus.srcLength(i));
+            auto trg_nodes = trg_model.getNodes(corpus.trg(i), corpus.trgLength(i));
+            if (thread_metrics) thread_metrics->lap(thread_metrics->nodes_time);
+
+            float loss = 0;
+            int words = trainSentence(std::move(src_nodes), std::move(trg_nodes), corpus.alignment(i),
+                                      thread_metrics ? &loss : 0);
+            word_count += words;
+
+            if (thread_metrics) {
+                thread_metrics->lap(thread_metrics->train_time);
+                thread_metrics->addSentence(words, loss);
+            }
+
+            updateProgress(word_count, last_count, training_words);
+        }
+
+        words_processed.fetch_add(word_count - last_count, std::memory_order_relaxed);
     }
 }
 
-vector<int> BilingualModel::uniformAlignment(const vector<HuffmanNode>& src_nodes,
-                                             const vector<HuffmanNode>& trg_nodes) {
+/**
+ * @brief Map each source node to a target node. `word_alignment` gives the target position
+ * of each source word (or -1). If it is null, the alignment is uniform (along the diagonal).
+ * The result is expressed in positions without the UNK nodes.
+ */
+vector<int> BilingualModel::getAlignment(const vector<HuffmanNode>& src_nodes,
+                                         const vector<HuffmanNode>& trg_nodes,
+                                         const int* word_alignment) {
     vector<int> alignment; // index = position in src_nodes, value = position in trg_nodes (or -1)
 
     vector<int> trg_mapping; // maps positions in trg_sent to positions in trg_nodes (or -1)
@@ -115,10 +366,13 @@ vector<int> BilingualModel::uniformAlignment(const vector<HuffmanNode>& src_node
     }
 
     for (int i = 0; i < src_nodes.size(); ++i) {
-        int j = i * trg_nodes.size() / src_nodes.size();
+        int j = word_alignment ? word_alignment[i] : i * trg_nodes.size() / src_nodes.size();
 
+        if (j < -1 || j >= static_cast<int>(trg_mapping.size())) {
+            throw runtime_error("invalid word alignment (target position out of the sentence)");
+        }
         if (src_nodes[i] != HuffmanNode::UNK) {
-            alignment.push_back(trg_mapping[j]);
+            alignment.push_back(j == -1 ? -1 : trg_mapping[j]);
         }
     }
 
@@ -126,8 +380,32 @@ vector<int> BilingualModel::uniformAlignment(const vector<HuffmanNode>& src_node
 }
 
 int BilingualModel::trainSentence(const string& src_sent, const string& trg_sent) {
-    auto src_nodes = src_model.getNodes(src_sent);  // same size as src_sent, OOV words are replaced by <UNK>
-    auto trg_nodes = trg_model.getNodes(trg_sent);
+    // same size as src_sent and trg_sent, OOV words are replaced by <UNK>
+    return trainSentence(src_model.getNodes(src_sent), trg_model.getNodes(trg_sent), 0);
+}
+
+int BilingualModel::trainSentence(vector<HuffmanNode> src_nodes, vector<HuffmanNode> trg_nodes,
+                                  const int* word_alignment, float* loss) {
+    return trainSentence(src_model, trg_model, src_nodes, trg_nodes, word_alignment,
+                         alpha.load(std::memory_order_relaxed), config->beta,
+                         true, true, loss);
+}
+
+/**
+ * @brief Train a pair of models on a sentence pair.
+ *
+ * @param word_alignment target position of each source word (or -1), null for a uniform alignment
+ * @param alpha learning rate
+ * @param beta weight of the bilingual updates (no bilingual training if 0)
+ * @param src_mono, trg_mono perform monolingual training on the source (resp. target) side
+ * @param loss if not null, the training loss is added to it
+ * @return number of words processed
+ */
+int BilingualModel::trainSentence(MonolingualModel& src_model, MonolingualModel& trg_model,
+                                  vector<HuffmanNode> src_nodes, vector<HuffmanNode> trg_nodes,
+                                  const int* word_alignment, float alpha, float beta,
+                                  bool src_mono, bool trg_mono, float* loss) {
+    const Config* config = src_model.config;
 
     // counts the number of words that are in the vocabulary
     int words = 0;
@@ -145,7 +423,7 @@ int BilingualModel::trainSentence(const string& src_sent, const string& trg_sent
 
     // The <UNK> tokens are necessary to perform the alignment (the nodes vector should have the same size
     // as the original sentence)
-    auto alignment = uniformAlignment(src_nodes, trg_nodes);
+    auto alignment = getAlignment(src_nodes, trg_nodes, word_alignment);
 
     // remove <UNK> tokens
     src_nodes.erase(
@@ -156,15 +434,15 @@ int BilingualModel::trainSentence(const string& src_sent, const string& trg_sent
         trg_nodes.end());
 
     // Monolingual training
-    for (int src_pos = 0; src_pos < src_nodes.size(); ++src_pos) {
-        trainWord(src_model, src_model, src_nodes, src_nodes, src_pos, src_pos, alpha);
+    for (int src_pos = 0; src_mono && src_pos < src_nodes.size(); ++src_pos) {
+        trainWord(src_model, src_model, src_nodes, src_nodes, src_pos, src_pos, alpha, loss);
     }
 
-    for (int trg_pos = 0; trg_pos < trg_nodes.size(); ++trg_pos) {
-        trainWord(trg_model, trg_model, trg_nodes, trg_nodes, trg_pos, trg_pos, alpha);
+    for (int trg_pos = 0; trg_mono && trg_pos < trg_nodes.size(); ++trg_pos) {
+        trainWord(trg_model, trg_model, trg_nodes, trg_nodes, trg_pos, trg_pos, alpha, loss);
     }
 
-    if (config->beta == 0)
+    if (beta == 0)
         return words;
 
     // Bilingual training
@@ -173,8 +451,8 @@ int BilingualModel::trainSentence(const string& src_sent, const string& trg_sent
         int trg_pos = alignment[src_pos];
 
         if (trg_pos != -1) { // target word isn't OOV
-            trainWord(src_model, trg_model, src_nodes, trg_nodes, src_pos, trg_pos, alpha * config->beta);
-            trainWord(trg_model, src_model, trg_nodes, src_nodes, trg_pos, src_pos, alpha * config->beta);
+            trainWord(src_model, trg_model, src_nodes, trg_nodes, src_pos, trg_pos, alpha * beta, loss);
+            trainWord(trg_model, src_model, trg_nodes, src_nodes, trg_pos, src_pos, alpha * beta, loss);
         }
     }
 
@@ -183,24 +461,26 @@ int BilingualModel::trainSentence(const string& src_sent, const string& trg_sent
 
 void BilingualModel::trainWord(MonolingualModel& src_model, MonolingualModel& trg_model,
                                const vector<HuffmanNode>& src_nodes, const vector<HuffmanNode>& trg_nodes,
-                               int src_pos, int trg_pos, float alpha) {
+                               int src_pos, int trg_pos, float alpha, float* loss) {
 
-    if (config->skip_gram) {
-        return trainWordSkipGram(src_model, trg_model, src_nodes, trg_nodes, src_pos, trg_pos, alpha);
+    if (src_model.config->skip_gram) {
+        return trainWordSkipGram(src_model, trg_model, src_nodes, trg_nodes, src_pos, trg_pos, alpha, loss);
     } else {
-        return trainWordCBOW(src_model, trg_model, src_nodes, trg_nodes, src_pos, trg_pos, alpha);
+        return trainWordCBOW(src_model, trg_model, src_nodes, trg_nodes, src_pos, trg_pos, alpha, loss);
     }
 }
 
 void BilingualModel::trainWordCBOW(MonolingualModel& src_model, MonolingualModel& trg_model,
                                    const vector<HuffmanNode>& src_nodes, const vector<HuffmanNode>& trg_nodes,
-                                   int src_pos, int trg_pos, float alpha) {
+                                   int src_pos, int trg_pos, float alpha, float* loss) {
+    PROFILE_SCOPE("BilingualModel::trainWordCBOW");
     // Trains the model by predicting a source node from its aligned context in the target sentence.
     // This function can be used in the reverse direction just by reversing the arguments. Likewise,
     // for monolingual training, use the same values for source and target.
 
     // 'src_pos' is the position in the source sentence of the current node to predict
     // 'trg_pos' is the position of the corresponding node in the target sentence
+    const Config* config = src_model.config;
     int dimension = config->dimension;
     vec hidden(dimension, 0);
     HuffmanNode cur_node = src_nodes[src_pos];
@@ -219,22 +499,24 @@ void BilingualModel::trainWordCBOW(MonolingualModel& src_model, MonolingualModel
 
     vec error(dimension, 0); // compute error & update output weights
     if (config->hierarchical_softmax) {
-        error += src_model.hierarchicalUpdate(cur_node, hidden, alpha);
+        error += src_model.hierarchicalUpdate(cur_node, hidden, alpha, true, loss);
     }
     if (config->negative > 0) {
-        error += src_model.negSamplingUpdate(cur_node, hidden, alpha);
+        error += src_model.negSamplingUpdate(cur_node, hidden, alpha, true, loss);
     }
 
     // Update input weights
     for (int pos = trg_pos - this_window_size; pos <= trg_pos + this_window_size; ++pos) {
         if (pos < 0 || pos >= trg_nodes.size() || pos == trg_pos) continue;
-        trg_model.input_weights[trg_nodes[pos].index] += error;
+        trg_model.inputUpdate(trg_nodes[pos].index, error, alpha);
     }
 }
 
 void BilingualModel::trainWordSkipGram(MonolingualModel& src_model, MonolingualModel& trg_model,
                                        const vector<HuffmanNode>& src_nodes, const vector<HuffmanNode>& trg_nodes,
-                                       int src_pos, int trg_pos, float alpha) {
+                                       int src_pos, int trg_pos, float alpha, float* loss) {
+    PROFILE_SCOPE("BilingualModel::trainWordSkipGram");
+    const Config* config = src_model.config;
     HuffmanNode input_word = src_nodes[src_pos];
 
     int this_window_size = 1 + multivec::rand() % config->window_size;
@@ -245,17 +527,20 @@ void BilingualModel::trainWordSkipGram(MonolingualModel& src_model, MonolingualM
 
         vec error(config->dimension, 0);
         if (config->hierarchical_softmax) {
-            error += trg_model.hierarchicalUpdate(output_word, src_model.input_weights[input_word.index], alpha);
+            error += trg_model.hierarchicalUpdate(output_word, src_model.input_weights[input_word.index], alpha,
+                                                  true, loss);
         }
         if (config->negative > 0) {
-            error += trg_model.negSamplingUpdate(output_word, src_model.input_weights[input_word.index], alpha);
+            error += trg_model.negSamplingUpdate(output_word, src_model.input_weights[input_word.index], alpha,
+                                                 true, loss);
         }
 
-        src_model.input_weights[input_word.index] += error;
+        src_model.inputUpdate(input_word.index, error, alpha);
     }
 }
 
 void BilingualModel::load(const string& filename) {
+    PROFILE_SCOPE("BilingualModel::load");
     if (config->verbose)
         std::cout << "Loading model" << std::endl;
 
@@ -1,10 +1,12 @@
 #pragma once
 #include "monolingual.hpp"
+#include "parallel_corpus.hpp"
 
 using namespace std;
 
 class BilingualModel
 {
+    friend class MultilingualModel;
     friend void save(ofstream& outfile, const BilingualModel& model);
     friend void load(ifstream& infile, BilingualModel& model);
 
@@ -12,31 +14,49 @@ private:
     // Configuration of the model (monolingual models have the same configuration)
     BilingualConfig* const config;
 
-    long long words_processed; // number of words processed so far
-    float alpha;
+    std::atomic<long long> words_processed; // number of words processed so far (read by the metrics and cluster threads)
+    std::atomic<float> alpha;
+    MetricsReporter* metrics; // during training, if metrics are enabled (config->metrics_file or metrics_callback)
+    MetricsCallback metrics_callback;
+    string last_metrics;
+
+    void trainThreads(const std::function<void(int)>& train_chunk);
+    void updateProgress(int word_count, int& last_count, long long training_words);
 
     void trainChunk(const string& src_file,
                     const string& trg_file,
                     const vector<long long>& src_chunks,
                     const vector<long long>& trg_chunks,
                     int thread_id);
+    void trainCorpusChunk(const ParallelCorpus& corpus, int chunk_id);
 
-    // TODO: unsupervised alignment (GIZA)
-    vector<int> uniformAlignment(const vector<HuffmanNode>& src_nodes, const vector<HuffmanNode>& trg_nodes);
+    static vector<int> getAlignment(const vector<HuffmanNode>& src_nodes, const vector<HuffmanNode>& trg_nodes,
+                                    const int* word_alignment = 0);
 
     int trainSentence(const string& trg_sent, const string& src_sent);
+    int trainSentence(vector<HuffmanNode> src_nodes, vector<HuffmanNode> trg_nodes, const int* word_alignment,
+                      float* loss = 0);
+
+    // the training functions below only use the parameters and configuration of the given models
+    // (also used for multilingual training, where models are shared by several language pairs)
+    static int trainSentence(MonolingualModel& src_model, MonolingualModel& trg_model,
+        vector<HuffmanNode> src_nodes, vector<HuffmanNode> trg_nodes, const int* word_alignment,
+        float alpha, float beta, bool src_mono = true, bool trg_mono = true, float* loss = 0);
 
-    void trainWord(MonolingualModel& src_params, MonolingualModel& trg_params,
+    static void trainWord(MonolingualModel& src_params, MonolingualModel& trg_params,
         const vector<HuffmanNode>& src_nodes, const vector<HuffmanNode>& trg_nodes,
-        int src_pos, int trg_pos, float alpha);
+        int src_pos, int trg_pos, float alpha, float* loss = 0);
 
-    void trainWordCBOW(MonolingualModel&, MonolingualModel&,
+    static void trainWordCBOW(MonolingualModel&, MonolingualModel&,
         const vector<HuffmanNode>&, const vector<HuffmanNode>&,
-        int, int, float);
+        int, int, float, float*);
 
-    void trainWordSkipGram(MonolingualModel&, MonolingualModel&,
+    static void trainWordSkipGram(MonolingualModel&, MonolingualModel&,
         const vector<HuffmanNode>&, const vector<HuffmanNode>&,
-        int, int, float);
+        int, int, float, float*);
+
+    static vector<vector<pair<string, float>>> closestBatch(const MonolingualModel& src_model,
+        const MonolingualModel& trg_model, const vector<string>& src_words, int n, bool csls, int policy, int threads);
 
 public:
     // A bilingual model is comprised of two monolingual models
@@ -44,12 +64,20 @@ public:
     MonolingualModel trg_model;
 
     // prefer this constructor
-    BilingualModel(BilingualConfig* config) : config(config), src_model(config), trg_model(config) {}
+    BilingualModel(BilingualConfig* config) : config(config), metrics(0), src_model(config), trg_model(config) {}
 
     void train(const string& src_file, const string& trg_file, bool initialize = true);
+    void trainCorpus(const string& corpus_file, bool initialize = true); // training with a binary parallel corpus
+    void buildCorpus(const string& src_file, const string& trg_file, const string& corpus_file, bool initialize = true);
+    void alignCorpus(const string& corpus_file, int iterations = 5); // unsupervised word alignment (see Aligner)
+    // maps src_model into the space of trg_model (see CrossLingualMapper), with a seed dictionary (identical words if empty)
+    void mapModels(const string& dictionary_file = "", int self_learning = 0);
     void load(const string& filename);
     void save(const string& filename) const;
 
+    void setMetricsCallback(const MetricsCallback& callback) { metrics_callback = callback; } // training metrics
+    const string& lastMetrics() const { return last_metrics; } // last metrics report of the last training
+
     float similarity(const string& src_word, const string& trg_word, int policy = 0) const; // cosine similarity
     float distance(const string& src_word, const string& trg_word, int policy = 0) const; // 1 - cosine similarity
     float similarityNgrams(const string& src_seq, const string& trg_seq, int policy = 0) const; // similarity between two sequences of same size
@@ -60,4 +88,12 @@ public:
     
     vector<pair<string, float>> trg_closest(const string& src_word, int n = 10, int policy = 0) const; // n closest words to given word
     vector<pair<string, float>> src_closest(const string& trg_word, int n = 10, int policy = 0) const;
+
+    // n closest target words of each source word, with blocked matrix products (multi-threaded). If src_words is
+    // empty, all the source words are used (in the order of src_model.getWords()). With csls, the scores are
+    // cross-domain similarity local scaling, which reduces hubness. OOV words get an empty list.
+    vector<vector<pair<string, float>>> trg_closest(const vector<string>& src_words, int n = 10, bool csls = false,
+                                                    int policy = 0) const;
+    vector<vector<pair<string, float>>> src_closest(const vector<string>& trg_words, int n = 10, bool csls = false,
+                                                    int policy = 0) const;
 };
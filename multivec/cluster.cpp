@@ -0,0 +1,324 @@
+#include "cluster.hpp"
+#include <cstring>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static void sendAll(int fd, const void* buffer, size_t n) {
+    const char* data = static_cast<const char*>(buffer);
+    while (n > 0) {
+        ssize_t k = send(fd, data, n, MSG_NOSIGNAL);
+        if (k <= 0) throw runtime_error("cluster: connection lost");
+        data += k;
+        n -= k;
+    }
+}
+
+static void receiveAll(int fd, void* buffer, size_t n) {
+    char* data = static_cast<char*>(buffer);
+    while (n > 0) {
+        ssize_t k = recv(fd, data, n, 0);
+        if (k <= 0) throw runtime_error("cluster: connection lost");
+        data += k;
+        n -= k;
+    }
+}
+
+/**
+ * @brief Open a socket for given address ("unix:path" or "host:port").
+ * The first process binds the socket and listens, the other processes connect to it.
+ */
+static int openSocket(const string& address, bool listening) {
+    int fd = -1;
+
+    if (address.compare(0, 5, "unix:") == 0) {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        string path = address.substr(5);
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) throw runtime_error("cluster: couldn't create socket");
+
+        if (listening) {
+            unlink(path.c_str());
+            if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+                close(fd);
+                throw runtime_error("cluster: couldn't listen on " + address);
+            }
+        } else if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    size_t colon = address.rfind(':');
+    if (colon == string::npos) throw runtime_error("cluster: invalid address " + address);
+    string host = address.substr(0, colon);
+    string port = address.substr(colon + 1);
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+    addrinfo* res = 0;
+    if (getaddrinfo(host.empty() ? 0 : host.c_str(), port.c_str(), &hints, &res) != 0) {
+        throw runtime_error("cluster: couldn't resolve " + address);
+    }
+
+    for (addrinfo* it = res; it != 0 && fd == -1; it = it->ai_next) {
+        fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+        if (fd == -1) continue;
+
+        if (listening) {
+            int yes = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+            if (bind(fd, it->ai_addr, it->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) break;
+        } else if (::connect(fd, it->ai_addr, it->ai_addrlen) == 0) {
+            break;
+        }
+
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd == -1 && listening) throw runtime_error("cluster: couldn't listen on " + address);
+    return fd;
+}
+
+Cluster::Cluster(const string& address, int rank, int size, const vector<mat*>& params, unsigned long long signature) :
+    rank(rank), size(size), dimension(0), params(params) {
+    if (rank < 0 || rank >= size) {
+        throw runtime_error("cluster: invalid rank");
+    }
+
+    for (auto it = params.begin(); it != params.end(); ++it) {
+        if (!(*it)->empty()) dimension = (*it)->front().size();
+    }
+
+    connect(address, signature);
+    broadcastParams(); // all processes start from the same parameters
+}
+
+Cluster::~Cluster() {
+    for (auto it = sockets.begin(); it != sockets.end(); ++it) {
+        close(*it);
+    }
+}
+
+void Cluster::connect(const string& address, unsigned long long signature) {
+    if (rank == 0) {
+        int listener = openSocket(address, true);
+        sockets.assign(size - 1, -1);
+
+        for (int i = 1; i < size; ++i) {
+            int fd = accept(listener, 0, 0);
+            if (fd == -1) throw runtime_error("cluster: couldn't accept connection");
+
+            int other_rank = 0;
+            unsigned long long other_signature = 0;
+            receiveAll(fd, &other_rank, sizeof(other_rank));
+            receiveAll(fd, &other_signature, sizeof(other_signature));
+
+            if (other_rank <= 0 || other_rank >= size || sockets[other_rank - 1] != -1) {
+                throw runtime_error("cluster: invalid or duplicate rank " + std::to_string(other_rank));
+            }
+            if (other_signature != signature) {
+                throw runtime_error("cluster: process " + std::to_string(other_rank) +
+                                    " has a different vocabulary or configuration");
+            }
+            sockets[other_rank - 1] = fd;
+        }
+
+        close(listener);
+        if (address.compare(0, 5, "unix:") == 0) unlink(address.substr(5).c_str());
+    } else {
+        // the first process may not be listening yet
+        int fd = -1;
+        for (int i = 0; i < 6000 && fd == -1; ++i) {
+            fd = openSocket(address, false);
+            if (fd == -1) std::this_thread::sleep_for(milliseconds(100));
+        }
+        if (fd == -1) throw runtime_error("cluster: couldn't connect to " + address);
+
+        sendAll(fd, &rank, sizeof(rank));
+        sendAll(fd, &signature, sizeof(signature));
+        sockets.push_back(fd);
+    }
+}
+
+void Cluster::sendRows(int fd, const vector<SparseRows>& rows, int flag) {
+    sendAll(fd, &flag, sizeof(flag));
+    for (auto it = rows.begin(); it != rows.end(); ++it) {
+        long long n = it->indices.size();
+        sendAll(fd, &n, sizeof(n));
+        sendAll(fd, it->indices.data(), n * sizeof(int));
+        sendAll(fd, it->values.data(), n * dimension * sizeof(float));
+    }
+}
+
+int Cluster::receiveRows(int fd, vector<SparseRows>& rows) {
+    int flag = 0;
+    receiveAll(fd, &flag, sizeof(flag));
+    rows.resize(params.size());
+    for (auto it = rows.begin(); it != rows.end(); ++it) {
+        long long n = 0;
+        receiveAll(fd, &n, sizeof(n));
+        it->indices.resize(n);
+        it->values.resize(n * dimension);
+        receiveAll(fd, it->indices.data(), n * sizeof(int));
+        receiveAll(fd, it->values.data(), n * dimension * sizeof(float));
+    }
+    return flag;
+}
+
+void Cluster::broadcastParams() {
+    vector<SparseRows> rows(params.size());
+
+    if (rank == 0) {
+        for (size_t m = 0; m < params.size(); ++m) {
+            mat& weights = *params[m];
+            for (int i = 0; i < weights.size(); ++i) {
+                rows[m].indices.push_back(i);
+                rows[m].values.insert(rows[m].values.end(), weights[i].data(), weights[i].data() + dimension);
+            }
+        }
+        for (auto it = sockets.begin(); it != sockets.end(); ++it) {
+            sendRows(*it, rows, 0);
+        }
+    } else {
+        receiveRows(sockets.front(), rows);
+        for (size_t m = 0; m < params.size(); ++m) {
+            mat& weights = *params[m];
+            if (rows[m].indices.size() != weights.size()) {
+                throw runtime_error("cluster: parameters don't have the same shape");
+            }
+            for (int i = 0; i < weights.size(); ++i) {
+                const float* row = rows[m].values.data() + i * dimension;
+                weights[i] = vec(row, row + dimension);
+            }
+        }
+    }
+
+    snapshots.clear();
+    for (auto it = params.begin(); it != params.end(); ++it) {
+        snapshots.push_back(**it);
+    }
+}
+
+/**
+ * @brief Run one synchronization round. All processes need to take part in each round,
+ * so a process that has finished training keeps calling this (with `done` set to true)
+ * until the other processes are done as well.
+ *
+ * @param done this process has finished training
+ * @return true if all processes are done
+ */
+bool Cluster::synchronize(bool done) {
+    // sparse delta of this process: rows that changed since the last round
+    vector<SparseRows> delta(params.size());
+    for (size_t m = 0; m < params.size(); ++m) {
+        mat& weights = *params[m];
+        for (int i = 0; i < weights.size(); ++i) {
+            vec row = weights[i] - snapshots[m][i]; // concurrent updates by the training threads are fine
+            if (row.dot(row) > 0) {
+                delta[m].indices.push_back(i);
+                delta[m].values.insert(delta[m].values.end(), row.data(), row.data() + dimension);
+            }
+        }
+    }
+
+    vector<SparseRows> average(params.size());
+    bool all_done = done;
+
+    if (rank == 0) {
+        // sum of all deltas (with a map from row index to position in the sum)
+        vector<unordered_map<int, int>> positions(params.size());
+        average = delta;
+        for (size_t m = 0; m < params.size(); ++m) {
+            for (int k = 0; k < average[m].indices.size(); ++k) positions[m][average[m].indices[k]] = k;
+        }
+
+        vector<SparseRows> other(params.size());
+        for (auto it = sockets.begin(); it != sockets.end(); ++it) {
+            all_done &= receiveRows(*it, other) != 0;
+
+            for (size_t m = 0; m < params.size(); ++m) {
+                for (int k = 0; k < other[m].indices.size(); ++k) {
+                    auto pos = positions[m].insert({other[m].indices[k], static_cast<int>(average[m].indices.size())});
+                    if (pos.second) {
+                        average[m].indices.push_back(other[m].indices[k]);
+                        average[m].values.resize(average[m].values.size() + dimension, 0);
+                    }
+                    float* dst = average[m].values.data() + pos.first->second * dimension;
+                    const float* src = other[m].values.data() + k * dimension;
+                    for (int c = 0; c < dimension; ++c) dst[c] += src[c];
+                }
+            }
+        }
+
+        for (size_t m = 0; m < params.size(); ++m) {
+            for (auto it = average[m].values.begin(); it != average[m].values.end(); ++it) *it /= size;
+        }
+
+        for (auto it = sockets.begin(); it != sockets.end(); ++it) {
+            sendRows(*it, average, all_done);
+        }
+    } else {
+        sendRows(sockets.front(), delta, done);
+        all_done = receiveRows(sockets.front(), average) != 0;
+    }
+
+    // replace this process' delta by the average delta
+    for (size_t m = 0; m < params.size(); ++m) {
+        mat& weights = *params[m];
+        unordered_map<int, const float*> own_delta;
+        for (int k = 0; k < delta[m].indices.size(); ++k) {
+            own_delta[delta[m].indices[k]] = delta[m].values.data() + k * dimension;
+        }
+
+        for (int k = 0; k < average[m].indices.size(); ++k) {
+            int i = average[m].indices[k];
+            const float* avg = average[m].values.data() + k * dimension;
+            auto it = own_delta.find(i);
+
+            for (int c = 0; c < dimension; ++c) {
+                weights[i][c] += avg[c] - (it == own_delta.end() ? 0 : it->second[c]);
+                snapshots[m][i][c] += avg[c];
+            }
+        }
+
+        if (all_done) { // no more updates: all processes end up with exactly the same parameters
+            weights = snapshots[m];
+        }
+    }
+
+    return all_done;
+}
+
+/**
+ * @brief Synchronize every `sync_words` words processed by this process, until `training_done`
+ * is set. Then, keep synchronizing until all the processes are done. Meant to be run in its own
+ * thread, alongside the training threads.
+ */
+void Cluster::run(const std::atomic<long long>& words_processed, long long sync_words,
+                  const std::atomic<bool>& training_done) {
+    long long next_sync = sync_words;
+
+    while (!training_done) {
+        if (words_processed.load(std::memory_order_relaxed) >= next_sync) {
+            synchronize();
+            next_sync = words_processed.load(std::memory_order_relaxed) + sync_words;
+        } else {
+            std::this_thread::sleep_for(milliseconds(10));
+        }
+    }
+
+    while (!synchronize(true)) {}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "utils.hpp"
+
+/**
+ * @brief Data-parallel training over several processes (possibly on several machines).
+ *
+ * Each process trains on its own shard of the corpus, with the same vocabulary. Periodically,
+ * all processes run a synchronization round: each process sends the rows of its parameters that
+ * changed since the last round (sparse deltas) to the first process (rank 0), which averages
+ * them and sends the result back. Each process then replaces its own delta by the average delta.
+ * Training threads are not interrupted by the synchronization (Hogwild style).
+ *
+ * Processes communicate over TCP (address "host:port") or Unix sockets (address "unix:path").
+ * This keeps a copy of the synchronized parameters (state at the last round).
+ */
+class Cluster {
+    int rank;
+    int size;
+    int dimension;
+
+    vector<int> sockets; // rank 0: one socket per process (index rank - 1), other ranks: socket to rank 0
+
+    vector<mat*> params;  // synchronized parameters
+    vector<mat> snapshots; // state of the parameters at the last round
+
+    struct SparseRows {
+        vector<int> indices;
+        vector<float> values; // indices.size() * dimension values
+    };
+
+    void connect(const string& address, unsigned long long signature);
+    void broadcastParams();
+
+    void sendRows(int fd, const vector<SparseRows>& rows, int flag);
+    int receiveRows(int fd, vector<SparseRows>& rows);
+
+public:
+    /**
+     * @param address address of the first process (rank 0), which listens for the other processes
+     * @param rank rank of this process, in [0, size)
+     * @param size number of processes
+     * @param params parameters to synchronize (same shapes in all processes)
+     * @param signature identifies the vocabulary and configuration, which must be the same for all processes
+     */
+    Cluster(const string& address, int rank, int size, const vector<mat*>& params, unsigned long long signature);
+    ~Cluster();
+
+    Cluster(const Cluster&) = delete;
+    Cluster& operator=(const Cluster&) = delete;
+
+    bool synchronize(bool done = false); // one averaging round, returns true when all processes are done
+    void run(const std::atomic<long long>& words_processed, long long sync_words, const std::atomic<bool>& training_done);
+};
@@ -1,5 +1,6 @@
 #include "monolingual.hpp"
 #include "bilingual.hpp"
+#include "linalg.hpp"
 
 
 /**
@@ -31,10 +32,28 @@ static bool comp(const pair<string, float>& p1, const pair<string, float>& p2) {
     return p1.second > p2.second;
 }
 
+/**
+ * @brief Approximate closest words to `v` with the HNSW index of the input weights (excluding the
+ * word at index `skip`), which explores config->index_ef candidates.
+ */
+vector<pair<string, float>> MonolingualModel::indexClosest(const vec& v, int n, int skip) const {
+    vector<pair<string, float>> res;
+    auto neighbors = hnsw.search(v, skip >= 0 ? n + 1 : n, config->index_ef);
+
+    for (auto it = neighbors.begin(); it != neighbors.end() && res.size() < n; ++it) {
+        if (it->first != skip) {
+            res.push_back({index_table[it->first]->word, it->second});
+        }
+    }
+    return res;
+}
+
 /**
  * @brief Return an ordered list of the `n` closest words to `word` according to cosine similarity.
+ * With an HNSW index (see buildIndex) and policy 0, the result is approximate.
  */
 vector<pair<string, float>> MonolingualModel::closest(const string& word, int n, int policy) const {
+    PROFILE_SCOPE("MonolingualModel::closest");
     vector<pair<string, float>> res;
     auto it = vocabulary.find(word);
 
@@ -43,6 +62,10 @@ vector<pair<string, float>> MonolingualModel::closest(const string& word, int n,
     }
 
     int index = it->second.index;
+    if (policy == 0 && !hnsw.empty()) {
+        return indexClosest(input_weights[index], n, index);
+    }
+
     vec v1 = wordVec(index, policy);
 
     for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
@@ -58,6 +81,11 @@ vector<pair<string, float>> MonolingualModel::closest(const string& word, int n,
 }
 
 vector<pair<string, float>> MonolingualModel::closest(const vec& v, int n, int policy) const {
+    PROFILE_SCOPE("MonolingualModel::closest");
+    if (policy == 0 && !hnsw.empty()) {
+        return indexClosest(v, n);
+    }
+
     vector<pair<string, float>> res;
 
     for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
@@ -147,6 +175,7 @@ void normalizeWeights(mat& weights) {
 }
 
 void MonolingualModel::normalizeWeights() {
+    hnsw.clear(); // the similarities change
     ::normalizeWeights(input_weights);
     ::normalizeWeights(output_weights);
     ::normalizeWeights(output_weights_hs);
@@ -347,6 +376,97 @@ vector<pair<string, float>> BilingualModel::src_closest(const string& trg_word,
     return src_model.closest(v, n, policy);
 }
 
+vector<vector<pair<string, float>>> BilingualModel::trg_closest(const vector<string>& src_words, int n, bool csls,
+                                                               int policy) const {
+    return closestBatch(src_model, trg_model, src_words, n, csls, policy, config->threads);
+}
+
+vector<vector<pair<string, float>>> BilingualModel::src_closest(const vector<string>& trg_words, int n, bool csls,
+                                                               int policy) const {
+    return closestBatch(trg_model, src_model, trg_words, n, csls, policy, config->threads);
+}
+
+/**
+ * @brief Batched retrieval: the normalized embeddings of both vocabularies are put into contiguous
+ * matrices once, and the k nearest neighbors are found with blocked matrix products.
+ *
+ * CSLS(x, y) = 2 cos(x, y) - r_trg(x) - r_src(y), where r_trg(x) is the mean similarity of x with its
+ * 10 nearest target words, and r_src(y) the mean similarity of y with its 10 nearest source words.
+ */
+vector<vector<pair<string, float>>> BilingualModel::closestBatch(const MonolingualModel& src_model,
+        const MonolingualModel& trg_model, const vector<string>& src_words, int n, bool csls, int policy,
+        int threads) {
+    PROFILE_SCOPE("BilingualModel::closestBatch");
+    const int csls_neighbors = 10;
+
+    // words and embeddings in index order
+    auto embeddings = [policy](const MonolingualModel& model, vector<string>& words) {
+        words.assign(model.vocabulary.size(), "");
+        mat weights(model.vocabulary.size());
+        for (auto it = model.vocabulary.begin(); it != model.vocabulary.end(); ++it) {
+            words[it->second.index] = it->first;
+            weights[it->second.index] = model.wordVec(it->second.index, policy);
+        }
+        Matrix m(weights, vector<int>());
+        m.normalizeRows();
+        return m;
+    };
+
+    vector<string> src_vocab, trg_vocab;
+    Matrix src = embeddings(src_model, src_vocab);
+    Matrix trg = embeddings(trg_model, trg_vocab);
+
+    vector<int> rows; // index of each query word (or -1 if OOV)
+    if (src_words.empty()) {
+        auto words = src_model.getWords();
+        for (auto it = words.begin(); it != words.end(); ++it) {
+            rows.push_back(src_model.vocabulary.at(it->first).index);
+        }
+    } else {
+        for (auto it = src_words.begin(); it != src_words.end(); ++it) {
+            auto node = src_model.vocabulary.find(*it);
+            rows.push_back(node == src_model.vocabulary.end() ? -1 : node->second.index);
+        }
+    }
+
+    vector<int> known_rows;
+    for (auto it = rows.begin(); it != rows.end(); ++it) {
+        if (*it != -1) known_rows.push_back(*it);
+    }
+
+    Matrix queries(known_rows.size(), src.cols());
+    for (int i = 0; i < known_rows.size(); ++i) {
+        std::copy(src.row(known_rows[i]), src.row(known_rows[i]) + src.cols(), queries.row(i));
+    }
+
+    vector<float> bias, query_density;
+    if (csls) {
+        // ranking by cos(x, y) - r_src(y) / 2 is the same as ranking by CSLS
+        bias = meanTopK(trg, src, csls_neighbors, threads);
+        for (auto it = bias.begin(); it != bias.end(); ++it) *it /= -2;
+        query_density = meanTopK(queries, trg, csls_neighbors, threads);
+    }
+
+    n = std::min(n, trg.rows());
+    vector<int> indices;
+    vector<float> scores;
+    topK(queries, trg, n, indices, scores, threads, bias);
+
+    vector<vector<pair<string, float>>> res(rows.size());
+    for (int i = 0, k = 0; i < rows.size(); ++i) {
+        if (rows[i] == -1) continue;
+
+        for (int r = 0; r < n; ++r) {
+            size_t pos = static_cast<size_t>(k) * n + r;
+            float score = csls ? 2 * scores[pos] - query_density[k] : scores[pos];
+            res[i].push_back({trg_vocab[indices[pos]], score});
+        }
+        ++k;
+    }
+
+    return res;
+}
+
 
 float BilingualModel::similarityNgrams(const string& src_seq, const string& trg_seq, int policy) const {
     auto src_words = split(src_seq);
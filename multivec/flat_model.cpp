@@ -0,0 +1,391 @@
+#include "flat_model.hpp"
+#include "monolingual.hpp"
+#include <cstring>
+
+// compares a word of the strings section with `word`, like string::compare
+static int compareWord(const char* data, size_t size, const string& word) {
+    int res = memcmp(data, word.data(), std::min(size, word.size()));
+    if (res != 0) return res;
+    return size < word.size() ? -1 : (size > word.size() ? 1 : 0);
+}
+
+bool FlatModel::isFlat(const string& filename) {
+    ifstream infile(filename, ios::binary);
+    char magic[sizeof(FLAT_MAGIC)] = {0};
+    infile.read(magic, sizeof(magic));
+    return infile && memcmp(magic, FLAT_MAGIC, sizeof(magic)) == 0;
+}
+
+void FlatModel::open(const string& filename) {
+    file.open(filename);
+
+    header = reinterpret_cast<const FlatHeader*>(file.data());
+    if (file.size() < sizeof(FlatHeader) || memcmp(header->magic, FLAT_MAGIC, sizeof(FLAT_MAGIC)) != 0) {
+        file.close();
+        throw runtime_error("not a flat model file: " + filename);
+    }
+    if (header->version > FLAT_VERSION) {
+        file.close();
+        throw runtime_error("unsupported version of the flat model format: " + filename);
+    }
+    if (header->file_size != file.size()) {
+        file.close();
+        throw runtime_error("truncated flat model file: " + filename);
+    }
+
+    // the sections are read without bound checks (empty sections have an offset of 0)
+    uint64_t size = file.size(), vocab_size = header->vocab_size;
+    uint64_t row_size = static_cast<uint64_t>(header->dimension) * sizeof(float);
+    if (header->dimension <= 0
+        || !flatVocabularyFits(vocab_size, header->words_offset, header->sorted_offset, header->strings_offset, size)
+        || header->codes_offset > size
+        || header->input_offset == 0 || !flatSectionFits(header->input_offset, vocab_size, row_size, size)
+        || !flatSectionFits(header->output_offset, header->output_offset ? vocab_size : 0, row_size, size)
+        || !flatSectionFits(header->output_hs_offset, header->output_hs_offset ? vocab_size : 0, row_size, size)
+        || !flatSectionFits(header->sent_offset, header->sent_offset ? header->sent_count : 0, row_size, size)) {
+        file.close();
+        throw runtime_error("invalid flat model file (sections out of the file): " + filename);
+    }
+
+    words = reinterpret_cast<const FlatWord*>(file.data() + header->words_offset);
+    sorted = reinterpret_cast<const uint32_t*>(file.data() + header->sorted_offset);
+    strings = file.data() + header->strings_offset;
+}
+
+const float* FlatModel::section(uint64_t offset) const {
+    return offset == 0 ? 0 : reinterpret_cast<const float*>(file.data() + offset);
+}
+
+int findWord(const FlatWord* words, const uint32_t* sorted, const char* strings, long long size, const string& word) {
+    long long low = 0, high = size; // binary search in [low, high)
+    while (low < high) {
+        long long mid = (low + high) / 2;
+        const FlatWord& entry = words[sorted[mid]];
+        int res = compareWord(strings + entry.string_offset, entry.string_size, word);
+        if (res == 0) return sorted[mid];
+        if (res < 0) low = mid + 1;
+        else high = mid;
+    }
+    return -1;
+}
+
+int FlatModel::index(const string& word) const {
+    return findWord(words, sorted, strings, header->vocab_size, word);
+}
+
+const int* FlatModel::code(int index) const {
+    return reinterpret_cast<const int*>(file.data() + header->codes_offset) + words[index].code_offset;
+}
+
+const float* FlatModel::inputRow(int index) const {
+    return section(header->input_offset) + static_cast<size_t>(index) * header->dimension;
+}
+
+const float* FlatModel::outputRow(int index) const {
+    const float* data = section(header->output_offset);
+    return data ? data + static_cast<size_t>(index) * header->dimension : 0;
+}
+
+const float* FlatModel::outputRowHS(int index) const {
+    const float* data = section(header->output_hs_offset);
+    return data ? data + static_cast<size_t>(index) * header->dimension : 0;
+}
+
+const float* FlatModel::sentRow(long long index) const {
+    const float* data = section(header->sent_offset);
+    return data ? data + static_cast<size_t>(index) * header->dimension : 0;
+}
+
+vec FlatModel::wordVec(int index, int policy) const {
+    int d = header->dimension;
+    const float* input = inputRow(index);
+    const float* output = header->negative > 0 ? outputRow(index) : 0;
+
+    if (policy == 1 && output) { // concat input and output
+        vec res(d * 2);
+        for (int c = 0; c < d; ++c) res[c] = input[c];
+        for (int c = 0; c < d; ++c) res[d + c] = output[c];
+        return res;
+    } else if (policy == 2 && output) { // sum input and output
+        vec res(d);
+        for (int c = 0; c < d; ++c) res[c] = input[c] + output[c];
+        return res;
+    } else if (policy == 3 && output) { // only output weights
+        return vec(output, output + d);
+    } else { // only input weights
+        return vec(input, input + d);
+    }
+}
+
+vec FlatModel::wordVec(const string& word, int policy) const {
+    int i = index(word);
+    if (i == -1) {
+        throw runtime_error("out of vocabulary");
+    }
+    return wordVec(i, policy);
+}
+
+float FlatModel::similarity(const string& word1, const string& word2, int policy) const {
+    int index1 = index(word1);
+    int index2 = index(word2);
+
+    if (index1 == -1 || index2 == -1) {
+        return 0.0;
+    } else if (index1 == index2) {
+        return 1.0;
+    } else {
+        return cosineSimilarity(wordVec(index1, policy), wordVec(index2, policy));
+    }
+}
+
+vector<pair<string, float>> FlatModel::closest(const string& word, int n, int policy) const {
+    int i = index(word);
+    if (i == -1) {
+        throw runtime_error("OOV word");
+    }
+
+    auto res = closest(wordVec(i, policy), n + 1, policy);
+    res.erase(std::remove_if(res.begin(), res.end(), [&](const pair<string, float>& p) { return p.first == word; }),
+              res.end());
+    if (res.size() > n) res.resize(n);
+    return res;
+}
+
+vector<pair<string, float>> FlatModel::closest(const vec& v, int n, int policy) const {
+    PROFILE_SCOPE("FlatModel::closest");
+    vector<pair<int, float>> scores;
+    int d = header->dimension;
+    float norm = v.norm();
+
+    for (long long i = 0; i < header->vocab_size; ++i) {
+        float score;
+        if (policy == 0 || header->negative <= 0) { // reads the mapped weights directly
+            const float* row = inputRow(i);
+            float dot = 0, row_norm = 0;
+            for (int c = 0; c < d; ++c) {
+                dot += row[c] * v[c];
+                row_norm += row[c] * row[c];
+            }
+            score = dot / (norm * sqrt(row_norm));
+        } else {
+            score = cosineSimilarity(v, wordVec(i, policy));
+        }
+        scores.push_back({static_cast<int>(i), score});
+    }
+
+    n = std::min(n, static_cast<int>(scores.size()));
+    std::partial_sort(scores.begin(), scores.begin() + n, scores.end(),
+                      [](const pair<int, float>& p1, const pair<int, float>& p2) { return p1.second > p2.second; });
+
+    vector<pair<string, float>> res;
+    for (int i = 0; i < n; ++i) {
+        res.push_back({word(scores[i].first), scores[i].second});
+    }
+    return res;
+}
+
+vector<pair<string, int>> FlatModel::getWords() const {
+    vector<pair<string, int>> res;
+    for (long long i = 0; i < header->vocab_size; ++i) {
+        res.push_back({word(i), count(i)});
+    }
+    return res;
+}
+
+// writes zeros until the position is a multiple of FLAT_ALIGNMENT, and returns this position
+uint64_t alignFlat(ofstream& outfile) {
+    static const char zeros[FLAT_ALIGNMENT] = {0};
+    uint64_t pos = outfile.tellp();
+    uint64_t padding = (FLAT_ALIGNMENT - pos % FLAT_ALIGNMENT) % FLAT_ALIGNMENT;
+    outfile.write(zeros, padding);
+    return pos + padding;
+}
+
+bool flatSectionFits(uint64_t offset, uint64_t count, uint64_t size, uint64_t file_size) {
+    return offset <= file_size && count <= (file_size - offset) / std::max<uint64_t>(size, 1);
+}
+
+bool flatVocabularyFits(uint64_t vocab_size, uint64_t words_offset, uint64_t sorted_offset, uint64_t strings_offset,
+                        uint64_t file_size) {
+    return flatSectionFits(words_offset, vocab_size, sizeof(FlatWord), file_size)
+        && flatSectionFits(sorted_offset, vocab_size, sizeof(uint32_t), file_size)
+        && strings_offset <= file_size;
+}
+
+void writeFlatVocabulary(ofstream& outfile, const vector<const HuffmanNode*>& nodes, bool codes,
+                         uint64_t& words_offset, uint64_t& sorted_offset, uint64_t& strings_offset) {
+    vector<FlatWord> words(nodes.size());
+    uint64_t string_offset = 0, code_offset = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        FlatWord& entry = words[i];
+        memset(&entry, 0, sizeof(entry));
+        entry.string_offset = string_offset;
+        entry.string_size = nodes[i]->word.size();
+        entry.count = nodes[i]->count;
+        if (codes) {
+            entry.code_offset = code_offset;
+            entry.code_size = nodes[i]->code.size();
+        }
+        string_offset += entry.string_size + 1;
+        code_offset += 2 * entry.code_size;
+    }
+    words_offset = alignFlat(outfile);
+    outfile.write(reinterpret_cast<const char*>(words.data()), sizeof(FlatWord) * words.size());
+
+    vector<uint32_t> sorted(nodes.size());
+    for (size_t i = 0; i < sorted.size(); ++i) sorted[i] = i;
+    std::sort(sorted.begin(), sorted.end(), [&](uint32_t i, uint32_t j) { return nodes[i]->word < nodes[j]->word; });
+    sorted_offset = alignFlat(outfile);
+    outfile.write(reinterpret_cast<const char*>(sorted.data()), sizeof(uint32_t) * sorted.size());
+
+    strings_offset = alignFlat(outfile);
+    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+        outfile.write((*it)->word.c_str(), (*it)->word.size() + 1);
+    }
+}
+
+static uint64_t writeMatrix(ofstream& outfile, const mat& weights) {
+    if (weights.empty()) return 0;
+    uint64_t offset = alignFlat(outfile);
+    for (auto it = weights.begin(); it != weights.end(); ++it) {
+        outfile.write(reinterpret_cast<const char*>(it->data()), sizeof(float) * it->size());
+    }
+    return offset;
+}
+
+static void readMatrix(const float* data, size_t rows, int dimension, mat& weights) {
+    weights.clear();
+    weights.reserve(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        weights.push_back(vec(data + i * dimension, data + (i + 1) * dimension));
+    }
+}
+
+/**
+ * @brief Save the entire model in the flat format (see flat_model.hpp), which can be loaded with
+ * `load`, or mapped in memory by FlatModel for fast queries.
+ */
+void MonolingualModel::saveFlat(const string& filename) const {
+    if (!deferred_file.empty())
+        throw runtime_error("can't save a model loaded in query-only mode");
+    if (config->verbose)
+        std::cout << "Saving model in flat format" << std::endl;
+
+    ofstream outfile(filename, ios::binary | ios::out);
+    check_is_open(outfile, filename);
+
+    vector<const HuffmanNode*> nodes(vocabulary.size());
+    for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
+        nodes[it->second.index] = &it->second;
+    }
+
+    FlatHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FLAT_MAGIC, sizeof(FLAT_MAGIC));
+    header.version = FLAT_VERSION;
+    header.header_size = sizeof(FlatHeader);
+    header.learning_rate = config->learning_rate;
+    header.dimension = config->dimension;
+    header.min_count = config->min_count;
+    header.iterations = config->iterations;
+    header.window_size = config->window_size;
+    header.threads = config->threads;
+    header.subsampling = config->subsampling;
+    header.negative = config->negative;
+    header.hierarchical_softmax = config->hierarchical_softmax;
+    header.skip_gram = config->skip_gram;
+    header.sent_vector = config->sent_vector;
+    header.dbow = config->dbow;
+    header.dbow_words = config->dbow_words;
+    header.vocab_size = nodes.size();
+    header.sent_count = sent_weights.size();
+
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header)); // written again at the end
+
+    writeFlatVocabulary(outfile, nodes, true, header.words_offset, header.sorted_offset, header.strings_offset);
+
+    header.codes_offset = alignFlat(outfile);
+    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+        outfile.write(reinterpret_cast<const char*>((*it)->code.data()), sizeof(int) * (*it)->code.size());
+        outfile.write(reinterpret_cast<const char*>((*it)->parents.data()), sizeof(int) * (*it)->parents.size());
+    }
+
+    header.input_offset = writeMatrix(outfile, input_weights);
+    if (config->negative > 0)
+        header.output_offset = writeMatrix(outfile, output_weights);
+    if (config->hierarchical_softmax)
+        header.output_hs_offset = writeMatrix(outfile, output_weights_hs);
+    header.sent_offset = writeMatrix(outfile, sent_weights);
+    header.file_size = outfile.tellp();
+
+    outfile.seekp(0);
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    if (!outfile) {
+        throw runtime_error("couldn't write file " + filename);
+    }
+
+    if (!hnsw.empty())
+        saveIndex(filename + ".hnsw");
+}
+
+/**
+ * @brief Load a model saved in the flat format (called by `load`). With `query_only`, only
+ * the vocabulary and input weights are loaded.
+ */
+void MonolingualModel::loadFlat(const string& filename, bool query_only) {
+    FlatModel model(filename);
+    const FlatHeader& header = model.getHeader();
+
+    config->learning_rate = header.learning_rate;
+    config->dimension = header.dimension;
+    config->min_count = header.min_count;
+    config->iterations = header.iterations;
+    config->window_size = header.window_size;
+    config->threads = header.threads;
+    config->subsampling = header.subsampling;
+    config->negative = header.negative;
+    config->hierarchical_softmax = header.hierarchical_softmax;
+    config->skip_gram = header.skip_gram;
+    config->sent_vector = header.sent_vector;
+    config->dbow = header.dbow;
+    config->dbow_words = header.dbow_words;
+
+    size_t v = header.vocab_size;
+    int d = header.dimension;
+
+    vocabulary.clear();
+    vocabulary.reserve(v);
+    for (size_t i = 0; i < v; ++i) {
+        HuffmanNode node(i, model.word(i));
+        node.count = model.count(i);
+        if (!query_only) {
+            const int* code = model.code(i);
+            int code_size = model.codeSize(i);
+            node.code.assign(code, code + code_size);
+            node.parents.assign(code + code_size, code + 2 * code_size);
+        }
+        vocabulary.insert({node.word, node});
+    }
+
+    readMatrix(model.inputRow(0), v, d, input_weights);
+    if (query_only) {
+        output_weights.clear();
+        output_weights_hs.clear();
+        sent_weights.clear();
+        return;
+    }
+
+    if (header.output_offset)
+        readMatrix(model.outputRow(0), v, d, output_weights);
+    else
+        output_weights = mat(v, vec(d));
+    if (header.output_hs_offset)
+        readMatrix(model.outputRowHS(0), v, d, output_weights_hs);
+    else
+        output_weights_hs = mat(v, vec(d));
+    if (header.sent_offset)
+        readMatrix(model.sentRow(0), header.sent_count, d, sent_weights);
+    else
+        sent_weights.clear();
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include "utils.hpp"
+#include "mapped_file.hpp"
+#include <cstdint>
+
+/**
+ * Flat model format: a memory-mappable alternative to the serialization format (serialization.hpp),
+ * that can be used read-only without parsing (see FlatModel).
+ *
+ * Layout (native byte order, little-endian on x86):
+ *   FlatHeader     (256 bytes) format version, configuration, and offsets of the sections below
+ *   words          FlatWord[vocab_size], in index order (word index i is entry i)
+ *   sorted         uint32[vocab_size], word indices in lexicographical order (word lookup by binary search)
+ *   strings        the words, '\0'-terminated
+ *   codes          int32 array: Huffman code, then parents of each word (see FlatWord::code_offset)
+ *   input          float32[vocab_size][dimension]
+ *   output         float32[vocab_size][dimension] (if negative sampling)
+ *   output_hs      float32[vocab_size][dimension] (if hierarchical softmax)
+ *   sent           float32[sent_count][dimension] (batch paragraph vectors)
+ * Each section starts at a multiple of FLAT_ALIGNMENT bytes, and empty sections have an offset of 0.
+ */
+
+const char FLAT_MAGIC[8] = {'M', 'V', 'F', 'L', 'A', 'T', '\0', '\0'};
+const uint32_t FLAT_VERSION = 1;
+const uint64_t FLAT_ALIGNMENT = 64; // cache line
+
+struct FlatHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+
+    // serialized configuration (same fields as save(ofstream&, const Config&))
+    float learning_rate;
+    int32_t dimension;
+    int32_t min_count;
+    int32_t iterations;
+    int32_t window_size;
+    int32_t threads;
+    float subsampling;
+    int32_t negative;
+    uint8_t hierarchical_softmax;
+    uint8_t skip_gram;
+    uint8_t sent_vector;
+    uint8_t dbow; // zero in files written before these two fields
+    uint8_t dbow_words;
+    uint8_t padding[3];
+
+    uint64_t vocab_size;
+    uint64_t sent_count;
+
+    uint64_t words_offset;
+    uint64_t sorted_offset;
+    uint64_t strings_offset;
+    uint64_t codes_offset;
+    uint64_t input_offset;
+    uint64_t output_offset;
+    uint64_t output_hs_offset;
+    uint64_t sent_offset;
+    uint64_t file_size;
+
+    uint8_t reserved[112]; // for future versions
+};
+
+struct FlatWord {
+    uint64_t string_offset; // relative to the strings section
+    uint64_t code_offset; // relative to the codes section (number of int32), parents follow the code
+    uint32_t string_size;
+    uint32_t code_size; // length of the Huffman code (and of the parents)
+    int32_t count;
+    uint32_t padding;
+};
+
+static_assert(sizeof(FlatHeader) == 256, "unexpected size of FlatHeader");
+static_assert(sizeof(FlatWord) == 32, "unexpected size of FlatWord");
+
+// helpers shared with the other mapped formats (see quantized.hpp)
+int findWord(const FlatWord* words, const uint32_t* sorted, const char* strings, long long size, const string& word);
+uint64_t alignFlat(ofstream& outfile); // pads the file with zeros to the next multiple of FLAT_ALIGNMENT
+// true if `count` items of `size` bytes at `offset` are inside a file of `file_size` bytes
+bool flatSectionFits(uint64_t offset, uint64_t count, uint64_t size, uint64_t file_size);
+// true if the words, sorted and strings sections of `vocab_size` words are inside the file
+bool flatVocabularyFits(uint64_t vocab_size, uint64_t words_offset, uint64_t sorted_offset, uint64_t strings_offset,
+                        uint64_t file_size);
+// writes the words, sorted and strings sections of `nodes` (in index order), with the Huffman codes (if `codes`)
+// described in the words section
+void writeFlatVocabulary(ofstream& outfile, const vector<const HuffmanNode*>& nodes, bool codes,
+                         uint64_t& words_offset, uint64_t& sorted_offset, uint64_t& strings_offset);
+
+/**
+ * @brief Read-only model in the flat format, mapped in memory (zero-copy): opening a model
+ * doesn't read it, pages are loaded on demand and shared by all the processes that map
+ * the same file. Supports the queries of MonolingualModel that don't need training structures.
+ */
+class FlatModel {
+    MappedFile file;
+    const FlatHeader* header;
+
+    const FlatWord* words;
+    const uint32_t* sorted;
+    const char* strings;
+
+    const float* section(uint64_t offset) const;
+
+public:
+    FlatModel() : header(0), words(0), sorted(0), strings(0) {}
+    FlatModel(const string& filename) : FlatModel() { open(filename); }
+
+    void open(const string& filename);
+    static bool isFlat(const string& filename); // checks the magic number of this file
+
+    int getDimension() const { return header->dimension; }
+    long long size() const { return header->vocab_size; } // size of the vocabulary
+    long long sentCount() const { return header->sent_count; }
+    const FlatHeader& getHeader() const { return *header; }
+
+    int index(const string& word) const; // index of this word, or -1 if it is OOV
+    string word(int index) const { return string(strings + words[index].string_offset, words[index].string_size); }
+    int count(int index) const { return words[index].count; }
+    const int* code(int index) const; // Huffman code (codeSize(index) values), followed by the parents
+    int codeSize(int index) const { return words[index].code_size; }
+
+    const float* inputRow(int index) const; // weights of this word, directly in the mapped file
+    const float* outputRow(int index) const; // null if the model has no negative sampling weights
+    const float* outputRowHS(int index) const;
+    const float* sentRow(long long index) const;
+
+    vec wordVec(int index, int policy = 0) const; // same policies as MonolingualModel::wordVec
+    vec wordVec(const string& word, int policy = 0) const;
+
+    float similarity(const string& word1, const string& word2, int policy = 0) const;
+    vector<pair<string, float>> closest(const string& word, int n = 10, int policy = 0) const;
+    vector<pair<string, float>> closest(const vec& v, int n = 10, int policy = 0) const;
+    vector<pair<string, int>> getWords() const;
+};
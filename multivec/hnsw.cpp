@@ -0,0 +1,504 @@
+#include "hnsw.hpp"
+#include "monolingual.hpp"
+#include "linalg.hpp"
+#include <cstring>
+#include <mutex>
+#include <queue>
+#include <random>
+
+// a node is locked while its links are read or modified (lock striping: one mutex per group of nodes)
+struct HNSWLocks {
+    vector<std::mutex> nodes;
+    std::mutex entry; // entry point and maximum level
+
+    HNSWLocks(long long size) : nodes(std::min(size, 1LL << 16)) {}
+    std::mutex& node(int index) { return nodes[index % nodes.size()]; }
+};
+
+namespace {
+
+// nodes visited by a search, reset in O(1) by incrementing the tag
+struct VisitedSet {
+    vector<uint32_t> tags;
+    uint32_t tag;
+
+    VisitedSet() : tag(0) {}
+
+    void reset(size_t size) {
+        if (tags.size() != size || ++tag == 0) {
+            tags.assign(size, 0);
+            tag = 1;
+        }
+    }
+    bool visit(int node) { // false if already visited
+        if (tags[node] == tag) return false;
+        tags[node] = tag;
+        return true;
+    }
+};
+
+VisitedSet& visitedSet() { // one per thread, as searches are concurrent
+    thread_local VisitedSet visited;
+    return visited;
+}
+
+}
+
+uint32_t* HNSWIndex::neighbors(int node, int level) {
+    if (level == 0) return base.data() + static_cast<size_t>(node) * (2 * links + 1);
+    return upper.data() + upper_offsets[node] + static_cast<size_t>(level - 1) * (links + 1);
+}
+
+const uint32_t* HNSWIndex::neighbors(int node, int level) const {
+    return const_cast<HNSWIndex*>(this)->neighbors(node, level);
+}
+
+void HNSWIndex::attach(const mat& data) {
+    this->data = &data;
+    dimension = data.empty() ? 0 : data[0].size();
+    inv_norms.resize(data.size());
+    for (size_t i = 0; i < data.size(); ++i) {
+        float norm = data[i].norm();
+        inv_norms[i] = norm > 0 ? 1 / norm : 0;
+    }
+}
+
+void HNSWIndex::allocate() {
+    base.assign(levels.size() * (2 * links + 1), 0);
+    upper_offsets.assign(levels.size(), 0);
+    size_t upper_size = 0;
+    for (size_t i = 0; i < levels.size(); ++i) {
+        upper_offsets[i] = upper_size;
+        upper_size += static_cast<size_t>(levels[i]) * (links + 1);
+    }
+    upper.assign(upper_size, 0);
+}
+
+unsigned long long HNSWIndex::checksum() const {
+    // FNV-1a of about 64 rows
+    unsigned long long res = 0xCBF29CE484222325ULL ^ data->size();
+    size_t step = std::max<size_t>(1, data->size() / 64);
+    for (size_t i = 0; i < data->size(); i += step) {
+        for (int c = 0; c < dimension; ++c) {
+            uint32_t bits;
+            memcpy(&bits, (*data)[i].data() + c, sizeof(bits));
+            res = (res ^ bits) * 0x100000001B3ULL;
+        }
+    }
+    return res;
+}
+
+float HNSWIndex::similarity(const float* query, int node) const {
+    return dot(query, (*data)[node].data(), dimension) * inv_norms[node];
+}
+
+float HNSWIndex::similarity(int node1, int node2) const {
+    return dot((*data)[node1].data(), (*data)[node2].data(), dimension) * inv_norms[node1] * inv_norms[node2];
+}
+
+/**
+ * @brief Descend from layer `from_level` to layer `to_level` (excluded), by moving to the closest neighbor
+ * of the current node in each layer, until no neighbor is closer to the query.
+ */
+int HNSWIndex::greedySearch(const float* query, int node, int from_level, int to_level, HNSWLocks* locks) const {
+    vector<uint32_t> buffer(links + 1);
+    float best = similarity(query, node);
+
+    for (int level = from_level; level > to_level; --level) {
+        for (bool changed = true; changed;) {
+            changed = false;
+            const uint32_t* list = neighbors(node, level);
+            if (locks) {
+                std::lock_guard<std::mutex> lock(locks->node(node));
+                std::copy(list, list + list[0] + 1, buffer.data());
+                list = buffer.data();
+            }
+            for (uint32_t k = 1; k <= list[0]; ++k) {
+                float score = similarity(query, list[k]);
+                if (score > best) {
+                    best = score;
+                    node = list[k];
+                    changed = true;
+                }
+            }
+        }
+    }
+    return node;
+}
+
+/**
+ * @brief Beam search in one layer: the `ef` closest nodes to the query that were found from `entry`,
+ * by decreasing similarity. `locks` is only needed while the graph is being built.
+ */
+vector<pair<float, int>> HNSWIndex::searchLayer(const float* query, int entry, int ef, int level,
+                                                HNSWLocks* locks) const {
+    typedef pair<float, int> Score;
+    std::priority_queue<Score> candidates; // nodes to expand, closest first
+    std::priority_queue<Score, vector<Score>, std::greater<Score>> results; // `ef` best nodes, furthest first
+
+    VisitedSet& visited = visitedSet();
+    visited.reset(levels.size());
+    visited.visit(entry);
+    float score = similarity(query, entry);
+    candidates.push({score, entry});
+    results.push({score, entry});
+
+    vector<uint32_t> buffer(2 * links + 1);
+    while (!candidates.empty()) {
+        Score candidate = candidates.top();
+        if (candidate.first < results.top().first && results.size() >= ef) break;
+        candidates.pop();
+
+        const uint32_t* list = neighbors(candidate.second, level);
+        if (locks) {
+            std::lock_guard<std::mutex> lock(locks->node(candidate.second));
+            std::copy(list, list + list[0] + 1, buffer.data());
+            list = buffer.data();
+        }
+        for (uint32_t k = 1; k <= list[0]; ++k) {
+            int node = list[k];
+            if (!visited.visit(node)) continue;
+
+            score = similarity(query, node);
+            if (results.size() < ef || score > results.top().first) {
+                candidates.push({score, node});
+                results.push({score, node});
+                if (results.size() > ef) results.pop();
+            }
+        }
+    }
+
+    vector<Score> res(results.size());
+    for (int i = res.size() - 1; i >= 0; --i, results.pop()) {
+        res[i] = results.top();
+    }
+    return res;
+}
+
+/**
+ * @brief Keep at most `n` candidates (sorted by decreasing similarity to the base node), skipping those
+ * that are closer to an already selected neighbor than to the base node: the links go in diverse
+ * directions, which keeps the graph connected when the data is clustered.
+ */
+vector<int> HNSWIndex::selectNeighbors(const vector<pair<float, int>>& candidates, int n) const {
+    vector<int> res;
+    for (auto it = candidates.begin(); it != candidates.end() && res.size() < n; ++it) {
+        bool diverse = true;
+        for (auto neighbor = res.begin(); neighbor != res.end() && diverse; ++neighbor) {
+            diverse = similarity(it->second, *neighbor) <= it->first;
+        }
+        if (diverse) res.push_back(it->second);
+    }
+    return res;
+}
+
+// adds a link from `node` to `neighbor`, and prunes the links of `node` if it has too many
+void HNSWIndex::connect(int node, int neighbor, int level, HNSWLocks& locks) {
+    std::lock_guard<std::mutex> lock(locks.node(node));
+    uint32_t* list = neighbors(node, level);
+    uint32_t max_links = level == 0 ? 2 * links : links;
+
+    if (list[0] < max_links) {
+        list[++list[0]] = neighbor;
+        return;
+    }
+
+    vector<pair<float, int>> candidates = {{similarity(node, neighbor), neighbor}};
+    for (uint32_t k = 1; k <= list[0]; ++k) {
+        candidates.push_back({similarity(node, list[k]), list[k]});
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater<pair<float, int>>());
+
+    vector<int> selected = selectNeighbors(candidates, max_links);
+    list[0] = selected.size();
+    std::copy(selected.begin(), selected.end(), list + 1);
+}
+
+void HNSWIndex::insert(int node, HNSWLocks& locks) {
+    int level = levels[node];
+    vec query = (*data)[node];
+    query *= inv_norms[node];
+
+    int entry, top;
+    {
+        std::lock_guard<std::mutex> lock(locks.entry);
+        entry = entry_point;
+        top = max_level;
+    }
+
+    entry = greedySearch(query.data(), entry, top, level, &locks);
+
+    for (int l = std::min(level, top); l >= 0; --l) {
+        auto candidates = searchLayer(query.data(), entry, ef_construction, l, &locks);
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                        [&](const pair<float, int>& p) { return p.second == node; }),
+                         candidates.end());
+        if (candidates.empty()) continue;
+        vector<int> selected = selectNeighbors(candidates, links);
+
+        {
+            std::lock_guard<std::mutex> lock(locks.node(node));
+            uint32_t* list = neighbors(node, l);
+            list[0] = selected.size();
+            std::copy(selected.begin(), selected.end(), list + 1);
+        }
+        for (auto it = selected.begin(); it != selected.end(); ++it) {
+            connect(*it, node, l, locks);
+        }
+        entry = candidates.front().second;
+    }
+
+    if (level > top) {
+        std::lock_guard<std::mutex> lock(locks.entry);
+        if (level > max_level) {
+            max_level = level;
+            entry_point = node;
+        }
+    }
+}
+
+/**
+ * @brief Build the graph of the rows of `data`, inserted by config.threads threads. The level of each
+ * node is drawn with a fixed seed, but the graph also depends on the order of the concurrent insertions.
+ */
+void HNSWIndex::build(const mat& data, unsigned long long signature, const HNSWConfig& config) {
+    if (data.empty()) {
+        throw runtime_error("empty model");
+    }
+    if (config.links < 2) {
+        throw runtime_error("the number of links must be at least 2");
+    }
+
+    clear();
+    attach(data);
+    this->signature = signature;
+    links = config.links;
+    ef_construction = std::max(config.ef_construction, config.links);
+
+    // P(level >= l) = links^-l
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double scale = 1 / log(static_cast<double>(links));
+    levels.resize(data.size());
+    for (auto it = levels.begin(); it != levels.end(); ++it) {
+        *it = std::min(HNSW_MAX_LEVEL, static_cast<int>(-log(1.0 - uniform(generator)) * scale));
+    }
+    allocate();
+
+    if (config.verbose)
+        std::cout << "Building HNSW index of " << data.size() << " words (links: " << links
+                  << ", ef construction: " << ef_construction << ")" << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    entry_point = 0;
+    max_level = levels[0];
+    HNSWLocks locks(data.size());
+    std::atomic<long long> next(1);
+    long long size = data.size();
+
+    // nodes are taken in order by the threads, so that each insertion finds a graph of similar size
+    parallelFor(config.threads, config.threads, [&](long long, long long) {
+        for (long long node = next++; node < size; node = next++) {
+            insert(node, locks);
+        }
+    });
+
+    if (config.verbose) {
+        std::chrono::duration<float> duration = std::chrono::high_resolution_clock::now() - start;
+        std::cout << "HNSW index built in " << duration.count() << "s (" << max_level + 1 << " layers)" << std::endl;
+    }
+}
+
+void HNSWIndex::save(const string& filename) const {
+    if (empty()) {
+        throw runtime_error("the HNSW index is empty");
+    }
+
+    ofstream outfile(filename, ios::binary | ios::out);
+    check_is_open(outfile, filename);
+
+    HNSWHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HNSW_MAGIC, sizeof(HNSW_MAGIC));
+    header.version = HNSW_VERSION;
+    header.header_size = sizeof(header);
+    header.dimension = dimension;
+    header.links = links;
+    header.ef_construction = ef_construction;
+    header.max_level = max_level;
+    header.entry_point = entry_point;
+    header.vocab_size = levels.size();
+    header.upper_size = upper.size();
+    header.signature = signature;
+    header.checksum = checksum();
+
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outfile.write(reinterpret_cast<const char*>(levels.data()), levels.size() * sizeof(uint8_t));
+    outfile.write(reinterpret_cast<const char*>(base.data()), base.size() * sizeof(uint32_t));
+    outfile.write(reinterpret_cast<const char*>(upper.data()), upper.size() * sizeof(uint32_t));
+
+    if (!outfile) {
+        throw runtime_error("couldn't write file " + filename);
+    }
+}
+
+/**
+ * @brief Load an index saved with `save`, for the rows of `data`. Return false (and leave the index
+ * empty) if it was built for another model, or for other vectors of the same vocabulary.
+ */
+bool HNSWIndex::load(const string& filename, const mat& data, unsigned long long signature) {
+    clear();
+    ifstream infile(filename, ios::binary | ios::in);
+    check_is_open(infile, filename);
+
+    HNSWHeader header;
+    infile.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!infile || memcmp(header.magic, HNSW_MAGIC, sizeof(HNSW_MAGIC)) != 0) {
+        throw runtime_error("not an HNSW index file: " + filename);
+    }
+    if (header.version > HNSW_VERSION || header.header_size != sizeof(header)) {
+        throw runtime_error("unsupported version of the HNSW index format: " + filename);
+    }
+
+    if (header.signature != signature || header.vocab_size != data.size() || data.empty()
+        || header.dimension != data[0].size()) {
+        return false;
+    }
+    attach(data);
+    if (header.checksum != checksum()) {
+        clear();
+        return false;
+    }
+
+    // sizes of the sections, before allocating them
+    infile.seekg(0, infile.end);
+    unsigned long long file_size = infile.tellg();
+    infile.seekg(sizeof(header), infile.beg);
+    if (header.links == 0 || header.links > (1 << 16) || header.max_level > HNSW_MAX_LEVEL
+        || header.entry_point >= header.vocab_size
+        || header.upper_size > file_size
+        || file_size != sizeof(header) + header.vocab_size * (sizeof(uint8_t) + (2 * header.links + 1) * sizeof(uint32_t))
+                        + header.upper_size * sizeof(uint32_t)) {
+        clear();
+        throw runtime_error("invalid HNSW index file: " + filename);
+    }
+
+    this->signature = signature;
+    links = header.links;
+    ef_construction = header.ef_construction;
+    max_level = header.max_level;
+    entry_point = header.entry_point;
+    levels.resize(header.vocab_size);
+    infile.read(reinterpret_cast<char*>(levels.data()), levels.size() * sizeof(uint8_t));
+    allocate();
+
+    if (!infile || upper.size() != header.upper_size) {
+        clear();
+        throw runtime_error("invalid HNSW index file: " + filename);
+    }
+
+    infile.read(reinterpret_cast<char*>(base.data()), base.size() * sizeof(uint32_t));
+    infile.read(reinterpret_cast<char*>(upper.data()), upper.size() * sizeof(uint32_t));
+    if (!infile) {
+        clear();
+        throw runtime_error("truncated HNSW index file: " + filename);
+    }
+
+    if (!valid()) {
+        clear();
+        throw runtime_error("invalid HNSW index file: " + filename);
+    }
+    return true;
+}
+
+/**
+ * @brief Check the graph read by `load`, as the searches follow its links without bound checks:
+ * the entry point is in the top layer, no word is above it, and the links of each layer have at most
+ * the maximum number of neighbors, which are words of this layer.
+ */
+bool HNSWIndex::valid() const {
+    long long size = levels.size();
+    if (entry_point < 0 || entry_point >= size || levels[entry_point] != max_level) return false;
+
+    for (long long node = 0; node < size; ++node) {
+        if (levels[node] > max_level) return false;
+
+        for (int level = 0; level <= levels[node]; ++level) {
+            const uint32_t* list = neighbors(node, level);
+            if (list[0] > (level == 0 ? 2 * links : links)) return false;
+            for (uint32_t k = 1; k <= list[0]; ++k) {
+                if (list[k] >= size || levels[list[k]] < level) return false;
+            }
+        }
+    }
+    return true;
+}
+
+void HNSWIndex::clear() {
+    data = 0;
+    inv_norms.clear();
+    levels.clear();
+    base.clear();
+    upper.clear();
+    upper_offsets.clear();
+    max_level = 0;
+    entry_point = -1;
+    signature = 0;
+}
+
+vector<pair<int, float>> HNSWIndex::search(const vec& v, int n, int ef) const {
+    PROFILE_SCOPE("HNSWIndex::search");
+    if (empty()) {
+        throw runtime_error("the HNSW index is empty");
+    }
+    if (v.size() != dimension) {
+        throw runtime_error("wrong dimension");
+    }
+
+    vec query = v;
+    float norm = query.norm();
+    if (norm > 0) query /= norm;
+
+    int entry = greedySearch(query.data(), entry_point, max_level, 0, 0);
+    auto candidates = searchLayer(query.data(), entry, std::max(ef, n), 0, 0);
+
+    vector<pair<int, float>> res;
+    for (int i = 0; i < candidates.size() && i < n; ++i) {
+        res.push_back({candidates[i].second, candidates[i].first});
+    }
+    return res;
+}
+
+/**
+ * @brief Build an HNSW index of the input weights with config->threads threads. `closest` (with policy 0)
+ * then returns approximate results, whose recall depends on config->index_ef.
+ */
+void MonolingualModel::buildIndex(int links, int ef_construction) {
+    HNSWConfig index_config;
+    index_config.links = links;
+    index_config.ef_construction = ef_construction;
+    index_config.threads = config->threads;
+    index_config.verbose = config->verbose;
+
+    indexVocab();
+    hnsw.build(input_weights, signature(), index_config);
+}
+
+void MonolingualModel::saveIndex(const string& filename) const {
+    if (config->verbose)
+        std::cout << "Saving HNSW index" << std::endl;
+    hnsw.save(filename);
+}
+
+bool MonolingualModel::loadIndex(const string& filename) {
+    if (!hnsw.load(filename, input_weights, signature())) {
+        if (config->verbose)
+            std::cout << "Ignoring HNSW index " << filename << ", which doesn't match the model" << std::endl;
+        return false;
+    }
+
+    indexVocab();
+    if (config->verbose)
+        std::cout << "Loaded HNSW index " << filename << std::endl;
+    return true;
+}
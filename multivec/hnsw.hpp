@@ -0,0 +1,106 @@
+#pragma once
+#include "utils.hpp"
+
+/**
+ * Hierarchical Navigable Small World graph (Malkov & Yashunin, 2016): approximate nearest neighbor
+ * index of word embeddings, used by MonolingualModel::closest (see MonolingualModel::buildIndex).
+ * The graph only contains links: the vectors are those of the model (not owned).
+ *
+ * Each word is in layer 0, and in each upper layer with probability 1 / links. A query greedily
+ * descends the upper layers from the entry point, then explores layer 0 with a beam of `ef` candidates.
+ *
+ * Saved next to the model (model file + ".hnsw"). Layout (native byte order):
+ *   HNSWHeader (128 bytes)
+ *   levels     uint8[vocab_size], top layer of each word
+ *   base       uint32[vocab_size][2 * links + 1], layer 0: number of neighbors, then the neighbors
+ *   upper      uint32[upper_size], layers 1 to levels[i] of each word i with levels[i] > 0 (in this
+ *              order), with links + 1 values per layer
+ */
+
+const char HNSW_MAGIC[8] = {'M', 'V', 'H', 'N', 'S', 'W', '\0', '\0'};
+const uint32_t HNSW_VERSION = 1;
+const int HNSW_MAX_LEVEL = 16;
+
+struct HNSWHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t dimension;
+    uint32_t links;
+    uint32_t ef_construction;
+    uint32_t max_level;
+
+    uint64_t entry_point;
+    uint64_t vocab_size;
+    uint64_t upper_size;
+    uint64_t signature; // vocabulary and dimension of the model (see MonolingualModel::signature)
+    uint64_t checksum; // sample of the vectors, to detect an index that is older than the model
+
+    uint8_t reserved[56]; // for future versions
+};
+
+static_assert(sizeof(HNSWHeader) == 128, "unexpected size of HNSWHeader");
+
+struct HNSWConfig {
+    int links; // neighbors per word in the upper layers (2 * links in layer 0)
+    int ef_construction; // beam width of the insertions: better graph, but slower construction
+    int threads;
+    bool verbose;
+
+    HNSWConfig() : links(16), ef_construction(200), threads(4), verbose(false) {}
+};
+
+struct HNSWLocks; // locks of the nodes during the construction (see hnsw.cpp)
+
+/**
+ * @brief HNSW graph over the rows of a matrix (cosine similarity). `build` inserts the rows with
+ * several threads (with a lock per group of nodes). `search` is thread-safe.
+ */
+class HNSWIndex {
+    const mat* data; // not owned
+    vector<float> inv_norms; // zero for null vectors
+    int dimension;
+    int links;
+    int ef_construction;
+    int max_level;
+    int entry_point;
+    unsigned long long signature;
+
+    vector<uint8_t> levels;
+    vector<uint32_t> base;
+    vector<uint32_t> upper;
+    vector<size_t> upper_offsets; // position in `upper` of each word with levels[i] > 0
+
+    uint32_t* neighbors(int node, int level);
+    const uint32_t* neighbors(int node, int level) const;
+
+    void attach(const mat& data); // computes the norms
+    void allocate(); // links of all the levels, initialized from `levels`
+    unsigned long long checksum() const;
+    bool valid() const; // links of a loaded graph
+
+    float similarity(const float* query, int node) const; // `query` is normalized
+    float similarity(int node1, int node2) const;
+    int greedySearch(const float* query, int node, int from_level, int to_level, HNSWLocks* locks) const;
+    vector<pair<float, int>> searchLayer(const float* query, int entry, int ef, int level, HNSWLocks* locks) const;
+    vector<int> selectNeighbors(const vector<pair<float, int>>& candidates, int n) const; // diversity heuristic
+    void connect(int node, int neighbor, int level, HNSWLocks& locks);
+    void insert(int node, HNSWLocks& locks);
+
+public:
+    HNSWIndex() : data(0), dimension(0), links(0), ef_construction(0), max_level(0), entry_point(-1), signature(0) {}
+
+    // builds the graph of the rows of `data` (which must outlive the index)
+    void build(const mat& data, unsigned long long signature, const HNSWConfig& config = HNSWConfig());
+    void save(const string& filename) const;
+    // false if this index doesn't match `data` and `signature` (e.g., saved before the model was trained again)
+    bool load(const string& filename, const mat& data, unsigned long long signature);
+    void clear();
+
+    bool empty() const { return entry_point < 0; }
+    long long size() const { return levels.size(); }
+
+    // approximate `n` closest rows to `v`, by decreasing cosine similarity: (row, similarity).
+    // `ef` (at least n) is the recall/latency trade-off.
+    vector<pair<int, float>> search(const vec& v, int n, int ef) const;
+};
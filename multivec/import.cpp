@@ -0,0 +1,168 @@
+#include "monolingual.hpp"
+#include "linalg.hpp"
+#include <cstring>
+
+namespace {
+
+struct Row {
+    const char* begin; // start of the word
+    const char* word_end;
+    const char* end; // end of the line (text), or of the vector (binary)
+};
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+const char* skipSpaces(const char* pos, const char* end) {
+    while (pos < end && isSpace(*pos)) ++pos;
+    return pos;
+}
+
+const char* skipWord(const char* pos, const char* end) {
+    while (pos < end && !isSpace(*pos)) ++pos;
+    return pos;
+}
+
+int countTokens(const char* pos, const char* end) {
+    int n = 0;
+    for (pos = skipSpaces(pos, end); pos < end; pos = skipSpaces(skipWord(pos, end), end)) ++n;
+    return n;
+}
+
+// parses `dimension` values in [pos, end): `end` must not be the end of the mapping, as strtof needs a delimiter
+bool parseValues(const char* pos, const char* end, int dimension, float* values) {
+    for (int c = 0; c < dimension; ++c) {
+        char* next;
+        values[c] = strtof(pos, &next);
+        if (next == pos || next > end) return false;
+        pos = next;
+    }
+    return skipSpaces(pos, end) == end;
+}
+
+}
+
+/**
+ * @brief Import word embeddings in the word2vec text (`binary` false) or binary format, e.g., saved by
+ * saveVectors or saveVectorsBin, or by another toolkit. The text format may also have no header (GloVe).
+ * The file is mapped in memory, and the vectors are parsed by config->threads threads.
+ *
+ * The result is a query-only model: `closest`, `similarity`, the sentence similarities, `save` and
+ * `saveFlat` work, but it has no output weights, and can't be trained further or infer paragraph
+ * vectors. Word counts are unknown: words are assumed to be sorted by decreasing frequency (as in
+ * word2vec), and their count is their rank from the end.
+ *
+ * @param max_vocab keep only the first `max_vocab` words (0 to keep all the words)
+ */
+void MonolingualModel::importVectors(const string& filename, bool binary, long long max_vocab) {
+    if (config->verbose)
+        std::cout << "Importing " << (binary ? "binary" : "text") << " word vectors from " << filename << std::endl;
+
+    MappedFile file;
+    file.open(filename);
+    file.adviseSequential();
+    const char* pos = file.data();
+    const char* end = pos + file.size();
+
+    const char* eol = std::find(pos, end, '\n');
+    long long vocab_size = -1;
+    int dimension = 0;
+
+    if (countTokens(pos, eol) == 2) { // header: vocabulary size and dimension
+        char* next;
+        vocab_size = strtoll(pos, &next, 10);
+        dimension = strtol(next, &next, 10);
+        pos = eol + 1;
+    } else if (!binary) { // no header: the dimension is given by the first line
+        dimension = countTokens(pos, eol) - 1;
+    }
+
+    if (dimension <= 0)
+        throw runtime_error("invalid header in " + filename);
+    long long header_size = vocab_size;
+    if (max_vocab > 0 && (vocab_size < 0 || max_vocab < vocab_size))
+        vocab_size = max_vocab;
+
+    // find the rows (sequential, but much faster than parsing the values)
+    vector<Row> rows;
+    if (vocab_size >= 0)
+        rows.reserve(vocab_size);
+    size_t vector_size = sizeof(float) * dimension;
+
+    while (vocab_size < 0 || static_cast<long long>(rows.size()) < vocab_size) {
+        pos = skipSpaces(pos, end);
+        if (pos == end) break;
+
+        Row row;
+        row.begin = pos;
+        row.word_end = skipWord(pos, end);
+        if (binary) {
+            row.end = row.word_end + 1 + vector_size;
+            if (row.end > end)
+                throw runtime_error("unexpected end of file in " + filename);
+        } else {
+            row.end = std::find(row.word_end, end, '\n');
+        }
+        rows.push_back(row);
+        pos = row.end;
+    }
+
+    if (header_size >= 0 && static_cast<long long>(rows.size()) < vocab_size)
+        throw runtime_error("unexpected end of file in " + filename);
+
+    // vocabulary, in file order (some files have duplicate words: only the first vector is kept)
+    vector<int> indices(rows.size());
+    vocabulary.clear();
+    vocabulary.reserve(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        int index = vocabulary.size();
+        HuffmanNode node(index, string(rows[i].begin, rows[i].word_end));
+        node.count = rows.size() - i;
+        indices[i] = vocabulary.insert({node.word, node}).second ? index : -1;
+    }
+
+    input_weights.assign(vocabulary.size(), vec());
+    std::atomic<long long> error_row(-1);
+
+    parallelFor(rows.size(), config->threads, [&](long long begin, long long end_row) {
+        for (long long i = begin; i < end_row && error_row < 0; ++i) {
+            if (indices[i] < 0) continue;
+            vec& weights = input_weights[indices[i]];
+            weights = vec(dimension, 0);
+            const Row& row = rows[i];
+
+            if (binary) {
+                memcpy(weights.data(), row.word_end + 1, vector_size);
+            } else if (row.end < end) {
+                if (!parseValues(row.word_end, row.end, dimension, weights.data())) error_row = i;
+            } else { // last line without a newline: copy it, so that strtof stops before the end of the mapping
+                string line(row.word_end, row.end);
+                if (!parseValues(line.c_str(), line.c_str() + line.size(), dimension, weights.data())) error_row = i;
+            }
+        }
+    });
+
+    if (error_row >= 0)
+        throw runtime_error("invalid vector for word '" + string(rows[error_row].begin, rows[error_row].word_end)
+                            + "' in " + filename + " (expected " + std::to_string(dimension) + " values)");
+
+    // the imported model only has input weights
+    config->dimension = dimension;
+    config->negative = 0;
+    config->hierarchical_softmax = false;
+    config->sent_vector = false;
+    output_weights.clear();
+    output_weights_hs.clear();
+    sent_weights.clear();
+    input_sq_grads.clear();
+    output_sq_grads.clear();
+    output_hs_sq_grads.clear();
+    unigram_table.clear();
+    index_table.clear();
+    hnsw.clear();
+    deferred_file.clear();
+
+    if (config->verbose)
+        std::cout << "Vocabulary size: " << vocabulary.size() << ", dimension: " << dimension << std::endl;
+}
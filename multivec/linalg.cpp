@@ -0,0 +1,272 @@
+#include "linalg.hpp"
+
+Matrix::Matrix(const mat& m, const vector<int>& rows) : _rows(rows.empty() ? m.size() : rows.size()),
+    _cols(m.empty() ? 0 : m.front().size()), _data(static_cast<size_t>(_rows) * _cols) {
+    for (int i = 0; i < _rows; ++i) {
+        const vec& v = m[rows.empty() ? i : rows[i]];
+        std::copy(v.data(), v.data() + _cols, row(i));
+    }
+}
+
+Matrix Matrix::identity(int n) {
+    Matrix m(n, n);
+    for (int i = 0; i < n; ++i) m(i, i) = 1;
+    return m;
+}
+
+Matrix Matrix::transpose() const {
+    Matrix t(_cols, _rows);
+    for (int i = 0; i < _rows; ++i) {
+        for (int j = 0; j < _cols; ++j) t(j, i) = (*this)(i, j);
+    }
+    return t;
+}
+
+void Matrix::normalizeRows() {
+    for (int i = 0; i < _rows; ++i) {
+        float* x = row(i);
+        float norm = sqrt(dot(x, x, _cols));
+        if (norm == 0) continue;
+        for (int j = 0; j < _cols; ++j) x[j] /= norm;
+    }
+}
+
+void parallelFor(long long n, int threads, const std::function<void(long long, long long)>& function) {
+    threads = static_cast<int>(std::max(1LL, std::min(static_cast<long long>(threads), n)));
+
+    if (threads == 1) {
+        function(0, n);
+        return;
+    }
+
+    vector<thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(thread(function, n * i / threads, n * (i + 1) / threads));
+    }
+    for (auto it = workers.begin(); it != workers.end(); ++it) {
+        it->join();
+    }
+}
+
+Matrix multiply(const Matrix& a, const Matrix& b, int threads) {
+    if (a.cols() != b.rows()) throw runtime_error("incompatible matrix dimensions");
+    Matrix c(a.rows(), b.cols());
+
+    parallelFor(a.rows(), threads, [&](long long begin, long long end) {
+        for (long long i = begin; i < end; ++i) {
+            float* y = c.row(i);
+            const float* x = a.row(i);
+            for (int k = 0; k < a.cols(); ++k) { // y += x[k] * b[k]
+                const float* z = b.row(k);
+                for (int j = 0; j < b.cols(); ++j) y[j] += x[k] * z[j];
+            }
+        }
+    });
+
+    return c;
+}
+
+Matrix transposeMultiply(const Matrix& a, const Matrix& b, int threads) {
+    if (a.rows() != b.rows()) throw runtime_error("incompatible matrix dimensions");
+    threads = std::max(1, std::min(threads, a.rows()));
+
+    // sum of outer products of the rows, each thread sums its own range of rows
+    vector<Matrix> partial(threads, Matrix(a.cols(), b.cols()));
+
+    parallelFor(threads, threads, [&](long long thread_id, long long) {
+        Matrix& c = partial[thread_id];
+        int begin = static_cast<long long>(a.rows()) * thread_id / threads;
+        int end = static_cast<long long>(a.rows()) * (thread_id + 1) / threads;
+
+        for (int k = begin; k < end; ++k) {
+            const float* x = a.row(k);
+            const float* z = b.row(k);
+            for (int i = 0; i < a.cols(); ++i) {
+                float* y = c.row(i);
+                for (int j = 0; j < b.cols(); ++j) y[j] += x[i] * z[j];
+            }
+        }
+    });
+
+    for (int t = 1; t < threads; ++t) {
+        for (int i = 0; i < a.cols(); ++i) {
+            for (int j = 0; j < b.cols(); ++j) partial[0](i, j) += partial[t](i, j);
+        }
+    }
+
+    return partial[0];
+}
+
+/**
+ * @brief One-sided Jacobi SVD: columns of `a` are orthogonalized by plane rotations, which
+ * are accumulated into `v`. Rotations of disjoint column pairs are independent, so each round
+ * of a round-robin ordering is done in parallel. Computations are in double precision.
+ */
+void svd(const Matrix& a, Matrix& u, vector<float>& s, Matrix& v, int threads) {
+    int m = a.rows();
+    int n = a.cols();
+    if (m < n) throw runtime_error("svd: matrix must have at least as many rows as columns");
+
+    // columns of a and v are stored as contiguous rows
+    vector<double> cols(static_cast<size_t>(n) * m);
+    vector<double> v_cols(static_cast<size_t>(n) * n, 0);
+    for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < m; ++i) cols[static_cast<size_t>(j) * m + i] = a(i, j);
+        v_cols[static_cast<size_t>(j) * n + j] = 1;
+    }
+
+    // round-robin tournament: in each round, all columns are paired (-1 is a dummy column)
+    vector<int> players(n + n % 2);
+    for (int j = 0; j < players.size(); ++j) players[j] = j < n ? j : -1;
+    int pairs = players.size() / 2;
+
+    const int max_sweeps = 30;
+    const double epsilon = 1e-10;
+
+    for (int sweep = 0; sweep < max_sweeps; ++sweep) {
+        std::atomic<int> rotations(0);
+
+        for (int round = 0; round + 1 < players.size(); ++round) {
+            parallelFor(pairs, n >= 64 ? threads : 1, [&](long long begin, long long end) {
+                for (long long k = begin; k < end; ++k) {
+                    int p = players[k];
+                    int q = players[players.size() - 1 - k];
+                    if (p == -1 || q == -1) continue;
+
+                    double* x = cols.data() + static_cast<size_t>(p) * m;
+                    double* y = cols.data() + static_cast<size_t>(q) * m;
+                    double alpha = 0, beta = 0, gamma = 0;
+                    for (int i = 0; i < m; ++i) {
+                        alpha += x[i] * x[i];
+                        beta += y[i] * y[i];
+                        gamma += x[i] * y[i];
+                    }
+
+                    if (std::abs(gamma) <= epsilon * sqrt(alpha * beta)) continue;
+                    ++rotations;
+
+                    double zeta = (beta - alpha) / (2 * gamma);
+                    double t = (zeta >= 0 ? 1 : -1) / (std::abs(zeta) + sqrt(1 + zeta * zeta));
+                    double c = 1 / sqrt(1 + t * t);
+                    double sn = c * t;
+
+                    for (int i = 0; i < m; ++i) {
+                        double xi = x[i];
+                        x[i] = c * xi - sn * y[i];
+                        y[i] = sn * xi + c * y[i];
+                    }
+
+                    double* vx = v_cols.data() + static_cast<size_t>(p) * n;
+                    double* vy = v_cols.data() + static_cast<size_t>(q) * n;
+                    for (int i = 0; i < n; ++i) {
+                        double xi = vx[i];
+                        vx[i] = c * xi - sn * vy[i];
+                        vy[i] = sn * xi + c * vy[i];
+                    }
+                }
+            });
+
+            // next round: keep the first player fixed, and rotate the others
+            std::rotate(players.begin() + 1, players.end() - 1, players.end());
+        }
+
+        if (rotations == 0) break;
+    }
+
+    // singular values in decreasing order
+    vector<double> norms(n);
+    vector<int> order(n);
+    for (int j = 0; j < n; ++j) {
+        const double* x = cols.data() + static_cast<size_t>(j) * m;
+        double norm = 0;
+        for (int i = 0; i < m; ++i) norm += x[i] * x[i];
+        norms[j] = sqrt(norm);
+        order[j] = j;
+    }
+    std::sort(order.begin(), order.end(), [&](int j, int k) { return norms[j] > norms[k]; });
+
+    u = Matrix(m, n);
+    v = Matrix(n, n);
+    s.assign(n, 0);
+
+    for (int k = 0; k < n; ++k) {
+        int j = order[k];
+        s[k] = norms[j];
+        const double* x = cols.data() + static_cast<size_t>(j) * m;
+        const double* vx = v_cols.data() + static_cast<size_t>(j) * n;
+        for (int i = 0; i < m; ++i) u(i, k) = norms[j] > 0 ? x[i] / norms[j] : 0;
+        for (int i = 0; i < n; ++i) v(i, k) = vx[i];
+    }
+}
+
+void nearestNeighbors(const Matrix& queries, const Matrix& keys, vector<int>& indices, vector<float>& scores,
+                      int threads) {
+    topK(queries, keys, 1, indices, scores, threads);
+}
+
+void topK(const Matrix& queries, const Matrix& keys, int k, vector<int>& indices, vector<float>& scores,
+          int threads, const vector<float>& key_bias) {
+    if (queries.cols() != keys.cols()) throw runtime_error("incompatible matrix dimensions");
+
+    indices.assign(static_cast<size_t>(queries.rows()) * k, -1);
+    scores.assign(static_cast<size_t>(queries.rows()) * k, -std::numeric_limits<float>::infinity());
+
+    const int query_block = 32;
+    const int key_block = 1024; // blocks of keys that stay in cache
+
+    parallelFor(queries.rows(), threads, [&](long long begin, long long end) {
+        typedef pair<float, int> Candidate;
+        vector<vector<Candidate>> heaps(query_block); // min-heaps of the k best keys of each query in the block
+
+        for (long long i0 = begin; i0 < end; i0 += query_block) {
+            long long i1 = std::min(i0 + query_block, end);
+            for (auto it = heaps.begin(); it != heaps.end(); ++it) it->clear();
+
+            for (int j0 = 0; j0 < keys.rows(); j0 += key_block) {
+                int j1 = std::min(j0 + key_block, keys.rows());
+
+                for (long long i = i0; i < i1; ++i) {
+                    const float* x = queries.row(i);
+                    vector<Candidate>& heap = heaps[i - i0];
+
+                    for (int j = j0; j < j1; ++j) {
+                        float score = dot(x, keys.row(j), keys.cols());
+                        if (!key_bias.empty()) score += key_bias[j];
+
+                        if (heap.size() < k) {
+                            heap.push_back({score, j});
+                            std::push_heap(heap.begin(), heap.end(), std::greater<Candidate>());
+                        } else if (score > heap.front().first) {
+                            std::pop_heap(heap.begin(), heap.end(), std::greater<Candidate>());
+                            heap.back() = {score, j};
+                            std::push_heap(heap.begin(), heap.end(), std::greater<Candidate>());
+                        }
+                    }
+                }
+            }
+
+            for (long long i = i0; i < i1; ++i) {
+                vector<Candidate>& heap = heaps[i - i0];
+                std::sort_heap(heap.begin(), heap.end(), std::greater<Candidate>()); // decreasing scores
+                for (int r = 0; r < heap.size(); ++r) {
+                    indices[i * k + r] = heap[r].second;
+                    scores[i * k + r] = heap[r].first;
+                }
+            }
+        }
+    });
+}
+
+vector<float> meanTopK(const Matrix& queries, const Matrix& keys, int k, int threads) {
+    vector<int> indices;
+    vector<float> scores;
+    k = std::max(1, std::min(k, keys.rows()));
+    topK(queries, keys, k, indices, scores, threads);
+
+    vector<float> means(queries.rows(), 0);
+    for (int i = 0; i < queries.rows(); ++i) {
+        for (int r = 0; r < k; ++r) means[i] += scores[static_cast<size_t>(i) * k + r];
+        means[i] /= k;
+    }
+    return means;
+}
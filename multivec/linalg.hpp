@@ -0,0 +1,69 @@
+#pragma once
+#include "utils.hpp"
+#include <limits>
+
+/**
+ * Dense linear algebra on contiguous row-major matrices, for operations on whole embedding
+ * matrices (products, SVD, nearest neighbors), which would be too slow on `mat` (vector of vectors).
+ * Expensive operations are multi-threaded (splitting the rows of the result between threads).
+ */
+class Matrix {
+    int _rows;
+    int _cols;
+    vector<float> _data;
+
+public:
+    Matrix() : _rows(0), _cols(0) {}
+    Matrix(int rows, int cols, float value = 0) : _rows(rows), _cols(cols), _data(static_cast<size_t>(rows) * cols, value) {}
+    Matrix(const mat& m, const vector<int>& rows); // copy of the given rows of m (all rows if empty)
+
+    static Matrix identity(int n);
+
+    int rows() const { return _rows; }
+    int cols() const { return _cols; }
+    float* row(int i) { return _data.data() + static_cast<size_t>(i) * _cols; }
+    const float* row(int i) const { return _data.data() + static_cast<size_t>(i) * _cols; }
+    float& operator()(int i, int j) { return row(i)[j]; }
+    float operator()(int i, int j) const { return row(i)[j]; }
+
+    Matrix transpose() const;
+    void normalizeRows(); // unit length rows
+};
+
+inline float dot(const float* x, const float* y, int n) {
+    // several partial sums, so that the compiler can vectorize the loop
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += x[i] * y[i];
+        s1 += x[i + 1] * y[i + 1];
+        s2 += x[i + 2] * y[i + 2];
+        s3 += x[i + 3] * y[i + 3];
+    }
+    for (; i < n; ++i) s0 += x[i] * y[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+// runs function(begin, end) on [0, n) split in `threads` contiguous ranges
+void parallelFor(long long n, int threads, const std::function<void(long long, long long)>& function);
+
+Matrix multiply(const Matrix& a, const Matrix& b, int threads = 1);           // a * b
+Matrix transposeMultiply(const Matrix& a, const Matrix& b, int threads = 1);  // a^T * b
+
+// singular value decomposition a = u * diag(s) * v^T (one-sided Jacobi), with a.rows() >= a.cols()
+void svd(const Matrix& a, Matrix& u, vector<float>& s, Matrix& v, int threads = 1);
+
+// nearest neighbor (highest dot product) in `keys` of each row of `queries`
+void nearestNeighbors(const Matrix& queries, const Matrix& keys, vector<int>& indices, vector<float>& scores,
+                      int threads = 1);
+
+/**
+ * @brief k nearest neighbors in `keys` of each row of `queries`, with score: dot(query, key) + key_bias[key]
+ * (no bias if `key_bias` is empty). Results for query i are in indices and scores [i * k, (i + 1) * k),
+ * by decreasing score (-1 if there are less than k keys).
+ */
+void topK(const Matrix& queries, const Matrix& keys, int k, vector<int>& indices, vector<float>& scores,
+          int threads = 1, const vector<float>& key_bias = vector<float>());
+
+// mean dot product of each row of `queries` with its k nearest neighbors in `keys` (used for CSLS)
+vector<float> meanTopK(const Matrix& queries, const Matrix& keys, int k, int threads = 1);
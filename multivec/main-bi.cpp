@@ -29,6 +29,24 @@ static vector<option_plus> options_plus = {
     {"save",          required_argument, 0, 'p', "save model"},
     {"save-src",      required_argument, 0, 'q', "save source model"},
     {"save-trg",      required_argument, 0, 'r', "save target model"},
+    {"cluster",       required_argument, 0, 's', "data-parallel training: address of the first process (host:port or unix:path)"},
+    {"rank",          required_argument, 0, 't', "data-parallel training: rank of this process (0 for the first process)"},
+    {"world-size",    required_argument, 0, 'u', "data-parallel training: number of processes"},
+    {"sync-words",    required_argument, 0, 'w', "data-parallel training: words processed between two synchronizations"},
+    {"build-corpus",  required_argument, 0, 'x', "convert training files to a binary corpus, and train with it"},
+    {"train-corpus",  required_argument, 0, 'y', "train with a binary corpus (created with --build-corpus)"},
+    {"align",         no_argument,       0, 'z', "align the binary corpus before training (IBM Model 2, saved in the corpus)"},
+    {"align-iter",    required_argument, 0, 'A', "number of alignment iterations"},
+    {"load-src",      required_argument, 0, 'B', "load a source monolingual model (to be mapped with --load-trg)"},
+    {"load-trg",      required_argument, 0, 'C', "load a target monolingual model"},
+    {"dict",          required_argument, 0, 'D', "seed dictionary for mapping (default: identical words)"},
+    {"self-learning", required_argument, 0, 'E', "maximum number of self-learning iterations for mapping"},
+    {"induce-dict",   required_argument, 0, 'F', "save the closest target words of each source word (bilingual lexicon induction)"},
+    {"topk",          required_argument, 0, 'G', "number of target words per source word in --induce-dict"},
+    {"csls",          no_argument,       0, 'H', "use CSLS instead of cosine similarity in --induce-dict"},
+    {"adagrad",       no_argument,       0, 'I', "per-row AdaGrad learning rates (converges in fewer epochs)"},
+    {"metrics",       required_argument, 0, 'J', "write training metrics to this file (JSON lines)"},
+    {"metrics-interval", required_argument, 0, 'K', "seconds between two metrics reports"},
     {0, 0, 0, 0, 0}
 };
 
@@ -52,6 +70,8 @@ int main(int argc, char **argv) {
     }
 
     string load_file;
+    string load_src_file;
+    string load_trg_file;
 
     // first pass on parameters to find out if a model file is provided
     while (1) {
@@ -61,6 +81,8 @@ int main(int argc, char **argv) {
 
         switch (opt) {
             case 'o': load_file = string(optarg);           break;
+            case 'B': load_src_file = string(optarg);       break;
+            case 'C': load_trg_file = string(optarg);       break;
             default:                                        break;
         }
     }
@@ -71,6 +93,9 @@ int main(int argc, char **argv) {
     // model file needs to be loaded before anything else (otherwise it overwrites the parameters)
     if (!load_file.empty()) {
         model.load(load_file);
+    } else if (!load_src_file.empty() && !load_trg_file.empty()) {
+        model.src_model.load(load_src_file);
+        model.trg_model.load(load_trg_file);
     }
 
     string train_src_file;
@@ -78,6 +103,15 @@ int main(int argc, char **argv) {
     string save_file;
     string save_src_file;
     string save_trg_file;
+    string build_corpus_file;
+    string train_corpus_file;
+    bool align = false;
+    int align_iterations = 5;
+    string dict_file;
+    int self_learning = 0;
+    string induce_dict_file;
+    int topk = 1;
+    bool csls = false;
 
     optind = 0;  // necessary to parse arguments twice
     while (1) {
@@ -106,11 +140,31 @@ int main(int argc, char **argv) {
             case 'p': save_file = string(optarg);           break;
             case 'q': save_src_file = string(optarg);       break;
             case 'r': save_trg_file = string(optarg);       break;
+            case 's': config.cluster_address = string(optarg); break;
+            case 't': config.cluster_rank = atoi(optarg);   break;
+            case 'u': config.cluster_size = atoi(optarg);   break;
+            case 'w': config.sync_words = atoll(optarg);    break;
+            case 'x': build_corpus_file = string(optarg);   break;
+            case 'y': train_corpus_file = string(optarg);   break;
+            case 'z': align = true;                         break;
+            case 'A': align_iterations = atoi(optarg);      break;
+            case 'B':                                       break;
+            case 'C':                                       break;
+            case 'D': dict_file = string(optarg);           break;
+            case 'E': self_learning = atoi(optarg);         break;
+            case 'F': induce_dict_file = string(optarg);    break;
+            case 'G': topk = atoi(optarg);                  break;
+            case 'H': csls = true;                          break;
+            case 'I': config.adagrad = true;                break;
+            case 'J': config.metrics_file = string(optarg); break;
+            case 'K': config.metrics_interval = atof(optarg); break;
             default:                                        abort();
         }
     }
 
-    if (load_file.empty() && (train_src_file.empty() || train_trg_file.empty())) {
+    bool mapping = load_file.empty() && !load_src_file.empty() && !load_trg_file.empty();
+
+    if (load_file.empty() && !mapping && train_corpus_file.empty() && (train_src_file.empty() || train_trg_file.empty())) {
         print_usage();
         return 0;
     }
@@ -118,8 +172,32 @@ int main(int argc, char **argv) {
     std::cout << "MultiVec-bi" << std::endl;
     config.print();
 
-    if (!train_src_file.empty() && !train_trg_file.empty()) {
-        model.train(train_src_file, train_trg_file, load_file.empty());
+    if (mapping) {
+        model.mapModels(dict_file, self_learning);
+    }
+
+    if (!train_src_file.empty() && !train_trg_file.empty() && !build_corpus_file.empty()) {
+        model.buildCorpus(train_src_file, train_trg_file, build_corpus_file, load_file.empty() && !mapping);
+        if (align) model.alignCorpus(build_corpus_file, align_iterations);
+        model.trainCorpus(build_corpus_file, false);
+    } else if (!train_src_file.empty() && !train_trg_file.empty()) {
+        model.train(train_src_file, train_trg_file, load_file.empty() && !mapping);
+    } else if (!train_corpus_file.empty()) {
+        if (align) model.alignCorpus(train_corpus_file, align_iterations);
+        model.trainCorpus(train_corpus_file, load_file.empty() && !mapping);
+    }
+
+    if (!induce_dict_file.empty()) {
+        ofstream outfile(induce_dict_file);
+        check_is_open(outfile, induce_dict_file);
+
+        auto words = model.src_model.getWords();
+        auto translations = model.trg_closest(vector<string>(), topk, csls);
+        for (int i = 0; i < words.size(); ++i) {
+            for (auto it = translations[i].begin(); it != translations[i].end(); ++it) {
+                outfile << words[i].first << " " << it->first << " " << it->second << std::endl;
+            }
+        }
     }
 
     if(!save_file.empty()) {
@@ -1,4 +1,5 @@
 #include "monolingual.hpp"
+#include "pq_index.hpp"
 #include <getopt.h>
 
 struct option_plus { // same as option with an additional description field
@@ -26,11 +27,42 @@ static vector<option_plus> options_plus = {
     {"sent-vector",       no_argument,       0, 'm', "train sentence vectors"},
     {"train",             required_argument, 0, 'n', "train with given training file"},
     {"load",              required_argument, 0, 'o', "load model"},
+    {"query-only",        no_argument,       0, 'M', "with --load, only load what queries need (training structures are loaded when needed)"},
+    {"import-vectors",    required_argument, 0, 'N', "import word vectors in the word2vec text format (instead of --load)"},
+    {"import-vectors-bin", required_argument, 0, 'O', "import word vectors in the word2vec binary format"},
+    {"import-max-vocab",  required_argument, 0, 'P', "with --import-vectors, only keep the first arg words"},
     {"save",              required_argument, 0, 'p', "save model"},
     {"save-vectors",      required_argument, 0, 'q', "save word vectors"},
     {"save-sent-vectors", required_argument, 0, 'r', "save sentence vectors"},
     {"save-vectors-bin",  required_argument, 0, 's', "save word vectors in binary format"},
-    {"train-online",      required_argument, 0, 't', "use existing model to train online sentence vectors"},
+    {"save-flat",         required_argument, 0, 'L', "save model in the memory-mappable flat format (can be loaded with --load)"},
+    {"save-int8",         required_argument, 0, 'Q', "save word vectors quantized to 8-bit integers (see QuantizedModel)"},
+    {"save-fp16",         required_argument, 0, 'R', "save word vectors as 16-bit floats (see QuantizedModel)"},
+    {"save-pq",           required_argument, 0, 'S', "build a product quantization index of the word vectors, and save it (see PQIndex)"},
+    {"pq-subquantizers",  required_argument, 0, 'T', "with --save-pq, bytes per vector (divides the dimension, default: dimension / 4)"},
+    {"pq-lists",          required_argument, 0, 'U', "with --save-pq, number of inverted lists (default: 0, exhaustive search)"},
+    {"hnsw",              no_argument,       0, 'V', "build an HNSW index for closest (saved next to the model by --save and --save-flat)"},
+    {"save-hnsw",         required_argument, 0, 'W', "build an HNSW index and save it (as model file + .hnsw, it is loaded with the model)"},
+    {"hnsw-links",        required_argument, 0, 'X', "with --hnsw, neighbors per word in the graph (default: 16)"},
+    {"hnsw-ef-construction", required_argument, 0, 'Y', "with --hnsw, candidates explored by each insertion (default: 200)"},
+    {"online-sent-vector", required_argument, 0, 't', "use existing model to compute online sentence vectors for each line of given file"},
+    {"train-online",      required_argument, 0, 't', "same as --online-sent-vector"},
+    {"dbow",              no_argument,       0, 'u', "DBOW paragraph vector model (default: DM)"},
+    {"dbow-words",        no_argument,       0, 'w', "also train word vectors in DBOW mode"},
+    {"save-sent-vectors-bin", required_argument, 0, 'x', "save sentence vectors as a binary float32 matrix"},
+    {"online-tolerance",  required_argument, 0, 'y', "early stopping threshold of online sentence vectors (0 to disable)"},
+    {"sent-weights-file", required_argument, 0, 'z', "store sentence vectors in this memory-mapped file instead of the model"},
+    {"cluster",           required_argument, 0, 'A', "data-parallel training: address of the first process (host:port or unix:path)"},
+    {"rank",              required_argument, 0, 'B', "data-parallel training: rank of this process (0 for the first process)"},
+    {"world-size",        required_argument, 0, 'C', "data-parallel training: number of processes"},
+    {"sync-words",        required_argument, 0, 'D', "data-parallel training: words processed between two synchronizations"},
+    {"adagrad",           no_argument,       0, 'E', "per-row AdaGrad learning rates (converges in fewer epochs)"},
+    {"heldout",           required_argument, 0, 'F', "held-out corpus, whose loss is evaluated during training"},
+    {"heldout-words",     required_argument, 0, 'G', "number of words between two held-out evaluations (default: one epoch)"},
+    {"heldout-tolerance", required_argument, 0, 'H', "stop training when the held-out loss improves by less than this (0 to disable)"},
+    {"metrics",           required_argument, 0, 'I', "write training metrics to this file (JSON lines)"},
+    {"metrics-interval",  required_argument, 0, 'J', "seconds between two metrics reports"},
+    {"scaling",           required_argument, 0, 'K', "benchmark mode: train with 1, 2, 4... up to arg threads, and report the thread scaling"},
     {0, 0, 0, 0, 0}
 };
 
@@ -40,7 +72,7 @@ void print_usage() {
         if (it->name == 0) continue;
         string name(it->name);
         if (it->has_arg == required_argument) name += " arg";
-        std::cout << std::setw(26) << std::left << "  --" + name << " " << it->desc << std::endl;
+        std::cout << std::setw(30) << std::left << "  --" + name << " " << it->desc << std::endl;
     }
     std::cout << std::endl;
 }
@@ -53,6 +85,7 @@ int main(int argc, char **argv) {
     }
 
     string load_file;
+    bool query_only = false;
 
     // first pass on parameters to find out if a model file is provided
     while (1) {
@@ -62,6 +95,7 @@ int main(int argc, char **argv) {
 
         switch (opt) {
             case 'o': load_file = string(optarg);           break;
+            case 'M': query_only = true;                    break;
             default:                                        break;
         }
     }
@@ -71,16 +105,29 @@ int main(int argc, char **argv) {
 
     // model file needs to be loaded before anything else (otherwise it overwrites the parameters)
     if (!load_file.empty()) {
-        model.load(load_file);
+        model.load(load_file, query_only);
     }
 
     int saving_policy = 0;
     string train_file;
     string save_file;
+    string save_flat;
+    string save_int8;
+    string save_fp16;
+    string save_pq;
+    PQConfig pq_config;
+    bool build_index = false;
+    string save_index;
+    HNSWConfig index_config;
     string save_vectors;
     string save_sent_vectors;
     string save_vectors_bin;
+    string save_sent_vectors_bin;
     string online_train_file;
+    int scaling_threads = 0;
+    string import_file;
+    bool import_binary = false;
+    long long import_max_vocab = 0;
 
     optind = 0;  // necessary to parse arguments twice
     while (1) {
@@ -111,12 +158,50 @@ int main(int argc, char **argv) {
             case 'r': save_sent_vectors = string(optarg);   break;
             case 's': save_vectors_bin = string(optarg);    break;
             case 't': online_train_file = string(optarg);   break;
+            case 'u': config.dbow = true;                   break;
+            case 'w': config.dbow_words = true;             break;
+            case 'x': save_sent_vectors_bin = string(optarg); break;
+            case 'y': config.online_tolerance = atof(optarg); break;
+            case 'z': config.sent_weights_file = string(optarg); break;
+            case 'A': config.cluster_address = string(optarg); break;
+            case 'B': config.cluster_rank = atoi(optarg);   break;
+            case 'C': config.cluster_size = atoi(optarg);   break;
+            case 'D': config.sync_words = atoll(optarg);    break;
+            case 'E': config.adagrad = true;                break;
+            case 'F': config.heldout_file = string(optarg); break;
+            case 'G': config.heldout_words = atoll(optarg); break;
+            case 'H': config.heldout_tolerance = atof(optarg); break;
+            case 'I': config.metrics_file = string(optarg); break;
+            case 'J': config.metrics_interval = atof(optarg); break;
+            case 'K':
+                scaling_threads = atoi(optarg);
+                if (scaling_threads < 1) throw runtime_error("invalid argument --scaling " + string(optarg));
+                break;
+            case 'L': save_flat = string(optarg);           break;
+            case 'M':                                       break;
+            case 'N': import_file = string(optarg);         break;
+            case 'O': import_file = string(optarg); import_binary = true; break;
+            case 'P': import_max_vocab = atoll(optarg);     break;
+            case 'Q': save_int8 = string(optarg);           break;
+            case 'R': save_fp16 = string(optarg);           break;
+            case 'S': save_pq = string(optarg);             break;
+            case 'T': pq_config.subquantizers = atoi(optarg); break;
+            case 'U': pq_config.lists = atoi(optarg);       break;
+            case 'V': build_index = true;                   break;
+            case 'W': save_index = string(optarg);          break;
+            case 'X': index_config.links = atoi(optarg);    break;
+            case 'Y': index_config.ef_construction = atoi(optarg); break;
             default:                                        abort();
         }
     }
     // TODO: possibility to provide vocabulary file
 
-    if (load_file.empty() && train_file.empty()) {  // one of those actions is required
+    // imported vectors replace the model (after the other options, for the number of threads)
+    if (!import_file.empty()) {
+        model.importVectors(import_file, import_binary, import_max_vocab);
+    }
+
+    if (load_file.empty() && import_file.empty() && train_file.empty()) {  // one of those actions is required
         print_usage();
         return 0;
     }
@@ -124,26 +209,66 @@ int main(int argc, char **argv) {
     std::cout << "MultiVec-mono" << std::endl;
     config.print();
 
-    if (!train_file.empty()) {
-        model.train(train_file, load_file.empty());
+    if (!train_file.empty() && scaling_threads > 0) {
+        model.scalingBenchmark(train_file, scaling_threads);
+    } else if (!train_file.empty()) {
+        model.train(train_file, load_file.empty() && import_file.empty());
     }
 
     if (!online_train_file.empty()) {
-        throw runtime_error("not implemented");  // TODO
+        // online paragraph vector: the sentence vectors are not part of the model
+        if (!save_sent_vectors.empty()) {
+            model.saveOnlineSentVectors(online_train_file, save_sent_vectors);
+        }
+        if (!save_sent_vectors_bin.empty()) {
+            model.saveOnlineSentVectors(online_train_file, save_sent_vectors_bin, true);
+        }
+        if (save_sent_vectors.empty() && save_sent_vectors_bin.empty()) {
+            ifstream infile(online_train_file);
+            check_is_open(infile, online_train_file);
+            model.sentVec(infile);
+        }
+    }
+
+    // after training (which drops the index), unless it was loaded with the model
+    if ((build_index || !save_index.empty()) && !model.hasIndex()) {
+        model.buildIndex(index_config.links, index_config.ef_construction);
     }
-    
+
     // saving methods (TODO: save model periodically/when training is interrupted)
     if(!save_file.empty()) {
         model.save(save_file);
     }
+    if (!save_flat.empty()) {
+        model.saveFlat(save_flat);
+    }
+    if (!save_index.empty()) {
+        model.saveIndex(save_index);
+    }
+    if (!save_int8.empty()) {
+        model.saveQuantized(save_int8, false, saving_policy);
+    }
+    if (!save_fp16.empty()) {
+        model.saveQuantized(save_fp16, true, saving_policy);
+    }
+    if (!save_pq.empty()) {
+        pq_config.threads = config.threads;
+        pq_config.verbose = config.verbose;
+        PQIndex::build(model, save_pq, pq_config);
+    }
     if (!save_vectors.empty()) {
         model.saveVectors(save_vectors, saving_policy);
     }
     if (!save_vectors_bin.empty()) {
         model.saveVectorsBin(save_vectors_bin, saving_policy);
     }
-    if (!save_sent_vectors.empty() && config.sent_vector) {
-        model.saveSentVectors(save_sent_vectors);
+    if (online_train_file.empty() && config.sent_vector) {
+        if (!save_sent_vectors.empty()) {
+            model.saveSentVectors(save_sent_vectors);
+        }
+        if (!save_sent_vectors_bin.empty()) {
+            model.saveSentVectors(save_sent_vectors_bin, true);
+        }
     }
 
     return 0;
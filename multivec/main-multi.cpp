@@ -0,0 +1,144 @@
+#include "multilingual.hpp"
+#include <getopt.h>
+
+struct option_plus {
+    const char *name;
+    int         has_arg;
+    int        *flag;
+    int         val;
+    const char *desc;
+};
+
+static vector<option_plus> options_plus = {
+    {"help",          no_argument,       0, 'h', "print this help message"},
+    {"verbose",       no_argument,       0, 'v', "verbose mode"},
+    {"dimension",     required_argument, 0, 'a', "dimension of the word embeddings"},
+    {"min-count",     required_argument, 0, 'b', "minimum count of vocabulary words"},
+    {"window-size",   required_argument, 0, 'c', "size of the window"},
+    {"threads",       required_argument, 0, 'd', "number of threads"},
+    {"iter",          required_argument, 0, 'e', "number of training epochs"},
+    {"negative",      required_argument, 0, 'f', "number of negative samples (0 for no negative sampling)"},
+    {"alpha",         required_argument, 0, 'g', "initial learning rate"},
+    {"beta",          required_argument, 0, 'i', "bilingual training weight"},
+    {"subsampling",   required_argument, 0, 'j', "subsampling (usually between 1e-03 and 1e-05)"},
+    {"sg",            no_argument,       0, 'k', "skip-gram model (default: CBOW)"},
+    {"hs",            no_argument,       0, 'l', "hierarchical softmax (default off)"},
+    {"train",         required_argument, 0, 'm', "add a parallel corpus for training: src_lang,trg_lang,src_file,trg_file"},
+    {"load",          required_argument, 0, 'o', "load model"},
+    {"save",          required_argument, 0, 'p', "save model"},
+    {"save-lang",     required_argument, 0, 'q', "save the monolingual model of a language: lang,file"},
+    {"adagrad",       no_argument,       0, 'r', "per-row AdaGrad learning rates (converges in fewer epochs)"},
+    {0, 0, 0, 0, 0}
+};
+
+void print_usage() {
+    std::cout << "Options:" << std::endl;
+    for (auto it = options_plus.begin(); it != options_plus.end(); ++it) {
+        if (it->name == 0) continue;
+        string name(it->name);
+        if (it->has_arg == required_argument) name += " arg";
+        std::cout << std::setw(26) << std::left << "  --" + name << " " << it->desc << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+static vector<string> split_arg(const string& arg, int n) {
+    vector<string> fields;
+    istringstream iss(arg);
+    string field;
+    while (getline(iss, field, ',')) fields.push_back(field);
+
+    if (fields.size() != n) {
+        throw runtime_error("invalid argument " + arg);
+    }
+    return fields;
+}
+
+int main(int argc, char **argv) {
+
+    vector<option> options;
+    for (auto it = options_plus.begin(); it != options_plus.end(); ++it) {
+        option op = {it->name, it->has_arg, it->flag, it->val};
+        options.push_back(op);
+    }
+
+    string load_file;
+
+    // first pass on parameters to find out if a model file is provided
+    while (1) {
+        int option_index = 0;
+        int opt = getopt_long(argc, argv, "hv", options.data(), &option_index);
+        if (opt == -1) break;
+
+        switch (opt) {
+            case 'o': load_file = string(optarg);           break;
+            default:                                        break;
+        }
+    }
+
+    BilingualConfig config;
+    MultilingualModel model(&config);
+
+    // model file needs to be loaded before anything else (otherwise it overwrites the parameters)
+    if (!load_file.empty()) {
+        model.load(load_file);
+    }
+
+    vector<vector<string>> corpora;
+    string save_file;
+    vector<vector<string>> save_lang_files;
+
+    optind = 0;  // necessary to parse arguments twice
+    while (1) {
+        int option_index = 0;
+        int opt = getopt_long(argc, argv, "hv", options.data(), &option_index);
+        if (opt == -1) break;
+
+        switch (opt) {
+            case 0:                                         break;
+            case 'h': print_usage();                        return 0;
+            case 'v': config.verbose = true;                break;
+            case 'a': config.dimension = atoi(optarg);      break;
+            case 'b': config.min_count = atoi(optarg);      break;
+            case 'c': config.window_size = atoi(optarg);    break;
+            case 'd': config.threads = atoi(optarg);        break;
+            case 'e': config.iterations = atoi(optarg);     break;
+            case 'f': config.negative = atoi(optarg);       break;
+            case 'g': config.learning_rate = atof(optarg);  break;
+            case 'i': config.beta = atof(optarg);           break;
+            case 'j': config.subsampling = atof(optarg);    break;
+            case 'k': config.skip_gram = true;              break;
+            case 'l': config.hierarchical_softmax = true;   break;
+            case 'm': corpora.push_back(split_arg(optarg, 4)); break;
+            case 'o':                                       break;
+            case 'p': save_file = string(optarg);           break;
+            case 'q': save_lang_files.push_back(split_arg(optarg, 2)); break;
+            case 'r': config.adagrad = true;                break;
+            default:                                        abort();
+        }
+    }
+
+    if (load_file.empty() && corpora.empty()) {
+        print_usage();
+        return 0;
+    }
+
+    std::cout << "MultiVec-multi" << std::endl;
+    config.print();
+
+    if (!corpora.empty()) {
+        for (auto it = corpora.begin(); it != corpora.end(); ++it) {
+            model.addCorpus((*it)[0], (*it)[1], (*it)[2], (*it)[3]);
+        }
+        model.train(load_file.empty());
+    }
+
+    if (!save_file.empty()) {
+        model.save(save_file);
+    }
+    for (auto it = save_lang_files.begin(); it != save_lang_files.end(); ++it) {
+        model.model((*it)[0]).save((*it)[1]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <string>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Memory-mapped file (POSIX mmap). Pages are loaded on demand and managed by the
+ * page cache, which makes it possible to work on files that are larger than the RAM.
+ * Writable mappings are shared: modifications go directly to the file.
+ */
+class MappedFile {
+    int fd;
+    char* _data;
+    size_t _size;
+    bool _writable;
+
+    void map(const std::string& filename) {
+        if (_size == 0) return;  // mmap doesn't accept empty mappings
+
+        int prot = _writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void* addr = mmap(NULL, _size, prot, MAP_SHARED, fd, 0);
+
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            fd = -1;
+            throw std::runtime_error("couldn't map file " + filename);
+        }
+
+        _data = static_cast<char*>(addr);
+    }
+
+public:
+    MappedFile() : fd(-1), _data(0), _size(0), _writable(false) {}
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Map an existing file in memory (read-only by default).
+     */
+    void open(const std::string& filename, bool writable = false) {
+        close();
+        _writable = writable;
+        fd = ::open(filename.c_str(), writable ? O_RDWR : O_RDONLY);
+
+        struct stat st;
+        if (fd == -1 || fstat(fd, &st) == -1) {
+            throw std::runtime_error("couldn't open file " + filename);
+        }
+
+        _size = st.st_size;
+        map(filename);
+    }
+
+    /**
+     * @brief Create (or truncate) a file of given size, and map it in memory for writing.
+     */
+    void create(const std::string& filename, size_t size) {
+        close();
+        _writable = true;
+        fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+        if (fd == -1) {
+            throw std::runtime_error("couldn't open file " + filename);
+        }
+        if (ftruncate(fd, size) == -1) {
+            throw std::runtime_error("couldn't resize file " + filename);
+        }
+
+        _size = size;
+        map(filename);
+    }
+
+    /**
+     * @brief Hint that the file will be read sequentially (aggressive read-ahead).
+     */
+    void adviseSequential() {
+        if (_data) madvise(_data, _size, MADV_SEQUENTIAL);
+    }
+
+    /**
+     * @brief Write modified pages back to disk.
+     */
+    void sync() {
+        if (_data && _writable) msync(_data, _size, MS_SYNC);
+    }
+
+    void close() {
+        if (_data) munmap(_data, _size);
+        if (fd != -1) ::close(fd);
+        fd = -1;
+        _data = 0;
+        _size = 0;
+    }
+
+    bool isOpen() const { return fd != -1; }
+    size_t size() const { return _size; }
+    char* data() { return _data; }
+    const char* data() const { return _data; }
+};
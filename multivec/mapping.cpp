@@ -0,0 +1,155 @@
+#include "mapping.hpp"
+
+CrossLingualMapper::CrossLingualMapper(const MonolingualModel& src_model, const MonolingualModel& trg_model,
+                                       int threads, bool verbose) :
+    src_model(src_model), trg_model(trg_model), threads(threads), verbose(verbose),
+    src(src_model.input_weights, vector<int>()), trg(trg_model.input_weights, vector<int>()) {
+    if (src.cols() != trg.cols()) {
+        throw runtime_error("models must have the same dimension");
+    }
+
+    src.normalizeRows();
+    trg.normalizeRows();
+    transform = Matrix::identity(src.cols());
+}
+
+vector<int> CrossLingualMapper::frequentWords(const MonolingualModel& model, int n) {
+    vector<pair<int, int>> words; // (count, index)
+    for (auto it = model.vocabulary.begin(); it != model.vocabulary.end(); ++it) {
+        words.push_back({it->second.count, it->second.index});
+    }
+
+    n = std::min(n, static_cast<int>(words.size()));
+    std::partial_sort(words.begin(), words.begin() + n, words.end(), std::greater<pair<int, int>>());
+
+    vector<int> indices;
+    for (int i = 0; i < n; ++i) indices.push_back(words[i].second);
+    return indices;
+}
+
+CrossLingualMapper::Dictionary CrossLingualMapper::readDictionary(const string& filename) const {
+    ifstream infile(filename);
+    check_is_open(infile, filename);
+
+    Dictionary dictionary;
+    string line;
+    while (getline(infile, line)) {
+        auto words = split(line);
+        if (words.size() < 2) continue;
+
+        auto it1 = src_model.vocabulary.find(words[0]);
+        auto it2 = trg_model.vocabulary.find(words[1]);
+        if (it1 != src_model.vocabulary.end() && it2 != trg_model.vocabulary.end()) {
+            dictionary.push_back({it1->second.index, it2->second.index});
+        }
+    }
+
+    if (verbose)
+        std::cout << "Dictionary size: " << dictionary.size() << std::endl;
+
+    return dictionary;
+}
+
+CrossLingualMapper::Dictionary CrossLingualMapper::identicalWords() const {
+    Dictionary dictionary;
+    for (auto it = src_model.vocabulary.begin(); it != src_model.vocabulary.end(); ++it) {
+        auto it2 = trg_model.vocabulary.find(it->first);
+        if (it2 != trg_model.vocabulary.end()) {
+            dictionary.push_back({it->second.index, it2->second.index});
+        }
+    }
+
+    if (verbose)
+        std::cout << "Identical words: " << dictionary.size() << std::endl;
+
+    return dictionary;
+}
+
+float CrossLingualMapper::fit(const Dictionary& dictionary) {
+    if (dictionary.empty()) {
+        throw runtime_error("empty dictionary");
+    }
+
+    int d = src.cols();
+    Matrix x(dictionary.size(), d);
+    Matrix z(dictionary.size(), d);
+    for (int i = 0; i < dictionary.size(); ++i) {
+        std::copy(src.row(dictionary[i].first), src.row(dictionary[i].first) + d, x.row(i));
+        std::copy(trg.row(dictionary[i].second), trg.row(dictionary[i].second) + d, z.row(i));
+    }
+
+    // orthogonal Procrustes
+    Matrix u, v;
+    vector<float> s;
+    svd(transposeMultiply(x, z, threads), u, s, v, threads);
+    transform = multiply(u, v.transpose(), threads);
+
+    // mean similarity of the dictionary pairs in the mapped space
+    Matrix mapped = multiply(x, transform, threads);
+    double similarity = 0;
+    for (int i = 0; i < mapped.rows(); ++i) similarity += dot(mapped.row(i), z.row(i), d);
+    return similarity / mapped.rows();
+}
+
+void CrossLingualMapper::selfLearning(Dictionary dictionary, int iterations, int max_vocab) {
+    // the dictionary is induced from the most frequent words
+    vector<int> src_words = frequentWords(src_model, max_vocab);
+    vector<int> trg_words = frequentWords(trg_model, max_vocab);
+    Matrix src_frequent(src_model.input_weights, src_words);
+    Matrix trg_frequent(trg_model.input_weights, trg_words);
+    src_frequent.normalizeRows();
+    trg_frequent.normalizeRows();
+
+    float objective = -1;
+
+    for (int k = 0; k < iterations; ++k) {
+        float similarity = fit(dictionary);
+        Matrix mapped = multiply(src_frequent, transform, threads);
+
+        // nearest neighbors in both directions
+        vector<int> forward, backward;
+        vector<float> forward_scores, backward_scores;
+        nearestNeighbors(mapped, trg_frequent, forward, forward_scores, threads);
+        nearestNeighbors(trg_frequent, mapped, backward, backward_scores, threads);
+
+        dictionary.clear();
+        double new_objective = 0;
+        for (int i = 0; i < forward.size(); ++i) {
+            dictionary.push_back({src_words[i], trg_words[forward[i]]});
+            new_objective += forward_scores[i];
+        }
+        for (int j = 0; j < backward.size(); ++j) {
+            if (forward[backward[j]] != j) { // not already in the dictionary
+                dictionary.push_back({src_words[backward[j]], trg_words[j]});
+            }
+            new_objective += backward_scores[j];
+        }
+        new_objective /= forward.size() + backward.size();
+
+        if (verbose)
+            std::cout << "Self-learning iteration " << k + 1 << ", dictionary similarity: " << similarity
+                      << ", nearest neighbor similarity: " << new_objective << std::endl;
+
+        if (new_objective - objective < 1e-06) break;
+        objective = new_objective;
+    }
+
+    fit(dictionary);
+}
+
+void CrossLingualMapper::apply(MonolingualModel& model) const {
+    int d = transform.rows();
+    mat* params[] = {&model.input_weights, &model.output_weights, &model.output_weights_hs, &model.sent_weights};
+    model.clearIndex(); // the rows are replaced
+
+    for (int k = 0; k < 4; ++k) {
+        mat* weights = params[k];
+        if (weights->empty()) continue;
+        if (weights->front().size() != d) throw runtime_error("wrong dimension");
+
+        Matrix mapped = multiply(Matrix(*weights, vector<int>()), transform, threads);
+        for (int i = 0; i < mapped.rows(); ++i) {
+            (*weights)[i] = vec(mapped.row(i), mapped.row(i) + d);
+        }
+    }
+}
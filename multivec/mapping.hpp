@@ -0,0 +1,46 @@
+#pragma once
+#include "monolingual.hpp"
+#include "linalg.hpp"
+
+/**
+ * @brief Maps the embeddings of a monolingual model into the space of another monolingual model
+ * (trained independently), to obtain bilingual embeddings without joint training.
+ *
+ * The mapping is an orthogonal transformation W, which minimizes the distance between the mapped
+ * source vectors and the target vectors of a seed dictionary (orthogonal Procrustes: W = U V^T,
+ * where U S V^T is the SVD of X^T Z). With self-learning, the dictionary is then induced again from
+ * the nearest neighbors of the most frequent words in the mapped space, and W is estimated again,
+ * until convergence.
+ *
+ * Because W is orthogonal, dot products between the weights of the source model are unchanged,
+ * so the mapped model can still be used (and trained) as before.
+ */
+class CrossLingualMapper {
+public:
+    typedef vector<pair<int, int>> Dictionary; // pairs of word indices (source, target)
+
+private:
+    const MonolingualModel& src_model;
+    const MonolingualModel& trg_model;
+    int threads;
+    bool verbose;
+
+    Matrix src; // normalized input weights
+    Matrix trg;
+    Matrix transform;
+
+    static vector<int> frequentWords(const MonolingualModel& model, int n); // indices of the n most frequent words
+
+public:
+    CrossLingualMapper(const MonolingualModel& src_model, const MonolingualModel& trg_model, int threads = 4,
+                       bool verbose = false);
+
+    Dictionary readDictionary(const string& filename) const; // one pair of words per line
+    Dictionary identicalWords() const; // words that are in both vocabularies (e.g. numbers, names)
+
+    float fit(const Dictionary& dictionary); // returns the mean cosine similarity of the mapped dictionary
+    void selfLearning(Dictionary dictionary, int iterations = 10, int max_vocab = 20000);
+
+    const Matrix& getTransform() const { return transform; }
+    void apply(MonolingualModel& model) const; // maps all the weights of a model
+};
@@ -0,0 +1,78 @@
+#include "metrics.hpp"
+
+MetricsReporter::MetricsReporter(int n_threads, const string& filename, const MetricsCallback& callback,
+                                 float interval) :
+    threads(n_threads), previous(n_threads), start(high_resolution_clock::now()), last(start),
+    callback(callback), interval(interval) {
+    if (!filename.empty()) {
+        outfile.open(filename);
+        check_is_open(outfile, filename);
+    }
+}
+
+void MetricsReporter::report(float alpha, float progress) {
+    high_resolution_clock::time_point now = high_resolution_clock::now();
+    double elapsed = duration_cast<duration<double>>(now - last).count();
+    double total_time = duration_cast<duration<double>>(now - start).count();
+    last = now;
+    if (elapsed <= 0) elapsed = 1e-06;
+
+    ostringstream threads_json;
+    long long total_words = 0;
+    double total_loss = 0;
+
+    for (int i = 0; i < threads.size(); ++i) {
+        ThreadSnapshot current = threads[i].snapshot(); // while the training thread is running
+        long long words = current.words - previous[i].words;
+        long long sentences = current.sentences - previous[i].sentences;
+        double loss = current.loss - previous[i].loss;
+        previous[i] = current;
+
+        total_words += words;
+        total_loss += loss;
+
+        threads_json << (i > 0 ? ", " : "")
+            << "{\"id\": " << i
+            << ", \"words\": " << current.words
+            << ", \"words_per_sec\": " << words / elapsed
+            << ", \"sentences_per_sec\": " << sentences / elapsed
+            << ", \"loss\": " << (words > 0 ? loss / words : 0)
+            << ", \"io_time\": " << current.io_time
+            << ", \"nodes_time\": " << current.nodes_time
+            << ", \"train_time\": " << current.train_time << "}";
+    }
+
+    ostringstream json;
+    json << "{\"time\": " << total_time
+         << ", \"alpha\": " << alpha
+         << ", \"progress\": " << progress
+         << ", \"words_per_sec\": " << total_words / elapsed
+         << ", \"loss\": " << (total_words > 0 ? total_loss / total_words : 0)
+         << ", \"threads\": [" << threads_json.str() << "]}";
+
+    last_report = json.str();
+
+    if (outfile.is_open())
+        outfile << last_report << std::endl;
+    if (callback)
+        callback(last_report);
+}
+
+void MetricsReporter::run(const std::atomic<float>& alpha, const std::atomic<long long>& words_processed,
+                          long long total_words, const std::atomic<bool>& training_done) {
+    // fraction of the training words, which is less than 1 at the end if training was stopped early
+    auto progress = [&]() {
+        if (total_words <= 0) return 0.0f;
+        return std::min(1.0f, static_cast<float>(words_processed.load(std::memory_order_relaxed)) / total_words);
+    };
+
+    while (!training_done) {
+        std::this_thread::sleep_for(milliseconds(10));
+
+        if (duration_cast<duration<double>>(high_resolution_clock::now() - last).count() >= interval) {
+            report(alpha.load(std::memory_order_relaxed), progress());
+        }
+    }
+
+    report(alpha.load(std::memory_order_relaxed), progress()); // last report, at the end of training
+}
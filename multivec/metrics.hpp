@@ -0,0 +1,99 @@
+#pragma once
+#include "utils.hpp"
+
+/**
+ * @brief Values of the counters of a training thread at some point (see ThreadMetrics::snapshot).
+ */
+struct ThreadSnapshot {
+    long long words;
+    long long sentences;
+    double loss;
+    double io_time;
+    double nodes_time;
+    double train_time;
+
+    ThreadSnapshot() : words(0), sentences(0), loss(0), io_time(0), nodes_time(0), train_time(0) {}
+};
+
+/**
+ * @brief Counters of a training thread. They are only updated by this thread, and read
+ * asynchronously by the reporting thread: each counter is atomic (relaxed loads and stores, as
+ * there is a single writer), but a snapshot may mix values from two consecutive sentences.
+ */
+struct ThreadMetrics {
+    std::atomic<long long> words;
+    std::atomic<long long> sentences;
+    std::atomic<double> loss; // sum of the training loss (only computed when metrics are enabled)
+    std::atomic<double> io_time; // time spent reading the training data (seconds)
+    std::atomic<double> nodes_time; // time spent converting sentences to vocabulary nodes (getNodes)
+    std::atomic<double> train_time; // time spent in the updates
+    high_resolution_clock::time_point last; // end of the last measured interval (only used by the training thread)
+
+    ThreadMetrics() : words(0), sentences(0), loss(0), io_time(0), nodes_time(0), train_time(0),
+        last(high_resolution_clock::now()) {}
+
+    template<typename T>
+    static void add(std::atomic<T>& counter, T value) { // by the only writer of `counter`
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    // adds the time elapsed since the last call to `time`
+    void lap(std::atomic<double>& time) {
+        high_resolution_clock::time_point now = high_resolution_clock::now();
+        add(time, duration_cast<duration<double>>(now - last).count());
+        last = now;
+    }
+
+    void addSentence(long long sentence_words, double sentence_loss) {
+        add(words, sentence_words);
+        add(sentences, 1LL);
+        add(loss, sentence_loss);
+    }
+
+    ThreadSnapshot snapshot() const {
+        ThreadSnapshot res;
+        res.words = words.load(std::memory_order_relaxed);
+        res.sentences = sentences.load(std::memory_order_relaxed);
+        res.loss = loss.load(std::memory_order_relaxed);
+        res.io_time = io_time.load(std::memory_order_relaxed);
+        res.nodes_time = nodes_time.load(std::memory_order_relaxed);
+        res.train_time = train_time.load(std::memory_order_relaxed);
+        return res;
+    }
+};
+
+typedef std::function<void(const string&)> MetricsCallback; // called with each report (one JSON object)
+
+/**
+ * @brief Periodic reports of the training metrics, as JSON lines:
+ *
+ *   {"time": 10.0, "alpha": 0.045, "progress": 0.1, "words_per_sec": 1.2e+06, "loss": 2.3, "threads": [
+ *     {"id": 0, "words": 1000000, "words_per_sec": 300000, "sentences_per_sec": 12000, "loss": 2.3,
+ *      "io_time": 0.1, "nodes_time": 0.4, "train_time": 9.5}, ...]}
+ *
+ * Rates and losses (mean loss per word) are measured since the previous report, while times are
+ * cumulative. A thread whose rate drops to zero is stalled.
+ */
+class MetricsReporter {
+    vector<ThreadMetrics> threads;
+    vector<ThreadSnapshot> previous; // values at the previous report
+    high_resolution_clock::time_point start;
+    high_resolution_clock::time_point last;
+
+    ofstream outfile;
+    MetricsCallback callback;
+    float interval; // seconds between two reports
+    string last_report;
+
+public:
+    MetricsReporter(int n_threads, const string& filename, const MetricsCallback& callback, float interval);
+
+    ThreadMetrics& threadMetrics(int thread_id) { return threads[thread_id]; }
+
+    void report(float alpha, float progress); // writes one JSON line, and calls the callback
+    const string& lastReport() const { return last_report; }
+
+    // reports every `interval` seconds until the end of training (run in a separate thread)
+    void run(const std::atomic<float>& alpha, const std::atomic<long long>& words_processed, long long total_words,
+             const std::atomic<bool>& training_done);
+};
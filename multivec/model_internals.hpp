@@ -0,0 +1,30 @@
+#pragma once
+#include "monolingual.hpp"
+
+/**
+ * @brief Access to the training internals of MonolingualModel, for the microbenchmarks
+ * (benchmarks/microbench). Not installed: this isn't part of the API of the library.
+ */
+class ModelInternals {
+public:
+    static void initVocab(MonolingualModel& model, const vector<pair<string, int>>& words) { model.initVocab(words); }
+    static void initNet(MonolingualModel& model) { model.initNet(); }
+
+    static mat& inputWeights(MonolingualModel& model) { return model.input_weights; }
+    static mat& outputWeights(MonolingualModel& model) { return model.output_weights; }
+    static mat& outputWeightsHS(MonolingualModel& model) { return model.output_weights_hs; }
+
+    static HuffmanNode* getRandomHuffmanNode(MonolingualModel& model) { return model.getRandomHuffmanNode(); }
+    static vector<HuffmanNode> getNodes(const MonolingualModel& model, const string& sentence) {
+        return model.getNodes(sentence);
+    }
+
+    static vec negSamplingUpdate(MonolingualModel& model, const HuffmanNode& node, const vec& hidden, float alpha,
+                                 bool update) {
+        return model.negSamplingUpdate(node, hidden, alpha, update);
+    }
+    static vec hierarchicalUpdate(MonolingualModel& model, const HuffmanNode& node, const vec& hidden, float alpha,
+                                  bool update) {
+        return model.hierarchicalUpdate(node, hidden, alpha, update);
+    }
+};
@@ -1,5 +1,8 @@
 #include "monolingual.hpp"
 #include "serialization.hpp"
+#include "cluster.hpp"
+#include "linalg.hpp"
+#include "flat_model.hpp"
 
 const HuffmanNode HuffmanNode::UNK;
 
@@ -26,20 +29,30 @@ void MonolingualModel::reduceVocab() {
 }
 
 void MonolingualModel::readVocab(const string& training_file) {
-    ifstream infile(training_file);
-
-    try {
-        check_is_open(infile, training_file);
-        check_is_non_empty(infile, training_file);
-    } catch (...) {
-        throw;
-    }
+    readVocab(vector<string>(1, training_file));
+}
 
+/**
+ * @brief Create vocabulary from several training files (e.g. the same language in several
+ * parallel corpora).
+ */
+void MonolingualModel::readVocab(const vector<string>& training_files) {
     vocabulary.clear();
 
-    string word;
-    while (infile >> word) {
-        addWordToVocab(word);
+    for (auto it = training_files.begin(); it != training_files.end(); ++it) {
+        ifstream infile(*it);
+
+        try {
+            check_is_open(infile, *it);
+            check_is_non_empty(infile, *it);
+        } catch (...) {
+            throw;
+        }
+
+        string word;
+        while (infile >> word) {
+            addWordToVocab(word);
+        }
     }
 
     if (config->verbose)
@@ -54,6 +67,29 @@ void MonolingualModel::readVocab(const string& training_file) {
     initUnigramTable();
 }
 
+void MonolingualModel::initVocab(const vector<pair<string, int>>& words) {
+    vocabulary.clear();
+
+    for (int i = 0; i < words.size(); ++i) {
+        HuffmanNode node(i, words[i].first);
+        node.count = words[i].second;
+        vocabulary.insert({node.word, node});
+    }
+
+    if (config->verbose)
+        std::cout << "Vocabulary size: " << vocabulary.size() << std::endl;
+
+    createBinaryTree();
+    initUnigramTable();
+}
+
+void MonolingualModel::indexVocab() {
+    index_table.assign(vocabulary.size(), 0);
+    for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
+        index_table[it->second.index] = &it->second;
+    }
+}
+
 void MonolingualModel::createBinaryTree() {
     vector<HuffmanNode*> heap;
     vector<HuffmanNode> parent_nodes;
@@ -98,6 +134,19 @@ void MonolingualModel::assignCodes(HuffmanNode* node, vector<int> code, vector<i
     }
 }
 
+void MonolingualModel::initTraining() {
+    if (!deferred_file.empty()) {
+        Config copy = *config; // the configuration may have been changed since loading
+        load(string(deferred_file));
+        *config = copy;
+    } else if (unigram_table.empty() && !vocabulary.empty()) {
+        initUnigramTable();
+    }
+
+    if (!input_weights.empty() && output_weights.empty() && output_weights_hs.empty())
+        throw runtime_error("the model has no output weights (imported vectors)");
+}
+
 void MonolingualModel::initUnigramTable() {
     unigram_table.clear();
     vocab_word_count = 0;
@@ -119,8 +168,8 @@ void MonolingualModel::initUnigramTable() {
     }
 }
 
-HuffmanNode* MonolingualModel::getRandomHuffmanNode() {
-    auto index = multivec::rand() % unigram_table.size();
+HuffmanNode* MonolingualModel::getRandomHuffmanNode(unsigned long long* random_state) {
+    auto index = (random_state ? multivec::rand(*random_state) : multivec::rand()) % unigram_table.size();
     return unigram_table[index];
 }
 
@@ -140,8 +189,79 @@ void MonolingualModel::initNet() {
     output_weights = mat(v, vec(d));
 }
 
+/**
+ * @brief Reset the AdaGrad accumulators (one float per row, so that they are as cheap
+ * as the weights themselves to update without locks).
+ */
+void MonolingualModel::initAdaGrad() {
+    if (!config->adagrad) return;
+    input_sq_grads.assign(input_weights.size(), 0);
+    output_sq_grads.assign(output_weights.size(), 0);
+    output_hs_sq_grads.assign(output_weights_hs.size(), 0);
+}
+
+/**
+ * Disk-backed sentence vectors (config->sent_weights_file): a 64-byte header, followed by the
+ * sentence vectors as a row-major float32 matrix. Those files can be memory-mapped, or read
+ * sequentially.
+ */
+struct SentWeightsHeader {
+    char magic[8];
+    long long rows;
+    long long dimension;
+    char padding[40];
+};
+
+static const char SENT_WEIGHTS_MAGIC[8] = {'M', 'V', 'S', 'E', 'N', 'T', '0', '1'};
+
+static float* sentWeightsData(MappedFile& file) {
+    return reinterpret_cast<float*>(file.data() + sizeof(SentWeightsHeader));
+}
+
+/**
+ * @brief Map an existing sentence vectors file, and check that its header is consistent.
+ * @return number of sentence vectors in the file
+ */
+static long long openSentWeights(MappedFile& file, const string& filename, int dimension, bool writable = false) {
+    file.open(filename, writable);
+    const SentWeightsHeader* header = reinterpret_cast<const SentWeightsHeader*>(file.data());
+
+    if (file.size() < sizeof(SentWeightsHeader) || !equal(SENT_WEIGHTS_MAGIC, SENT_WEIGHTS_MAGIC + 8, header->magic)) {
+        throw runtime_error("invalid sentence vectors file " + filename);
+    }
+    if (header->dimension != dimension ||
+        file.size() < sizeof(SentWeightsHeader) + header->rows * dimension * sizeof(float)) {
+        throw runtime_error("sentence vectors file " + filename + " doesn't match the model");
+    }
+
+    return header->rows;
+}
+
 void MonolingualModel::initSentWeights() {
     int d = config->dimension;
+
+    if (!config->sent_weights_file.empty()) {
+        // disk-backed sentence vectors, which are not saved with the model
+        sent_weights.clear();
+        sent_weights_map.create(config->sent_weights_file,
+            sizeof(SentWeightsHeader) + training_lines * d * sizeof(float));
+
+        SentWeightsHeader header = SentWeightsHeader();
+        copy(SENT_WEIGHTS_MAGIC, SENT_WEIGHTS_MAGIC + 8, header.magic);
+        header.rows = training_lines;
+        header.dimension = d;
+        *reinterpret_cast<SentWeightsHeader*>(sent_weights_map.data()) = header;
+
+        float* data = sentWeightsData(sent_weights_map);
+        for (long long i = 0; i < training_lines * d; ++i) {
+            data[i] = (multivec::randf() - 0.5f) / d;
+        }
+
+        sent_weights_map.adviseSequential(); // each thread reads its chunk sequentially
+        return;
+    }
+
+    sent_weights_map.close();
     sent_weights = mat(training_lines, vec(d));
 
     for (size_t row = 0; row < training_lines; ++row) {
@@ -151,7 +271,27 @@ void MonolingualModel::initSentWeights() {
     }
 }
 
+vec MonolingualModel::getSentWeights(long long sent_id) const {
+    if (sent_weights_map.isOpen()) {
+        int d = config->dimension;
+        const float* row = reinterpret_cast<const float*>(sent_weights_map.data() + sizeof(SentWeightsHeader)) + sent_id * d;
+        return vec(row, row + d);
+    } else {
+        return sent_weights[sent_id];
+    }
+}
+
+void MonolingualModel::setSentWeights(long long sent_id, const vec& sent_vec) {
+    if (sent_weights_map.isOpen()) {
+        copy(sent_vec.data(), sent_vec.data() + sent_vec.size(),
+             sentWeightsData(sent_weights_map) + sent_id * config->dimension);
+    } else {
+        sent_weights[sent_id] = sent_vec;
+    }
+}
+
 vector<HuffmanNode> MonolingualModel::getNodes(const string& sentence) const {
+    PROFILE_SCOPE("MonolingualModel::getNodes");
     vector<HuffmanNode> nodes;
     istringstream iss(sentence);
     string word;
@@ -170,11 +310,24 @@ vector<HuffmanNode> MonolingualModel::getNodes(const string& sentence) const {
     return nodes;
 }
 
+vector<HuffmanNode> MonolingualModel::getNodes(const int* indices, int length) const {
+    PROFILE_SCOPE("MonolingualModel::getNodes");
+    vector<HuffmanNode> nodes;
+    nodes.reserve(length);
+
+    for (int i = 0; i < length; ++i) {
+        nodes.push_back(indices[i] == -1 ? HuffmanNode::UNK : *index_table[indices[i]]);
+    }
+
+    return nodes;
+}
+
 /**
  * @brief Discard random nodes according to their frequency. The more frequent a word is, the more
  * likely it is to be discarded. Discarded nodes are replaced by UNK token.
  */
 void MonolingualModel::subsample(vector<HuffmanNode>& nodes) const {
+    PROFILE_SCOPE("MonolingualModel::subsample");
     for (auto it = nodes.begin(); it != nodes.end(); ++it) {
         auto node = *it;
         float f = static_cast<float>(node.count) / vocab_word_count; // frequency of this word
@@ -186,58 +339,157 @@ void MonolingualModel::subsample(vector<HuffmanNode>& nodes) const {
     }
 }
 
-void MonolingualModel::saveVectorsBin(const string &filename, int policy) const {
-    if (config->verbose)
-        std::cout << "Saving embeddings in binary format to " << filename << std::endl;
+/**
+ * @brief Write `rows` rows to `output` in order. Batches of rows are formatted in parallel by
+ * `n_threads` threads (`format(i, buffer)` appends row i to the buffer of its thread), then each
+ * buffer is written with a single call.
+ */
+static void parallelWrite(ostream& output, long long rows, int n_threads,
+                          const std::function<void(long long, string&)>& format) {
+    const long long batch_size = 4096; // rows per thread and per write
+    n_threads = max(n_threads, 1);
+    vector<string> buffers(n_threads);
+
+    for (long long start = 0; start < rows; start += batch_size * n_threads) {
+        parallelFor(n_threads, n_threads, [&](long long begin, long long end) {
+            for (long long thread_id = begin; thread_id < end; ++thread_id) {
+                string& buffer = buffers[thread_id];
+                buffer.clear();
+                long long first = start + thread_id * batch_size;
+                long long last = std::min(rows, first + batch_size);
+                for (long long i = first; i < last; ++i) {
+                    format(i, buffer);
+                }
+            }
+        });
 
-    ofstream outfile(filename, ios::binary | ios::out);
+        for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+            output.write(it->data(), it->size());
+        }
+    }
+}
 
-    try {
-        check_is_open(outfile, filename);
-    } catch (...) {
-        throw;
+// same text format as `ostream << float` (6 significant digits), each value followed by a space
+static void appendText(string& buffer, const float* data, int size) {
+    char number[32];
+    for (int c = 0; c < size; ++c) {
+        int n = snprintf(number, sizeof(number), "%g ", data[c]);
+        buffer.append(number, n);
     }
+}
 
-    outfile << vocabulary.size() << " " << config->dimension << endl;
+static void appendBinary(string& buffer, const float* data, int size) {
+    buffer.append(reinterpret_cast<const char*>(data), sizeof(float) * size);
+}
 
-    for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
-        string word = string(it->second.word);
-        word.push_back(' ');
-        vec embedding = wordVec(it->second.index, policy);
+int MonolingualModel::wordVecSize(int policy) const {
+    return policy == 1 && config->negative > 0 ? 2 * config->dimension : config->dimension;
+}
 
-        outfile.write(word.c_str(), word.size());
-        outfile.write(reinterpret_cast<const char*>(embedding.data()), sizeof(float) * config->dimension);
-        outfile << endl;
-    }
+/**
+ * @brief Same as wordVec, but returns a pointer to the weights when possible instead of a copy
+ * (policies 0 and 3). Otherwise, the vector is computed in `buffer` (of size wordVecSize(policy)).
+ * It doesn't throw (it is called by worker threads): the caller checks the policy with checkPolicy.
+ */
+void MonolingualModel::checkPolicy(int policy) const {
+    if (policy != 0 && config->negative > 0 && output_weights.empty())
+        throw runtime_error("output weights are not loaded (query-only mode)");
 }
 
-void MonolingualModel::saveVectors(const string &filename, int policy) const {
-    if (config->verbose)
-        std::cout << "Saving embeddings in text format to " << filename << std::endl;
+const float* MonolingualModel::wordVecData(int index, int policy, float* buffer) const {
+    int d = config->dimension;
+    if (policy == 1 && config->negative > 0) {
+        std::copy(input_weights[index].data(), input_weights[index].data() + d, buffer);
+        std::copy(output_weights[index].data(), output_weights[index].data() + d, buffer + d);
+        return buffer;
+    } else if (policy == 2 && config->negative > 0) {
+        for (int c = 0; c < d; ++c) buffer[c] = input_weights[index][c] + output_weights[index][c];
+        return buffer;
+    } else if (policy == 3 && config->negative > 0) {
+        return output_weights[index].data();
+    } else {
+        return input_weights[index].data();
+    }
+}
 
+/**
+ * @brief Save the word embeddings in the word2vec text (`binary` false) or binary format,
+ * formatted in parallel with config->threads threads.
+ */
+void MonolingualModel::exportVectors(const string& filename, int policy, bool binary) const {
+    checkPolicy(policy); // before the threads, where exceptions aren't caught
     ofstream outfile(filename, ios::binary | ios::out);
+    check_is_open(outfile, filename);
 
-    try {
-        check_is_open(outfile, filename);
-    } catch (...) {
-        throw;
+    vector<const HuffmanNode*> nodes;
+    nodes.reserve(vocabulary.size());
+    for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
+        nodes.push_back(&it->second);
     }
 
-    outfile << vocabulary.size() << " " << config->dimension << endl;
+    int size = wordVecSize(policy);
+    outfile << nodes.size() << " " << size << '\n';
 
-    for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
-        outfile << it->second.word << " ";
-        vec embedding = wordVec(it->second.index, policy);
-        for (int c = 0; c < config->dimension; ++c) {
-            outfile << embedding[c] << " ";
+    parallelWrite(outfile, nodes.size(), config->threads, [&](long long i, string& buffer) {
+        thread_local vector<float> row; // for the policies that need a copy
+        row.resize(size);
+        const float* data = wordVecData(nodes[i]->index, policy, row.data());
+
+        buffer.append(nodes[i]->word);
+        buffer.push_back(' ');
+        if (binary) {
+            appendBinary(buffer, data, size);
+        } else {
+            appendText(buffer, data, size);
         }
-        outfile << endl;
+        buffer.push_back('\n');
+    });
+
+    if (!outfile) {
+        throw runtime_error("couldn't write file " + filename);
     }
 }
 
-void MonolingualModel::saveSentVectors(const string &filename) const {
+void MonolingualModel::saveVectorsBin(const string &filename, int policy) const {
+    if (config->verbose)
+        std::cout << "Saving embeddings in binary format to " << filename << std::endl;
+
+    exportVectors(filename, policy, true);
+}
+
+void MonolingualModel::saveVectors(const string &filename, int policy) const {
+    if (config->verbose)
+        std::cout << "Saving embeddings in text format to " << filename << std::endl;
+
+    exportVectors(filename, policy, false);
+}
+
+/**
+ * @brief Write sentence vectors to a stream, one vector per line in text mode. In binary
+ * mode, the vectors are written as a row-major float32 matrix with no header.
+ * Rows are given by `row(i)`, and formatted in parallel.
+ */
+static void writeSentVectors(ostream& output, long long rows, int dimension, bool binary, int n_threads,
+                             const std::function<const float*(long long)>& row) {
+    parallelWrite(output, rows, n_threads, [&](long long i, string& buffer) {
+        if (binary) {
+            appendBinary(buffer, row(i), dimension);
+        } else {
+            appendText(buffer, row(i), dimension);
+            buffer.push_back('\n');
+        }
+    });
+}
+
+static void writeSentVectors(ostream& output, const mat& embeddings, bool binary, int n_threads) {
+    if (embeddings.empty()) return;
+    writeSentVectors(output, embeddings.size(), embeddings[0].size(), binary, n_threads,
+                     [&](long long i) { return embeddings[i].data(); });
+}
+
+void MonolingualModel::saveSentVectors(const string &filename, bool binary) const {
     if (config->verbose)
-        std::cout << "Saving sentence vectors in text format to " << filename << std::endl;
+        std::cout << "Saving sentence vectors in " << (binary ? "binary" : "text") << " format to " << filename << std::endl;
 
     ofstream outfile(filename, ios::binary | ios::out);
 
@@ -247,34 +499,55 @@ void MonolingualModel::saveSentVectors(const string &filename) const {
         throw;
     }
 
-    for (auto it = sent_weights.begin(); it != sent_weights.end(); ++it) {
-        vec embedding = *it;
-        for (int c = 0; c < config->dimension; ++c) {
-            outfile << embedding[c] << " ";
-        }
-        outfile << endl;
+    if (sent_weights_map.isOpen() || !config->sent_weights_file.empty()) {
+        // disk-backed sentence vectors
+        MappedFile file;
+        long long rows = openSentWeights(file, config->sent_weights_file, config->dimension);
+        file.adviseSequential();
+
+        const float* data = sentWeightsData(file);
+        int d = config->dimension;
+        writeSentVectors(outfile, rows, d, binary, config->threads, [&](long long i) { return data + i * d; });
+    } else {
+        writeSentVectors(outfile, sent_weights, binary, config->threads);
     }
 }
 
-void MonolingualModel::load(const string& filename) {
+/**
+ * @brief Load a model saved with `save` or `saveFlat`. With `query_only`, only the vocabulary and
+ * input weights are loaded (what `wordVec` with policy 0, `closest`, `similarity`, etc. need).
+ * The rest of the model (Huffman codes, output and sentence weights, unigram table) is loaded
+ * from the same file when it is first needed: by `train`, `sentVec` or `heldoutLoss`.
+ */
+void MonolingualModel::load(const string& filename, bool query_only) {
+    PROFILE_SCOPE("MonolingualModel::load");
     if (config->verbose)
-        std::cout << "Loading model" << std::endl;
+        std::cout << "Loading model" << (query_only ? " (query-only)" : "") << std::endl;
 
-    ifstream infile(filename);
-
-    try {
+    if (FlatModel::isFlat(filename)) {
+        loadFlat(filename, query_only);
+    } else {
+        ifstream infile(filename);
         check_is_open(infile, filename);
-    } catch (...) {
-        throw;
+        ::load(infile, *this, query_only);
     }
 
-    ::load(infile, *this);
-    initUnigramTable();
+    unigram_table.clear();
+    deferred_file = query_only ? filename : string();
+    if (!query_only)
+        initUnigramTable();
     if (config->verbose)
         std::cout << "Vocabulary size: " << vocabulary.size() << std::endl;
+
+    // HNSW index saved next to the model (ignored if it is older than the model)
+    hnsw.clear();
+    if (ifstream(filename + ".hnsw"))
+        loadIndex(filename + ".hnsw");
 }
 
 void MonolingualModel::save(const string& filename) const {
+    if (!deferred_file.empty())
+        throw runtime_error("can't save a model loaded in query-only mode");
     if (config->verbose)
         std::cout << "Saving model" << std::endl;
 
@@ -287,9 +560,14 @@ void MonolingualModel::save(const string& filename) const {
     }
 
     ::save(outfile, *this);
+
+    if (!hnsw.empty())
+        saveIndex(filename + ".hnsw");
 }
 
 vec MonolingualModel::wordVec(int index, int policy) const {
+    checkPolicy(policy);
+
     if (policy == 1 && config->negative > 0) // concat input and output
     {
         int d = config->dimension;
@@ -333,35 +611,94 @@ vec MonolingualModel::wordVec(const string& word, int policy) const {
     }
 }
 
-void MonolingualModel::sentVec(istream& input) {
-    string line;
-    while(getline(input, line)) {
-        vec embedding(config->dimension, 0);
+void MonolingualModel::sentVecChunk(const vector<string>& sentences, mat& embeddings, int thread_id, int n_threads) {
+    for (size_t i = thread_id; i < sentences.size(); i += n_threads) {
         try {
-            embedding = sentVec(line);
+            embeddings[i] = sentVec(sentences[i]);
         } catch (runtime_error) {
-            // in case of error (empty sentence, or all words are OOV), print a vector of zeros
-        };
+            // in case of error (empty sentence, or all words are OOV), keep a vector of zeros
+        }
+    }
+}
 
-        for (int c = 0; c < config->dimension; ++c) {
-            std::cout << embedding[c] << " ";
+/**
+ * @brief Online paragraph vector for all lines in a stream. Lines are read in batches,
+ * and each batch is shared between `config->threads` threads. The parameters of the model
+ * are frozen, so the threads don't interfere with each other. The vectors are written
+ * in the same order as the input lines (see `writeSentVectors` for the output format).
+ */
+void MonolingualModel::sentVec(istream& input, ostream& output, bool binary) {
+    initTraining(); // before the threads, which call sentVec(const string&)
+    const size_t batch_size = 10000;
+    int n_threads = max(config->threads, 1);
+    vector<string> sentences;
+
+    while (true) {
+        sentences.clear();
+        string line;
+        while (sentences.size() < batch_size && getline(input, line)) {
+            sentences.push_back(line);
         }
+
+        if (sentences.empty()) break;
+
+        mat embeddings(sentences.size(), vec(config->dimension, 0));
+
+        if (n_threads == 1) {
+            sentVecChunk(sentences, embeddings, 0, 1);
+        } else {
+            vector<thread> threads;
+
+            for (int i = 0; i < n_threads; ++i) {
+                threads.push_back(thread(&MonolingualModel::sentVecChunk, this,
+                    std::cref(sentences), std::ref(embeddings), i, n_threads));
+            }
+
+            for (auto it = threads.begin(); it != threads.end(); ++it) {
+                it->join();
+            }
+        }
+
+        writeSentVectors(output, embeddings, binary, n_threads);
+    }
+}
+
+void MonolingualModel::saveOnlineSentVectors(const string& input_file, const string& output_file, bool binary) {
+    if (config->verbose)
+        std::cout << "Saving online sentence vectors in " << (binary ? "binary" : "text") << " format to " << output_file << std::endl;
+
+    ifstream infile(input_file);
+    ofstream outfile(output_file, ios::binary | ios::out);
+
+    try {
+        check_is_open(infile, input_file);
+        check_is_open(outfile, output_file);
+    } catch (...) {
+        throw;
     }
+
+    sentVec(infile, outfile, binary);
 }
 
 /**
  * @brief Online paragraph vector on a given sentence. The parameters
  * of the model are frozen, while gradient descent is performed on this
  * single sentence. For batch paragraph vector, use the normal training
- * procedure with config->sent_vec set to true.
+ * procedure with config->sent_vec set to true. With config->dbow, the
+ * DBOW model is used (the sentence vector alone predicts each word).
+ * The learning rate decays linearly over at most config->iterations passes,
+ * and inference stops early once a pass changes the vector by less than
+ * config->online_tolerance (relative norm).
  * TODO: integrate this in the normal training procedure
  *
  * @param sentence
  * @return sent_vec
  */
 vec MonolingualModel::sentVec(const string& sentence) {
+    initTraining();
     int dimension = config->dimension;
-    float alpha = config->learning_rate;  // TODO: decreasing learning rate
+    float starting_alpha = config->learning_rate;
+    int max_iterations = config->iterations;
 
     auto nodes = getNodes(sentence);  // no subsampling here
     nodes.erase(
@@ -371,24 +708,44 @@ vec MonolingualModel::sentVec(const string& sentence) {
     if (nodes.empty())
         throw runtime_error("too short sentence, or OOV words");
 
+    int n = nodes.size();
+
+    // Cumulative sums of the context vectors. The input weights are frozen, so the sum of
+    // any context window is obtained in O(dimension), for all iterations.
+    mat context_sums;
+    if (!config->dbow) {
+        context_sums = mat(n + 1, vec(dimension, 0));
+        for (int pos = 0; pos < n; ++pos) {
+            context_sums[pos + 1] = context_sums[pos] + input_weights[nodes[pos].index];
+        }
+    }
+
     vec sent_vec(dimension, 0);
 
-    for (int k = 0; k < config->iterations; ++k) {
-        for (int word_pos = 0; word_pos < nodes.size(); ++word_pos) {
-            vec hidden(dimension, 0);
-            HuffmanNode cur_node = nodes[word_pos];
+    for (int k = 0; k < max_iterations; ++k) {
+        vec previous = sent_vec;
 
-            int this_window_size = 1 + multivec::rand() % config->window_size;
-            int count = 0;
+        for (int word_pos = 0; word_pos < n; ++word_pos) {
+            const HuffmanNode& cur_node = nodes[word_pos];
 
-            for (int pos = word_pos - this_window_size; pos <= word_pos + this_window_size; ++pos) {
-                if (pos < 0 || pos >= nodes.size() || pos == word_pos) continue;
-                hidden += input_weights[nodes[pos].index];
-                ++count;
-            }
+            // linearly decreasing learning rate (same as training)
+            float alpha = starting_alpha * (1 - static_cast<float>(k * n + word_pos) / (max_iterations * n));
+            alpha = max(alpha, starting_alpha * 0.0001f);
+
+            vec hidden;
 
-            if (count == 0) continue;
-            hidden = (hidden + sent_vec) / (count + 1); // TODO this or (hidden / count) + sent_vec?
+            if (config->dbow) { // the sentence vector is the hidden layer
+                hidden = sent_vec;
+            } else {
+                int this_window_size = 1 + multivec::rand() % config->window_size;
+                int start = max(0, word_pos - this_window_size);
+                int end = min(n, word_pos + this_window_size + 1);
+                int count = end - start - 1;
+
+                if (count == 0) continue;
+                // context words and sentence vector, without the current word
+                hidden = (context_sums[end] - context_sums[start] - input_weights[cur_node.index] + sent_vec) / (count + 1);
+            }
 
             vec error(dimension, 0);
             if (config->hierarchical_softmax) {
@@ -400,6 +757,10 @@ vec MonolingualModel::sentVec(const string& sentence) {
 
             sent_vec += error;
         }
+
+        // early stopping, when this iteration barely changed the sentence vector
+        if (vec(sent_vec - previous).norm() <= config->online_tolerance * sent_vec.norm())
+            break;
     }
 
     return sent_vec;
@@ -426,7 +787,12 @@ void MonolingualModel::train(const string& training_file, bool initialize) {
         // reads vocab and initializes unigram table
         readVocab(training_file);
         initNet();
-    } else if (vocab_word_count == 0) {
+        deferred_file.clear();
+    } else {
+        initTraining();
+    }
+
+    if (!initialize && vocab_word_count == 0) {
         // TODO: check that everything is initialized, and dimension is OK
         throw runtime_error("the model needs to be initialized before training");
     }
@@ -434,6 +800,9 @@ void MonolingualModel::train(const string& training_file, bool initialize) {
     // TODO: also serialize training state
     words_processed = 0;
     alpha = config->learning_rate;
+    stop_training = false;
+    initAdaGrad();
+    hnsw.clear(); // built for the old weights
 
     // read file to find out the beginning of each chunk
     // also counts the number of lines and words
@@ -448,6 +817,38 @@ void MonolingualModel::train(const string& training_file, bool initialize) {
         initSentWeights();
 
     high_resolution_clock::time_point start = high_resolution_clock::now();
+
+    // data-parallel training: synchronize with the other processes in a separate thread
+    std::unique_ptr<Cluster> cluster;
+    std::atomic<bool> training_done(false);
+    thread sync_thread;
+    if (config->cluster_size > 1) {
+        cluster.reset(new Cluster(config->cluster_address, config->cluster_rank, config->cluster_size,
+            {&input_weights, &output_weights, &output_weights_hs}, signature()));
+        sync_thread = thread(&Cluster::run, cluster.get(), std::cref(words_processed),
+            config->sync_words, std::cref(training_done));
+    }
+
+    // training metrics, reported in a separate thread
+    std::unique_ptr<MetricsReporter> reporter;
+    thread metrics_thread;
+    if (!config->metrics_file.empty() || metrics_callback) {
+        reporter.reset(new MetricsReporter(config->threads, config->metrics_file, metrics_callback,
+            config->metrics_interval));
+        metrics = reporter.get();
+        metrics_thread = thread(&MetricsReporter::run, reporter.get(), std::cref(alpha), std::cref(words_processed),
+            config->iterations * training_words, std::cref(training_done));
+    }
+
+    // held-out evaluation (and early stopping) in a separate thread
+    vector<vector<HuffmanNode>> heldout;
+    thread heldout_thread;
+    if (!config->heldout_file.empty()) {
+        heldout = readHeldout(config->heldout_file);
+        heldout_thread = thread(&MonolingualModel::evaluateHeldout, this, std::cref(heldout),
+            std::cref(training_done));
+    }
+
     if (config->threads == 1) {
         trainChunk(training_file, chunks, 0);
     } else {
@@ -462,13 +863,160 @@ void MonolingualModel::train(const string& training_file, bool initialize) {
             it->join();
         }
     }
+
+    training_done = true;
+    if (cluster) {
+        sync_thread.join();
+    }
+    if (heldout_thread.joinable()) {
+        heldout_thread.join();
+    }
+    if (reporter) {
+        metrics_thread.join();
+        last_metrics = reporter->lastReport();
+        metrics = 0;
+    }
     high_resolution_clock::time_point end = high_resolution_clock::now();
     auto duration = duration_cast<microseconds>(end - start).count();
+    training_time = static_cast<float>(duration) / 1000000;
 
     if (config->verbose)
         std::cout << std::endl;
 
-    std::cout << "Training time: " << static_cast<float>(duration) / 1000000 << std::endl;
+    std::cout << "Training time: " << training_time << std::endl;
+
+    if (!heldout.empty()) {
+        std::cout << "Held-out loss: " << heldoutLoss(heldout, config->threads) << std::endl;
+    }
+
+    sent_weights_map.sync();
+}
+
+vector<vector<HuffmanNode>> MonolingualModel::readHeldout(const string& filename) const {
+    ifstream infile(filename);
+    check_is_open(infile, filename);
+
+    vector<vector<HuffmanNode>> sentences;
+    string sent;
+    while (getline(infile, sent)) {
+        auto nodes = getNodes(sent);
+        nodes.erase(remove(nodes.begin(), nodes.end(), HuffmanNode::UNK), nodes.end());
+        if (!nodes.empty()) sentences.push_back(nodes);
+    }
+
+    return sentences;
+}
+
+/**
+ * @brief Mean loss (negative log-likelihood of negative sampling and/or hierarchical softmax)
+ * of each prediction made by the model on `sentences`, with the full context window, and
+ * no sentence vectors. Forward pass only (no update), with `threads` threads.
+ * The negative samples of each sentence are drawn from a generator seeded with its position, so that
+ * two evaluations only differ by the weights of the model (not by sampling noise).
+ */
+float MonolingualModel::heldoutLoss(const vector<vector<HuffmanNode>>& sentences, int threads) {
+    threads = max(1, threads);
+    vector<double> losses(threads, 0);
+    vector<long long> predictions(threads, 0);
+
+    parallelFor(threads, threads, [&](long long thread_id, long long) {
+        unsigned long long random_state;
+        auto predict = [&](const HuffmanNode& node, const vec& hidden) {
+            float loss = 0;
+            if (config->hierarchical_softmax)
+                hierarchicalUpdate(node, hidden, 0, false, &loss);
+            if (config->negative > 0)
+                negSamplingUpdate(node, hidden, 0, false, &loss, &random_state);
+            losses[thread_id] += loss;
+            ++predictions[thread_id];
+        };
+
+        for (size_t i = thread_id; i < sentences.size(); i += threads) {
+            random_state = i;
+            const vector<HuffmanNode>& nodes = sentences[i];
+            int length = nodes.size();
+
+            for (int pos = 0; pos < length; ++pos) {
+                int begin = max(0, pos - config->window_size);
+                int end = min(length - 1, pos + config->window_size);
+
+                if (config->skip_gram) {
+                    for (int p = begin; p <= end; ++p) {
+                        if (p != pos) predict(nodes[p], input_weights[nodes[pos].index]);
+                    }
+                } else if (end > begin) {
+                    vec hidden(config->dimension, 0);
+                    for (int p = begin; p <= end; ++p) {
+                        if (p != pos) hidden += input_weights[nodes[p].index];
+                    }
+                    hidden /= end - begin;
+                    predict(nodes[pos], hidden);
+                }
+            }
+        }
+    });
+
+    double loss = 0;
+    long long total = 0;
+    for (int i = 0; i < threads; ++i) {
+        loss += losses[i];
+        total += predictions[i];
+    }
+    return total == 0 ? 0 : loss / total;
+}
+
+float MonolingualModel::heldoutLoss(const string& filename) {
+    initTraining();
+    return heldoutLoss(readHeldout(filename), config->threads);
+}
+
+/**
+ * @brief Evaluate the held-out loss every config->heldout_words processed words (or about once
+ * per epoch), until the end of training. Training is stopped early (stop_training) when the loss
+ * improves by less than config->heldout_tolerance, relatively to the previous evaluation.
+ * This runs in its own thread, concurrently with the training threads (like the cluster synchronization),
+ * and evaluates with this thread only, so as not to compete with the training threads.
+ */
+void MonolingualModel::evaluateHeldout(const vector<vector<HuffmanNode>>& sentences,
+                                       const std::atomic<bool>& training_done) {
+    long long eval_words = config->heldout_words > 0 ? config->heldout_words : training_words;
+    long long next_eval = eval_words;
+    float previous_loss = heldoutLoss(sentences, 1);
+
+    if (config->verbose)
+        std::cout << "Held-out loss: " << previous_loss << std::endl;
+
+    while (!training_done) {
+        long long processed = words_processed.load(std::memory_order_relaxed);
+        if (processed < next_eval) {
+            std::this_thread::sleep_for(milliseconds(10));
+            continue;
+        }
+
+        float loss = heldoutLoss(sentences, 1);
+        if (config->verbose)
+            std::cout << std::endl;
+        std::cout << "Held-out loss: " << loss << " (" << processed << " words)" << std::endl;
+
+        if (config->heldout_tolerance > 0 && loss > previous_loss * (1 - config->heldout_tolerance)) {
+            std::cout << "Early stopping" << std::endl;
+            stop_training = true;
+            return;
+        }
+
+        previous_loss = loss;
+        next_eval = words_processed.load(std::memory_order_relaxed) + eval_words;
+    }
+}
+
+unsigned long long MonolingualModel::signature() const {
+    // independent from the iteration order of the vocabulary
+    unsigned long long res = config->dimension;
+    std::hash<string> hash;
+    for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
+        res += (hash(it->first) ^ it->second.index) * 0x9E3779B97F4A7C15ULL;
+    }
+    return res;
 }
 
 /**
@@ -525,30 +1073,47 @@ void MonolingualModel::trainChunk(const string& training_file,
         throw;
     }
 
-    for (int k = 0; k < max_iterations; ++k) {
+    ThreadMetrics* thread_metrics = metrics ? &metrics->threadMetrics(chunk_id) : 0;
+    if (thread_metrics) thread_metrics->last = high_resolution_clock::now();
+
+    for (int k = 0; k < max_iterations && !stop_training; ++k) {
         int word_count = 0, last_count = 0;
 
         infile.clear();
         infile.seekg(chunks[chunk_id], infile.beg);
 
-        int chunk_size = training_lines / chunks.size();
-        int sent_id = chunk_id * chunk_size;
+        long long chunk_size = training_lines / chunks.size();
+        long long sent_id = chunk_id * chunk_size;
 
         string sent;
-        while (getline(infile, sent)) {
-            word_count += trainSentence(sent, sent_id++); // asynchronous update (possible race conditions)
+        while (read_line(infile, sent)) {
+            if (thread_metrics) thread_metrics->lap(thread_metrics->io_time);
+            auto nodes = getNodes(sent);  // same size as sent, OOV words are replaced by <UNK>
+            if (thread_metrics) thread_metrics->lap(thread_metrics->nodes_time);
+
+            float loss = 0;
+            // asynchronous update (possible race conditions)
+            int words = trainSentence(std::move(nodes), sent_id++, thread_metrics ? &loss : 0);
+            word_count += words;
+
+            if (thread_metrics) {
+                thread_metrics->lap(thread_metrics->train_time);
+                thread_metrics->addSentence(words, loss);
+            }
 
             // update learning rate
             if (word_count - last_count > 10000) {
-                words_processed += word_count - last_count; // asynchronous update
+                long long processed = words_processed.fetch_add(word_count - last_count, std::memory_order_relaxed)
+                    + word_count - last_count;
                 last_count = word_count;
 
                 // decreasing learning rate
-                alpha = starting_alpha * (1 - static_cast<float>(words_processed) / (max_iterations * training_words));
-                alpha = max(alpha, starting_alpha * 0.0001f);
+                float new_alpha = starting_alpha * (1 - static_cast<float>(processed) / (max_iterations * training_words));
+                new_alpha = max(new_alpha, starting_alpha * 0.0001f);
+                alpha.store(new_alpha, std::memory_order_relaxed);
 
                 if (config->verbose) {
-                    printf("\rAlpha: %f  Progress: %.2f%%", alpha, 100.0 * words_processed /
+                    printf("\rAlpha: %f  Progress: %.2f%%", new_alpha, 100.0 * processed /
                                     (max_iterations * training_words));
                     fflush(stdout);
                 }
@@ -557,15 +1122,19 @@ void MonolingualModel::trainChunk(const string& training_file,
             // stop when reaching the end of a chunk
             if (chunk_id < chunks.size() - 1 && infile.tellg() >= chunks[chunk_id + 1])
                 break;
+            if (stop_training)
+                break;
         }
 
-        words_processed += word_count - last_count;
+        words_processed.fetch_add(word_count - last_count, std::memory_order_relaxed);
     }
 }
 
-int MonolingualModel::trainSentence(const string& sent, int sent_id) {
-    auto nodes = getNodes(sent);  // same size as sent, OOV words are replaced by <UNK>
-
+/**
+ * @brief Train the model on a sentence (as given by getNodes). If `loss` is not null, the
+ * training loss is added to it.
+ */
+int MonolingualModel::trainSentence(vector<HuffmanNode> nodes, long long sent_id, float* loss) {
     // counts the number of words that are in the vocabulary
     int words = nodes.size() - count(nodes.begin(), nodes.end(), HuffmanNode::UNK);
 
@@ -582,23 +1151,51 @@ int MonolingualModel::trainSentence(const string& sent, int sent_id) {
         remove(nodes.begin(), nodes.end(), HuffmanNode::UNK),
         nodes.end());
 
+    // The sentence vector is trained on a local copy, which is written back at the end
+    // of the sentence (each sentence is processed by exactly one thread).
+    vec sent_vec;
+    if (config->sent_vector) {
+        sent_vec = getSentWeights(sent_id);
+    }
+
+    if (config->sent_vector && config->dbow) {
+        // PV-DBOW: the sentence vector alone is used to predict each word of the sentence
+        for (int pos = 0; pos < nodes.size(); ++pos) {
+            trainWordDBOW(nodes, pos, sent_vec, loss);
+        }
+    }
+
     // Monolingual training
-    for (int pos = 0; pos < nodes.size(); ++pos) {
-        trainWord(nodes, pos, sent_id);
+    if (!config->sent_vector || !config->dbow || config->dbow_words) {
+        vec* context_sent_vec = config->sent_vector && !config->dbow ? &sent_vec : 0;
+
+        for (int pos = 0; pos < nodes.size(); ++pos) {
+            trainWord(nodes, pos, context_sent_vec, loss);
+        }
+    }
+
+    if (config->sent_vector) {
+        setSentWeights(sent_id, sent_vec);
     }
 
     return words; // returns the number of words processed, for progress estimation
 }
 
-void MonolingualModel::trainWord(const vector<HuffmanNode>& nodes, int word_pos, int sent_id) {
+void MonolingualModel::trainWord(const vector<HuffmanNode>& nodes, int word_pos, vec* sent_vec, float* loss) {
     if (config->skip_gram) {
-        trainWordSkipGram(nodes, word_pos, sent_id);
+        trainWordSkipGram(nodes, word_pos, loss);
     } else {
-        trainWordCBOW(nodes, word_pos, sent_id);
+        trainWordCBOW(nodes, word_pos, sent_vec, loss);
     }
 }
 
-void MonolingualModel::trainWordCBOW(const vector<HuffmanNode>& nodes, int word_pos, int sent_id) {
+/**
+ * @brief CBOW update: predict the word at `word_pos` from the average of its context.
+ * If `sent_vec` is not null, it is part of the context (PV-DM), and it is updated as well.
+ */
+void MonolingualModel::trainWordCBOW(const vector<HuffmanNode>& nodes, int word_pos, vec* sent_vec, float* loss) {
+    PROFILE_SCOPE("MonolingualModel::trainWordCBOW");
+    float alpha = this->alpha.load(std::memory_order_relaxed); // updated by the training threads
     int dimension = config->dimension;
     vec hidden(dimension, 0);
     HuffmanNode cur_node = nodes[word_pos];
@@ -612,8 +1209,8 @@ void MonolingualModel::trainWordCBOW(const vector<HuffmanNode>& nodes, int word_
         ++count;
     }
 
-    if (config->sent_vector) {
-        hidden += sent_weights[sent_id];
+    if (sent_vec) {
+        hidden += *sent_vec;
         ++count;
     }
 
@@ -622,24 +1219,44 @@ void MonolingualModel::trainWordCBOW(const vector<HuffmanNode>& nodes, int word_
 
     vec error(dimension, 0);
     if (config->hierarchical_softmax) {
-        error += hierarchicalUpdate(cur_node, hidden, alpha);
+        error += hierarchicalUpdate(cur_node, hidden, alpha, true, loss);
     }
     if (config->negative > 0) {
-        error += negSamplingUpdate(cur_node, hidden, alpha);
+        error += negSamplingUpdate(cur_node, hidden, alpha, true, loss);
     }
 
     // update input weights
     for (int pos = word_pos - this_window_size; pos <= word_pos + this_window_size; ++pos) {
         if (pos < 0 || pos >= nodes.size() || pos == word_pos) continue;
-        input_weights[nodes[pos].index] += error;
+        inputUpdate(nodes[pos].index, error, alpha);
     }
 
-    if (config->sent_vector) {
-        sent_weights[sent_id] += error;
+    if (sent_vec) {
+        *sent_vec += error;
+    }
+}
+
+/**
+ * @brief PV-DBOW update: predict the word at `word_pos` from the sentence vector only.
+ * No context averaging, and the input word weights are left untouched.
+ */
+void MonolingualModel::trainWordDBOW(const vector<HuffmanNode>& nodes, int word_pos, vec& sent_vec, float* loss) {
+    PROFILE_SCOPE("MonolingualModel::trainWordDBOW");
+    float alpha = this->alpha.load(std::memory_order_relaxed); // updated by the training threads
+    vec error(config->dimension, 0);
+    if (config->hierarchical_softmax) {
+        error += hierarchicalUpdate(nodes[word_pos], sent_vec, alpha, true, loss);
     }
+    if (config->negative > 0) {
+        error += negSamplingUpdate(nodes[word_pos], sent_vec, alpha, true, loss);
+    }
+
+    sent_vec += error;
 }
 
-void MonolingualModel::trainWordSkipGram(const vector<HuffmanNode>& nodes, int word_pos, int sent_id) {
+void MonolingualModel::trainWordSkipGram(const vector<HuffmanNode>& nodes, int word_pos, float* loss) {
+    PROFILE_SCOPE("MonolingualModel::trainWordSkipGram");
+    float alpha = this->alpha.load(std::memory_order_relaxed); // updated by the training threads
     int dimension = config->dimension;
     HuffmanNode input_word = nodes[word_pos]; // use this word to predict surrounding words
 
@@ -653,19 +1270,22 @@ void MonolingualModel::trainWordSkipGram(const vector<HuffmanNode>& nodes, int w
 
         vec error(dimension, 0);
         if (config->hierarchical_softmax) {
-            error += hierarchicalUpdate(output_word, input_weights[input_word.index], alpha);
+            error += hierarchicalUpdate(output_word, input_weights[input_word.index], alpha, true, loss);
         }
         if (config->negative > 0) {
-            error += negSamplingUpdate(output_word, input_weights[input_word.index], alpha);
+            error += negSamplingUpdate(output_word, input_weights[input_word.index], alpha, true, loss);
         }
 
-        input_weights[input_word.index] += error;
+        inputUpdate(input_word.index, error, alpha);
     }
 }
 
-vec MonolingualModel::negSamplingUpdate(const HuffmanNode& node, const vec& hidden, float alpha, bool update) {
+vec MonolingualModel::negSamplingUpdate(const HuffmanNode& node, const vec& hidden, float alpha, bool update,
+                                        float* loss, unsigned long long* random_state) {
+    PROFILE_SCOPE("MonolingualModel::negSamplingUpdate");
     int dimension = config->dimension;
     vec temp(dimension, 0);
+    float hidden_sq = config->adagrad ? hidden.dot(hidden) / dimension : 0;
 
     for (int d = 0; d < config->negative + 1; ++d) {
         int label;
@@ -675,7 +1295,7 @@ vec MonolingualModel::negSamplingUpdate(const HuffmanNode& node, const vec& hidd
             target = &node;
             label = 1;
         } else { // n negative examples
-            target = getRandomHuffmanNode();
+            target = getRandomHuffmanNode(random_state);
             if (*target == node) continue;
             label = 0;
         }
@@ -690,42 +1310,83 @@ vec MonolingualModel::negSamplingUpdate(const HuffmanNode& node, const vec& hidd
         } else {
             pred = sigmoid(x);
         }
+        if (loss) {
+            *loss -= log(max(label ? pred : 1 - pred, 1e-06f));
+        }
         float error = alpha * (label - pred);
 
         temp += error * output_weights[target->index];
 
-        if (update)
-            output_weights[target->index] += error * hidden;
+        if (update) {
+            float scale = adaGradScale(output_sq_grads, target->index, (label - pred) * (label - pred) * hidden_sq);
+            output_weights[target->index] += (scale * error) * hidden;
+        }
     }
 
     return temp;
 }
 
 vec MonolingualModel::hierarchicalUpdate(const HuffmanNode& node, const vec& hidden,
-        float alpha, bool update) {
+        float alpha, bool update, float* loss) {
+    PROFILE_SCOPE("MonolingualModel::hierarchicalUpdate");
     int dimension = config->dimension;
     vec temp(dimension, 0);
+    float hidden_sq = config->adagrad ? hidden.dot(hidden) / dimension : 0;
 
     for (int j = 0; j < node.code.size(); ++j) {
         int parent_index = node.parents[j];
         float x = hidden.dot(output_weights_hs[parent_index]);
 
         if (x <= -MAX_EXP || x >= MAX_EXP) {
+            if (loss && (x > 0) != (node.code[j] == 1)) {
+                *loss -= log(1e-06f); // wrong prediction, with saturated sigmoid
+            }
             continue;
         }
 
         float pred = sigmoid(x);
+        if (loss) {
+            *loss -= log(max(node.code[j] ? pred : 1 - pred, 1e-06f));
+        }
         float error = -alpha * (pred - node.code[j]);
 
         temp += error * output_weights_hs[parent_index];
 
-        if (update)
-            output_weights_hs[parent_index] += error * hidden;
+        if (update) {
+            float scale = adaGradScale(output_hs_sq_grads, parent_index, (pred - node.code[j]) * (pred - node.code[j]) * hidden_sq);
+            output_weights_hs[parent_index] += (scale * error) * hidden;
+        }
     }
 
     return temp;
 }
 
+/**
+ * @brief AdaGrad with one accumulator per row (instead of one per parameter): adds the mean
+ * squared gradient `sq_grad` of row `index` to its accumulator, and returns the factor by which
+ * to scale the update of this row (1 without AdaGrad). The accumulators start at 1, so that the
+ * learning rate of a row is at most alpha, and decreases as the row gets updated.
+ * Like the weights, the accumulators are updated without locks (Hogwild).
+ */
+float MonolingualModel::adaGradScale(vector<float>& sq_grads, int index, float sq_grad) {
+    if (!config->adagrad) return 1;
+    float sum = sq_grads[index] + sq_grad;
+    sq_grads[index] = sum;
+    return 1 / sqrt(1 + sum);
+}
+
+/**
+ * @brief Add `error` (the gradient scaled by `alpha`) to the input weights of word `index`.
+ */
+void MonolingualModel::inputUpdate(int index, const vec& error, float alpha) {
+    if (config->adagrad && alpha > 0) {
+        float sq_grad = error.dot(error) / (alpha * alpha * config->dimension);
+        input_weights[index] += adaGradScale(input_sq_grads, index, sq_grad) * error;
+    } else {
+        input_weights[index] += error;
+    }
+}
+
 vector<pair<string, int>> MonolingualModel::getWords() const {
     vector<pair<string, int>> res;
 
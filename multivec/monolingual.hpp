@@ -1,11 +1,19 @@
 #pragma once
 #include "utils.hpp"
+#include "mapped_file.hpp"
+#include "metrics.hpp"
+#include "hnsw.hpp"
 
 class MonolingualModel
 {
     friend class BilingualModel;
+    friend class MultilingualModel;
+    friend class CrossLingualMapper;
+    friend class PQIndex;
+    friend class ModelInternals; // training internals, for the microbenchmarks (model_internals.hpp, not installed)
     friend void save(ofstream& outfile, const MonolingualModel& model);
     friend void load(ifstream& infile, MonolingualModel& model);
+    friend void load(ifstream& infile, MonolingualModel& model, bool query_only);
 
 private:
     Config* const config;
@@ -14,6 +22,12 @@ private:
     mat output_weights; // output weights for negative sampling
     mat output_weights_hs; // output weights for hierarchical softmax
     mat sent_weights;
+    MappedFile sent_weights_map; // disk-backed sentence vectors (used instead of sent_weights if config->sent_weights_file is set)
+
+    // AdaGrad state (config->adagrad): sum of the mean squared gradients of each row, not serialized
+    vector<float> input_sq_grads;
+    vector<float> output_sq_grads;
+    vector<float> output_hs_sq_grads;
 
     long long vocab_word_count; // property of vocabulary (sum of all word counts)
 
@@ -21,57 +35,110 @@ private:
     long long training_words; // total number of words in training file (used for progress estimation)
     long long training_lines;
     // training state
-    long long words_processed;
-    float alpha;
+    std::atomic<long long> words_processed; // read by the metrics, cluster and held-out threads
+    float training_time; // duration of the last training (seconds)
+    std::atomic<float> alpha;
+    std::atomic<bool> stop_training; // early stopping (set by the held-out evaluation)
+    MetricsReporter* metrics; // during training, if metrics are enabled (config->metrics_file or metrics_callback)
+    MetricsCallback metrics_callback;
+    string last_metrics;
+
+    string deferred_file; // model loaded in query-only mode: the training-only sections are still in this file
 
     unordered_map<string, HuffmanNode> vocabulary;
     vector<HuffmanNode*> unigram_table;
+    vector<const HuffmanNode*> index_table; // maps word indices to vocabulary nodes (see indexVocab)
+    HNSWIndex hnsw; // approximate nearest neighbors of the input weights, used by closest (see buildIndex)
 
     void addWordToVocab(const string& word);
     void reduceVocab();
     void createBinaryTree();
     void assignCodes(HuffmanNode* node, vector<int> code, vector<int> parents) const;
     void initUnigramTable();
+    void initTraining(); // loads what query-only mode deferred (see load)
 
-    HuffmanNode* getRandomHuffmanNode(); // uses the unigram frequency table to sample a random node
+    // uses the unigram frequency table to sample a random node (with `random_state` as generator, if not null)
+    HuffmanNode* getRandomHuffmanNode(unsigned long long* random_state = 0);
 
     vector<HuffmanNode> getNodes(const string& sentence) const;
+    vector<HuffmanNode> getNodes(const int* indices, int length) const; // -1 for OOV words, needs indexVocab
     void subsample(vector<HuffmanNode>& node) const;
 
     void readVocab(const string& training_file);
+    void readVocab(const vector<string>& training_files);
+    void initVocab(const vector<pair<string, int>>& words); // vocabulary from words and counts, in index order
+    void indexVocab();
     void initNet();
+    void initAdaGrad();
     void initSentWeights();
+    vec getSentWeights(long long sent_id) const;
+    void setSentWeights(long long sent_id, const vec& sent_vec);
 
     void trainChunk(const string& training_file, const vector<long long>& chunks, int chunk_id);
 
-    int trainSentence(const string& sent, int sent_id);
-    void trainWord(const vector<HuffmanNode>& nodes, int word_pos, int sent_id);
-    void trainWordCBOW(const vector<HuffmanNode>& nodes, int word_pos, int sent_id);
-    void trainWordSkipGram(const vector<HuffmanNode>& nodes, int word_pos, int sent_id);
+    int trainSentence(vector<HuffmanNode> nodes, long long sent_id, float* loss = 0);
+    void trainWord(const vector<HuffmanNode>& nodes, int word_pos, vec* sent_vec, float* loss = 0);
+    void trainWordCBOW(const vector<HuffmanNode>& nodes, int word_pos, vec* sent_vec, float* loss = 0);
+    void trainWordSkipGram(const vector<HuffmanNode>& nodes, int word_pos, float* loss = 0);
+    void trainWordDBOW(const vector<HuffmanNode>& nodes, int word_pos, vec& sent_vec, float* loss = 0);
+
+    vec hierarchicalUpdate(const HuffmanNode& node, const vec& hidden, float alpha, bool update = true, float* loss = 0);
+    vec negSamplingUpdate(const HuffmanNode& node, const vec& hidden, float alpha, bool update = true, float* loss = 0,
+                          unsigned long long* random_state = 0);
+    float adaGradScale(vector<float>& sq_grads, int index, float sq_grad);
+    void inputUpdate(int index, const vec& error, float alpha);
+
+    vector<vector<HuffmanNode>> readHeldout(const string& filename) const;
+    float heldoutLoss(const vector<vector<HuffmanNode>>& sentences, int threads); // mean loss per prediction, without updates
+    void evaluateHeldout(const vector<vector<HuffmanNode>>& sentences, const std::atomic<bool>& training_done);
+
+    void sentVecChunk(const vector<string>& sentences, mat& embeddings, int thread_id, int n_threads);
+
+    unsigned long long signature() const; // identifies the vocabulary and dimension of this model
 
-    vec hierarchicalUpdate(const HuffmanNode& node, const vec& hidden, float alpha, bool update = true);
-    vec negSamplingUpdate(const HuffmanNode& node, const vec& hidden, float alpha, bool update = true);
+    void loadFlat(const string& filename, bool query_only); // see flat_model.hpp
 
     vector<long long> chunkify(const string& filename, int n_chunks);
     vec wordVec(int index, int policy) const;
+    int wordVecSize(int policy) const;
+    void checkPolicy(int policy) const; // throws if the weights that this saving policy needs aren't loaded
+    const float* wordVecData(int index, int policy, float* buffer) const; // wordVec without copy, when possible
+    void exportVectors(const string& filename, int policy, bool binary) const; // word2vec format, multi-threaded
+    vector<pair<string, float>> indexClosest(const vec& v, int n, int skip = -1) const; // closest with the HNSW index
 
 public:
-    MonolingualModel(Config* config) : config(config) {}  // prefer this constructor
+    MonolingualModel(Config* config) : config(config), training_time(0), stop_training(false), metrics(0) {}  // prefer this constructor
 
     vec wordVec(const string& word, int policy = 0) const; // word embedding
     vec sentVec(const string& sentence); // paragraph vector (Le & Mikolov), TODO: custom alpha and iterations
-    void sentVec(istream& infile); // compute paragraph vector for all lines in a stream
+    void sentVec(istream& input, ostream& output = std::cout, bool binary = false); // compute paragraph vector for all lines in a stream (multi-threaded)
+    void saveOnlineSentVectors(const string& input_file, const string& output_file, bool binary = false); // same with files
 
     void train(const string& training_file, bool initialize = true); // training from scratch (resets vocabulary and weights)
 
     void saveVectorsBin(const string &filename, int policy = 0) const; // saves word embeddings in the word2vec binary format
     void saveVectors(const string &filename, int policy = 0) const; // saves word embeddings in the word2vec text format
-    void saveSentVectors(const string &filename) const;
-    void load(const string& filename); // loads the entire model
+    void saveSentVectors(const string &filename, bool binary = false) const;
+    void load(const string& filename, bool query_only = false); // loads the entire model (or what queries need)
     void save(const string& filename) const; // saves the entire model
+    void saveFlat(const string& filename) const; // saves the entire model in the memory-mappable flat format (see FlatModel)
+    void saveQuantized(const string& filename, bool fp16 = false, int policy = 0) const; // int8 or fp16 word embeddings (see QuantizedModel)
+    void importVectors(const string& filename, bool binary = false, long long max_vocab = 0); // word2vec format, query-only (see import.cpp)
 
     void normalizeWeights(); // normalize all weights between 0 and 1
 
+    // HNSW index of the input weights, for fast approximate `closest` (see hnsw.hpp). It is saved next to
+    // the model (file + ".hnsw") by `save` and `saveFlat`, loaded with it, and dropped when the weights change.
+    void buildIndex(int links = 16, int ef_construction = 200);
+    void saveIndex(const string& filename) const;
+    bool loadIndex(const string& filename); // false if the index was built for other weights
+    void clearIndex() { hnsw.clear(); }
+    bool hasIndex() const { return !hnsw.empty(); }
+
+    void scalingBenchmark(const string& training_file, int max_threads, ostream& output = std::cout); // see scaling.cpp
+    float heldoutLoss(const string& filename); // mean loss of the model on a corpus (see config->heldout_file)
+    void setMetricsCallback(const MetricsCallback& callback) { metrics_callback = callback; } // training metrics
+    const string& lastMetrics() const { return last_metrics; } // last metrics report of the last training
     float similarity(const string& word1, const string& word2, int policy = 0) const; // cosine similarity
     float distance(const string& word1, const string& word2, int policy = 0) const; // 1 - cosine similarity
     float similarityNgrams(const string& seq1, const string& seq2, int policy = 0) const; // similarity between two sequences of same size
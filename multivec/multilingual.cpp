@@ -0,0 +1,264 @@
+#include "multilingual.hpp"
+#include "serialization.hpp"
+#include <set>
+
+int MultilingualModel::languageIndex(const string& lang) const {
+    auto it = std::find(languages.begin(), languages.end(), lang);
+    return it == languages.end() ? -1 : static_cast<int>(it - languages.begin());
+}
+
+int MultilingualModel::addLanguage(const string& lang) {
+    int index = languageIndex(lang);
+    if (index != -1) return index;
+
+    languages.push_back(lang);
+    models.push_back(std::unique_ptr<MonolingualModel>(new MonolingualModel(config)));
+    return static_cast<int>(languages.size()) - 1;
+}
+
+MonolingualModel& MultilingualModel::model(const string& lang) {
+    int index = languageIndex(lang);
+    if (index == -1) throw runtime_error("unknown language " + lang);
+    return *models[index];
+}
+
+const MonolingualModel& MultilingualModel::model(const string& lang) const {
+    int index = languageIndex(lang);
+    if (index == -1) throw runtime_error("unknown language " + lang);
+    return *models[index];
+}
+
+/**
+ * @brief Add a parallel corpus for training. New languages are added to the model.
+ */
+void MultilingualModel::addCorpus(const string& src_lang, const string& trg_lang,
+                                  const string& src_file, const string& trg_file) {
+    if (src_lang == trg_lang) {
+        throw runtime_error("corpus languages must be different (" + src_lang + ")");
+    }
+
+    Corpus corpus;
+    corpus.src_lang = addLanguage(src_lang);
+    corpus.trg_lang = addLanguage(trg_lang);
+    corpus.src_file = src_file;
+    corpus.trg_file = trg_file;
+    corpora.push_back(corpus);
+}
+
+void MultilingualModel::train(bool initialize) {
+    if (corpora.empty()) {
+        throw runtime_error("no training corpus");
+    }
+
+    for (auto it = corpora.begin(); it != corpora.end(); ++it) {
+        std::cout << "Training files: " << it->src_file << " (" << languages[it->src_lang] << "), "
+                  << it->trg_file << " (" << languages[it->trg_lang] << ")" << std::endl;
+    }
+
+    if (config->verbose && initialize)
+        std::cout << "Creating new model" << std::endl;
+
+    // one vocabulary per language, from all the files in this language
+    // (languages that were added to an existing model are also initialized)
+    for (int lang = 0; lang < languages.size(); ++lang) {
+        if (initialize || models[lang]->vocabulary.empty()) {
+            vector<string> files;
+            for (auto it = corpora.begin(); it != corpora.end(); ++it) {
+                string file = it->src_lang == lang ? it->src_file : it->trg_lang == lang ? it->trg_file : "";
+                if (!file.empty() && std::find(files.begin(), files.end(), file) == files.end()) {
+                    files.push_back(file);
+                }
+            }
+
+            if (config->verbose)
+                std::cout << "Language: " << languages[lang] << std::endl;
+            models[lang]->readVocab(files);
+            models[lang]->initNet();
+        }
+    }
+
+    // monolingual training is done only once for each file
+    std::set<pair<int, string>> monolingual_files;
+    long long training_words = 0;
+
+    for (auto it = corpora.begin(); it != corpora.end(); ++it) {
+        it->src_mono = monolingual_files.insert({it->src_lang, it->src_file}).second;
+        it->trg_mono = monolingual_files.insert({it->trg_lang, it->trg_file}).second;
+
+        // read files to find out the beginning of each chunk
+        it->src_chunks = models[it->src_lang]->chunkify(it->src_file, config->threads);
+        training_words += models[it->src_lang]->training_words;
+        it->trg_chunks = models[it->trg_lang]->chunkify(it->trg_file, config->threads);
+        training_words += models[it->trg_lang]->training_words;
+    }
+
+    words_processed = 0;
+    alpha = config->learning_rate;
+    for (auto it = models.begin(); it != models.end(); ++it) {
+        (*it)->initAdaGrad();
+        (*it)->clearIndex(); // built for the old weights
+    }
+
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+
+    if (config->threads == 1) {
+        trainChunk(0, training_words);
+    } else {
+        vector<thread> threads;
+
+        for (int i = 0; i < config->threads; ++i) {
+            threads.push_back(thread(&MultilingualModel::trainChunk, this, i, training_words));
+        }
+
+        for (auto it = threads.begin(); it != threads.end(); ++it) {
+            it->join();
+        }
+    }
+
+    high_resolution_clock::time_point end = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(end - start).count();
+
+    if (config->verbose)
+        std::cout << std::endl;
+
+    std::cout << "Training time: " << static_cast<float>(duration) / 1000000 << std::endl;
+}
+
+/**
+ * @brief Train on the `chunk_id`th chunk of each corpus. Corpora are interleaved (one sentence
+ * pair from each corpus in turn), so that all language pairs are trained with the same learning rate.
+ */
+void MultilingualModel::trainChunk(int chunk_id, long long training_words) {
+    vector<std::unique_ptr<ifstream>> src_files, trg_files;
+
+    for (auto it = corpora.begin(); it != corpora.end(); ++it) {
+        src_files.push_back(std::unique_ptr<ifstream>(new ifstream(it->src_file)));
+        trg_files.push_back(std::unique_ptr<ifstream>(new ifstream(it->trg_file)));
+        check_is_open(*src_files.back(), it->src_file);
+        check_is_open(*trg_files.back(), it->trg_file);
+    }
+
+    float starting_alpha = config->learning_rate;
+    int max_iterations = config->iterations;
+
+    for (int k = 0; k < max_iterations; ++k) {
+        int word_count = 0, last_count = 0;
+
+        vector<bool> active(corpora.size(), true);
+        int active_corpora = corpora.size();
+
+        for (int c = 0; c < corpora.size(); ++c) {
+            src_files[c]->clear();
+            trg_files[c]->clear();
+            src_files[c]->seekg(corpora[c].src_chunks[chunk_id], src_files[c]->beg);
+            trg_files[c]->seekg(corpora[c].trg_chunks[chunk_id], trg_files[c]->beg);
+        }
+
+        while (active_corpora > 0) {
+            for (int c = 0; c < corpora.size(); ++c) {
+                if (!active[c]) continue;
+
+                const Corpus& corpus = corpora[c];
+                MonolingualModel& src_model = *models[corpus.src_lang];
+                MonolingualModel& trg_model = *models[corpus.trg_lang];
+
+                string src_sent, trg_sent;
+                if (!getline(*src_files[c], src_sent) || !getline(*trg_files[c], trg_sent)) {
+                    active[c] = false;
+                    --active_corpora;
+                    continue;
+                }
+
+                word_count += BilingualModel::trainSentence(src_model, trg_model,
+                    src_model.getNodes(src_sent), trg_model.getNodes(trg_sent), 0,
+                    alpha, config->beta, corpus.src_mono, corpus.trg_mono);
+
+                // stop when reaching the end of a chunk
+                if (chunk_id < corpus.src_chunks.size() - 1 &&
+                    src_files[c]->tellg() >= corpus.src_chunks[chunk_id + 1]) {
+                    active[c] = false;
+                    --active_corpora;
+                }
+            }
+
+            // update learning rate
+            if (word_count - last_count > 10000) {
+                words_processed += word_count - last_count; // asynchronous update
+                last_count = word_count;
+
+                alpha = starting_alpha * (1 - static_cast<float>(words_processed) / (max_iterations * training_words));
+                alpha = std::max(alpha, starting_alpha * 0.0001f);
+
+                if (config->verbose) {
+                    printf("\rAlpha: %f  Progress: %.2f%%", alpha, 100.0 * words_processed /
+                                    (max_iterations * training_words));
+                    fflush(stdout);
+                }
+            }
+        }
+
+        words_processed += word_count - last_count;
+    }
+}
+
+float MultilingualModel::similarity(const string& lang1, const string& word1, const string& lang2,
+                                    const string& word2, int policy) const {
+    const MonolingualModel& model1 = model(lang1);
+    const MonolingualModel& model2 = model(lang2);
+    auto it1 = model1.vocabulary.find(word1);
+    auto it2 = model2.vocabulary.find(word2);
+
+    if (it1 == model1.vocabulary.end() || it2 == model2.vocabulary.end()) {
+        return 0.0;
+    } else {
+        vec v1 = model1.wordVec(it1->second.index, policy);
+        vec v2 = model2.wordVec(it2->second.index, policy);
+        return cosineSimilarity(v1, v2);
+    }
+}
+
+vector<pair<string, float>> MultilingualModel::closest(const string& src_lang, const string& word,
+                                                       const string& trg_lang, int n, int policy) const {
+    const MonolingualModel& src_model = model(src_lang);
+    auto it = src_model.vocabulary.find(word);
+
+    if (it == src_model.vocabulary.end()) {
+        throw runtime_error("OOV word");
+    }
+
+    vec v = src_model.wordVec(it->second.index, policy);
+    return model(trg_lang).closest(v, n, policy);
+}
+
+void MultilingualModel::load(const string& filename) {
+    if (config->verbose)
+        std::cout << "Loading model" << std::endl;
+
+    ifstream infile(filename);
+
+    try {
+        check_is_open(infile, filename);
+    } catch (...) {
+        throw;
+    }
+
+    ::load(infile, *this);
+    for (auto it = models.begin(); it != models.end(); ++it) {
+        (*it)->initUnigramTable();
+    }
+}
+
+void MultilingualModel::save(const string& filename) const {
+    if (config->verbose)
+        std::cout << "Saving model" << std::endl;
+
+    ofstream outfile(filename);
+
+    try {
+        check_is_open(outfile, filename);
+    } catch (...) {
+        throw;
+    }
+
+    ::save(outfile, *this);
+}
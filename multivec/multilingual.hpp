@@ -0,0 +1,64 @@
+#pragma once
+#include "bilingual.hpp"
+
+using namespace std;
+
+/**
+ * @brief Joint training of several languages, with one parallel corpus per language pair.
+ *
+ * Each language has a single monolingual model (vocabulary and weights), which is shared by all
+ * the language pairs that contain this language. All the corpora are trained concurrently, by
+ * the same threads: each thread goes through its chunk of every corpus, one sentence pair at a time.
+ *
+ * When the same file is used for a language in several corpora (e.g. multi-parallel corpus),
+ * monolingual training on this file is only done once.
+ */
+class MultilingualModel
+{
+    friend void save(ofstream& outfile, const MultilingualModel& model);
+    friend void load(ifstream& infile, MultilingualModel& model);
+
+private:
+    BilingualConfig* const config;
+
+    vector<string> languages;
+    vector<std::unique_ptr<MonolingualModel>> models; // one model per language (same order as languages)
+
+    struct Corpus {
+        int src_lang;
+        int trg_lang;
+        string src_file;
+        string trg_file;
+        bool src_mono; // monolingual training on the source side (false if already done with another corpus)
+        bool trg_mono;
+        vector<long long> src_chunks;
+        vector<long long> trg_chunks;
+    };
+    vector<Corpus> corpora;
+
+    long long words_processed;
+    float alpha;
+
+    int addLanguage(const string& lang);
+    int languageIndex(const string& lang) const; // -1 if unknown language
+
+    void trainChunk(int chunk_id, long long training_words);
+
+public:
+    MultilingualModel(BilingualConfig* config) : config(config) {}
+
+    void addCorpus(const string& src_lang, const string& trg_lang, const string& src_file, const string& trg_file);
+    void train(bool initialize = true); // train with all the corpora (a new vocabulary is created for each language)
+    void load(const string& filename);
+    void save(const string& filename) const;
+
+    const vector<string>& getLanguages() const { return languages; }
+    MonolingualModel& model(const string& lang); // throws if unknown language
+    const MonolingualModel& model(const string& lang) const;
+
+    float similarity(const string& lang1, const string& word1, const string& lang2, const string& word2,
+                     int policy = 0) const; // cosine similarity
+    // n closest words in language trg_lang to given word
+    vector<pair<string, float>> closest(const string& src_lang, const string& word, const string& trg_lang,
+                                        int n = 10, int policy = 0) const;
+};
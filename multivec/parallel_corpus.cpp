@@ -0,0 +1,220 @@
+#include "parallel_corpus.hpp"
+
+static const char PARALLEL_CORPUS_MAGIC[8] = {'M', 'V', 'P', 'A', 'R', 'A', '0', '1'};
+
+void ParallelCorpus::open(const string& filename) {
+    file.open(filename);
+    header = reinterpret_cast<const ParallelCorpusHeader*>(file.data());
+
+    if (file.size() < sizeof(ParallelCorpusHeader) ||
+        !equal(PARALLEL_CORPUS_MAGIC, PARALLEL_CORPUS_MAGIC + 8, header->magic)) {
+        throw runtime_error("invalid parallel corpus file " + filename);
+    }
+
+    // the sections are accessed without bound checks during training
+    long long pairs = header->pairs;
+    if (pairs < 0 || header->src_tokens < 0 || header->trg_tokens < 0
+        || !fits(header->src_ids, header->src_tokens, sizeof(int))
+        || !fits(header->trg_ids, header->trg_tokens, sizeof(int))
+        || !fits(header->src_offsets, pairs + 1, sizeof(long long))
+        || !fits(header->trg_offsets, pairs + 1, sizeof(long long))
+        || (hasAlignment() && !fits(header->alignment, header->src_tokens, sizeof(int)))
+        || !validOffsets(section<long long>(header->src_offsets), pairs, header->src_tokens)
+        || !validOffsets(section<long long>(header->trg_offsets), pairs, header->trg_tokens)) {
+        throw runtime_error("invalid parallel corpus file " + filename);
+    }
+    // checked here rather than in the training threads, where an exception can't be caught
+    if (hasAlignment() && !validAlignment()) {
+        throw runtime_error("invalid word alignment in parallel corpus file " + filename);
+    }
+}
+
+// true if `count` values of `size` bytes at `position` are inside the file
+bool ParallelCorpus::fits(long long position, long long count, size_t size) const {
+    return position >= static_cast<long long>(sizeof(ParallelCorpusHeader)) && count >= 0
+        && position <= static_cast<long long>(file.size())
+        && static_cast<unsigned long long>(count) <= (file.size() - position) / size;
+}
+
+// true if each source word is aligned to a position of its target sentence (or -1)
+bool ParallelCorpus::validAlignment() const {
+    for (long long i = 0; i < size(); ++i) {
+        const int* positions = alignment(i);
+        int trg_length = trgLength(i);
+        for (int j = 0; j < srcLength(i); ++j) {
+            if (positions[j] < -1 || positions[j] >= trg_length) return false;
+        }
+    }
+    return true;
+}
+
+// true if the sentence offsets go from 0 to `tokens` without decreasing
+bool ParallelCorpus::validOffsets(const long long* offsets, long long pairs, long long tokens) {
+    if (offsets[0] != 0 || offsets[pairs] != tokens) return false;
+    for (long long i = 0; i < pairs; ++i) {
+        if (offsets[i + 1] < offsets[i]) return false;
+    }
+    return true;
+}
+
+int ParallelCorpus::srcLength(long long i) const {
+    const long long* offsets = section<long long>(header->src_offsets);
+    return static_cast<int>(offsets[i + 1] - offsets[i]);
+}
+
+int ParallelCorpus::trgLength(long long i) const {
+    const long long* offsets = section<long long>(header->trg_offsets);
+    return static_cast<int>(offsets[i + 1] - offsets[i]);
+}
+
+const int* ParallelCorpus::alignment(long long i) const {
+    if (!hasAlignment()) return 0;
+    return section<int>(header->alignment) + srcOffset(i);
+}
+
+vector<pair<string, int>> ParallelCorpus::readVocab(long long position, long long size) const {
+    vector<pair<string, int>> words;
+    words.reserve(size);
+    const char* data = file.data() + position;
+
+    for (long long i = 0; i < size; ++i) {
+        long long count, length;
+        std::copy(data, data + sizeof(count), reinterpret_cast<char*>(&count));
+        std::copy(data + sizeof(count), data + 2 * sizeof(count), reinterpret_cast<char*>(&length));
+        data += 2 * sizeof(count);
+        words.push_back({string(data, length), static_cast<int>(count)});
+        data += length;
+    }
+
+    return words;
+}
+
+static void pad(ofstream& outfile) {
+    // aligns the next section on 8 bytes
+    while (outfile.tellp() % 8 != 0) outfile.put(0);
+}
+
+/**
+ * @brief Convert one side of the corpus to word indices.
+ * @return offsets of the sentences (in number of words)
+ */
+static vector<long long> writeIds(ofstream& outfile, const string& filename,
+                                  const unordered_map<string, HuffmanNode>& vocab) {
+    ifstream infile(filename);
+    check_is_open(infile, filename);
+    check_is_non_empty(infile, filename);
+
+    vector<long long> offsets(1, 0);
+    vector<int> ids;
+    string line, word;
+
+    while (getline(infile, line)) {
+        ids.clear();
+        istringstream iss(line);
+
+        while (iss >> word) {
+            auto it = vocab.find(word);
+            ids.push_back(it == vocab.end() ? -1 : it->second.index);
+        }
+
+        outfile.write(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(int));
+        offsets.push_back(offsets.back() + ids.size());
+    }
+
+    return offsets;
+}
+
+static void writeVocab(ofstream& outfile, const unordered_map<string, HuffmanNode>& vocab) {
+    vector<const HuffmanNode*> nodes(vocab.size());
+    for (auto it = vocab.begin(); it != vocab.end(); ++it) {
+        nodes[it->second.index] = &it->second;
+    }
+
+    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+        long long count = (*it)->count;
+        long long length = (*it)->word.size();
+        outfile.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        outfile.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        outfile.write((*it)->word.data(), length);
+    }
+}
+
+/**
+ * @brief Create a binary parallel corpus from two text files (one sentence per line), using
+ * the given vocabularies to convert words to indices.
+ */
+void ParallelCorpus::build(const string& src_file, const string& trg_file,
+                           const unordered_map<string, HuffmanNode>& src_vocab,
+                           const unordered_map<string, HuffmanNode>& trg_vocab,
+                           const string& filename) {
+    ofstream outfile(filename, ios::binary | ios::out);
+    check_is_open(outfile, filename);
+
+    ParallelCorpusHeader header = ParallelCorpusHeader();
+    std::copy(PARALLEL_CORPUS_MAGIC, PARALLEL_CORPUS_MAGIC + 8, header.magic);
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header)); // written again at the end
+
+    vector<long long> offsets;
+
+    header.src_ids = outfile.tellp();
+    offsets = writeIds(outfile, src_file, src_vocab);
+    pad(outfile);
+    header.src_offsets = outfile.tellp();
+    outfile.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(long long));
+    header.pairs = offsets.size() - 1;
+    header.src_tokens = offsets.back();
+
+    header.trg_ids = outfile.tellp();
+    offsets = writeIds(outfile, trg_file, trg_vocab);
+    pad(outfile);
+    header.trg_offsets = outfile.tellp();
+    outfile.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(long long));
+    header.trg_tokens = offsets.back();
+
+    if (offsets.size() - 1 != header.pairs) {
+        throw runtime_error("files " + src_file + " and " + trg_file + " don't have the same number of lines");
+    }
+
+    header.src_vocab = outfile.tellp();
+    header.src_vocab_size = src_vocab.size();
+    writeVocab(outfile, src_vocab);
+    header.trg_vocab = outfile.tellp();
+    header.trg_vocab_size = trg_vocab.size();
+    writeVocab(outfile, trg_vocab);
+
+    outfile.seekp(0);
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+/**
+ * @brief Add a word alignment to an existing corpus file (or replace its alignment).
+ * @param alignment target position (or -1) of each source token, in corpus order
+ */
+void ParallelCorpus::saveAlignment(const string& filename, const vector<int>& alignment) {
+    fstream file(filename, ios::binary | ios::in | ios::out);
+    if (!file.is_open()) {
+        throw runtime_error("couldn't open file " + filename);
+    }
+
+    ParallelCorpusHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    if (!file || !equal(PARALLEL_CORPUS_MAGIC, PARALLEL_CORPUS_MAGIC + 8, header.magic)) {
+        throw runtime_error("invalid parallel corpus file " + filename);
+    }
+    if (alignment.size() != header.src_tokens) {
+        throw runtime_error("alignment doesn't match corpus " + filename);
+    }
+
+    if (header.alignment == 0) { // new section at the end of the file
+        file.seekp(0, ios::end);
+        while (file.tellp() % 8 != 0) file.put(0);
+        header.alignment = file.tellp();
+    } else {
+        file.seekp(header.alignment);
+    }
+
+    file.write(reinterpret_cast<const char*>(alignment.data()), alignment.size() * sizeof(int));
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "utils.hpp"
+#include "mapped_file.hpp"
+
+/**
+ * Binary parallel corpus, where both sides are already converted to word indices.
+ * File layout (all positions are in bytes from the beginning of the file):
+ * - 128-byte header (see ParallelCorpusHeader)
+ * - source word indices (int32, -1 for OOV words), then source offsets (int64, pairs + 1 values)
+ * - target word indices, then target offsets
+ * - source and target vocabularies, in index order (for each word: int64 count, int64 length, characters)
+ * - optional word alignment (int32 for each source word: position in the target sentence, or -1)
+ *
+ * The file is memory-mapped for training.
+ */
+struct ParallelCorpusHeader {
+    char magic[8];
+    long long pairs;
+    long long src_tokens;
+    long long trg_tokens;
+    long long src_ids;      // positions of the sections in the file
+    long long src_offsets;
+    long long trg_ids;
+    long long trg_offsets;
+    long long src_vocab;
+    long long trg_vocab;
+    long long alignment;    // 0 if there is no alignment
+    long long src_vocab_size;
+    long long trg_vocab_size;
+    char padding[16];
+};
+
+class ParallelCorpus {
+    MappedFile file;
+    const ParallelCorpusHeader* header;
+
+    template<typename T>
+    const T* section(long long position) const {
+        return reinterpret_cast<const T*>(file.data() + position);
+    }
+
+    vector<pair<string, int>> readVocab(long long position, long long size) const;
+    bool fits(long long position, long long count, size_t size) const;
+    static bool validOffsets(const long long* offsets, long long pairs, long long tokens);
+    bool validAlignment() const;
+
+public:
+    ParallelCorpus() : header(0) {}
+    ParallelCorpus(const string& filename) : header(0) { open(filename); }
+
+    void open(const string& filename);
+
+    long long size() const { return header->pairs; } // number of sentence pairs
+    long long srcTokens() const { return header->src_tokens; }
+    long long trgTokens() const { return header->trg_tokens; }
+    int srcVocabSize() const { return static_cast<int>(header->src_vocab_size); }
+    int trgVocabSize() const { return static_cast<int>(header->trg_vocab_size); }
+
+    // word indices of the source (resp. target) side of the ith sentence pair
+    const int* src(long long i) const { return section<int>(header->src_ids) + srcOffset(i); }
+    const int* trg(long long i) const { return section<int>(header->trg_ids) + section<long long>(header->trg_offsets)[i]; }
+    int srcLength(long long i) const;
+    long long srcOffset(long long i) const { return section<long long>(header->src_offsets)[i]; } // position of src(i)
+    int trgLength(long long i) const;
+
+    bool hasAlignment() const { return header->alignment != 0; }
+    // target position of each source word of the ith sentence pair (or -1), null if no alignment
+    const int* alignment(long long i) const;
+
+    // words (with their counts) in index order
+    vector<pair<string, int>> srcVocab() const { return readVocab(header->src_vocab, header->src_vocab_size); }
+    vector<pair<string, int>> trgVocab() const { return readVocab(header->trg_vocab, header->trg_vocab_size); }
+
+    static void build(const string& src_file, const string& trg_file,
+                      const unordered_map<string, HuffmanNode>& src_vocab,
+                      const unordered_map<string, HuffmanNode>& trg_vocab,
+                      const string& filename);
+    static void saveAlignment(const string& filename, const vector<int>& alignment);
+};
@@ -0,0 +1,383 @@
+#include "pq_index.hpp"
+#include "monolingual.hpp"
+#include "linalg.hpp"
+#include <cstring>
+#include <numeric>
+#include <queue>
+#include <random>
+
+namespace {
+
+Matrix columns(const Matrix& m, int begin, int n) {
+    Matrix res(m.rows(), n);
+    for (int i = 0; i < m.rows(); ++i) {
+        std::copy(m.row(i) + begin, m.row(i) + begin + n, res.row(i));
+    }
+    return res;
+}
+
+// closest centroid (L2 distance) of each row of `data`
+void assign(const Matrix& data, const Matrix& centroids, vector<int>& assignment, int threads) {
+    // argmin |x - c|^2 = argmax x.c - |c|^2 / 2, with the scores of all the centroids computed
+    // together (transposed centroids), which vectorizes even when the rows are short
+    int k = centroids.rows();
+    Matrix transposed = centroids.transpose();
+    vector<float> bias(k);
+    for (int c = 0; c < k; ++c) {
+        bias[c] = -0.5f * dot(centroids.row(c), centroids.row(c), centroids.cols());
+    }
+
+    assignment.resize(data.rows());
+    parallelFor(data.rows(), threads, [&](long long begin, long long end) {
+        vector<float> scores(k);
+        for (long long i = begin; i < end; ++i) {
+            const float* x = data.row(i);
+            std::copy(bias.begin(), bias.end(), scores.begin());
+            for (int j = 0; j < data.cols(); ++j) {
+                const float* t = transposed.row(j);
+                for (int c = 0; c < k; ++c) scores[c] += x[j] * t[c];
+            }
+            assignment[i] = std::max_element(scores.begin(), scores.end()) - scores.begin();
+        }
+    });
+}
+
+Matrix kmeans(const Matrix& data, int k, int iterations, int threads, std::mt19937& generator) {
+    int d = data.cols();
+    Matrix centroids(k, d);
+
+    // initialization with distinct random rows (as long as there are enough rows)
+    vector<int> rows(data.rows());
+    std::iota(rows.begin(), rows.end(), 0);
+    std::shuffle(rows.begin(), rows.end(), generator);
+    for (int c = 0; c < k; ++c) {
+        std::copy(data.row(rows[c % rows.size()]), data.row(rows[c % rows.size()]) + d, centroids.row(c));
+    }
+
+    std::uniform_int_distribution<int> random_row(0, data.rows() - 1);
+    vector<int> assignment;
+
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        assign(data, centroids, assignment, threads);
+
+        Matrix sums(k, d);
+        vector<int> counts(k, 0);
+        for (int i = 0; i < data.rows(); ++i) {
+            float* sum = sums.row(assignment[i]);
+            const float* x = data.row(i);
+            for (int j = 0; j < d; ++j) sum[j] += x[j];
+            counts[assignment[i]]++;
+        }
+
+        for (int c = 0; c < k; ++c) {
+            if (counts[c] == 0) { // empty cluster: restart from a random row
+                const float* x = data.row(random_row(generator));
+                std::copy(x, x + d, centroids.row(c));
+            } else {
+                for (int j = 0; j < d; ++j) centroids(c, j) = sums(c, j) / counts[c];
+            }
+        }
+    }
+
+    return centroids;
+}
+
+void subtractCentroids(Matrix& data, const Matrix& centroids, const vector<int>& assignment) {
+    for (int i = 0; i < data.rows(); ++i) {
+        const float* c = centroids.row(assignment[i]);
+        float* x = data.row(i);
+        for (int j = 0; j < data.cols(); ++j) x[j] -= c[j];
+    }
+}
+
+template<class T>
+uint64_t writeSection(ofstream& outfile, const T* data, size_t size) {
+    uint64_t offset = alignFlat(outfile);
+    outfile.write(reinterpret_cast<const char*>(data), sizeof(T) * size);
+    return offset;
+}
+
+}
+
+/**
+ * @brief Build a product quantization index of the (normalized) input weights of `model`, and save
+ * it in `filename`. The k-means assignments and the encoding of the vocabulary use config.threads threads.
+ */
+void PQIndex::build(const MonolingualModel& model, const string& filename, const PQConfig& config) {
+    int d = model.config->dimension;
+    long long vocab_size = model.input_weights.size();
+    int m = config.subquantizers;
+    if (m == 0) { // sub-vectors of 4 dimensions (or fewer, if 4 doesn't divide the dimension)
+        int sub_dimension = 4;
+        while (d % sub_dimension != 0) --sub_dimension;
+        m = d / sub_dimension;
+    }
+
+    if (vocab_size == 0) {
+        throw runtime_error("empty model");
+    }
+    if (m <= 0 || d % m != 0) {
+        throw runtime_error("the dimension must be a multiple of the number of sub-quantizers");
+    }
+
+    int sub_dimension = d / m;
+    int n_lists = std::max(1, config.lists);
+    std::mt19937 generator(1);
+
+    // training set: random sample of the normalized vectors
+    vector<int> sample(vocab_size);
+    std::iota(sample.begin(), sample.end(), 0);
+    std::shuffle(sample.begin(), sample.end(), generator);
+    sample.resize(std::min(vocab_size, std::max(config.training_size, static_cast<long long>(PQ_CENTROIDS))));
+    Matrix training_set(model.input_weights, sample);
+    training_set.normalizeRows();
+
+    Matrix coarse(n_lists, d); // a single list with a null centroid without IVF
+    if (n_lists > 1) {
+        if (config.verbose)
+            std::cout << "Training " << n_lists << " coarse centroids" << std::endl;
+        coarse = kmeans(training_set, n_lists, config.iterations, config.threads, generator);
+
+        vector<int> assignment;
+        assign(training_set, coarse, assignment, config.threads);
+        subtractCentroids(training_set, coarse, assignment);
+    }
+
+    if (config.verbose)
+        std::cout << "Training " << m << " codebooks of " << PQ_CENTROIDS << " centroids" << std::endl;
+    vector<Matrix> codebooks;
+    for (int j = 0; j < m; ++j) {
+        codebooks.push_back(kmeans(columns(training_set, j * sub_dimension, sub_dimension), PQ_CENTROIDS,
+                                   config.iterations, config.threads, generator));
+    }
+
+    // encode all the vectors, by batches of rows
+    if (config.verbose)
+        std::cout << "Encoding " << vocab_size << " vectors" << std::endl;
+    const int batch_size = 4096;
+    vector<int> word_lists(vocab_size, 0);
+    vector<uint8_t> all_codes(vocab_size * m);
+
+    parallelFor((vocab_size + batch_size - 1) / batch_size, config.threads, [&](long long begin, long long end) {
+        vector<int> rows, assignment;
+        for (long long b = begin; b < end; ++b) {
+            rows.clear();
+            for (long long i = b * batch_size; i < std::min((b + 1) * batch_size, vocab_size); ++i) rows.push_back(i);
+
+            Matrix batch(model.input_weights, rows);
+            batch.normalizeRows();
+            if (n_lists > 1) {
+                assign(batch, coarse, assignment, 1);
+                subtractCentroids(batch, coarse, assignment);
+                for (size_t i = 0; i < rows.size(); ++i) word_lists[rows[i]] = assignment[i];
+            }
+
+            for (int j = 0; j < m; ++j) {
+                assign(columns(batch, j * sub_dimension, sub_dimension), codebooks[j], assignment, 1);
+                for (size_t i = 0; i < rows.size(); ++i) all_codes[static_cast<size_t>(rows[i]) * m + j] = assignment[i];
+            }
+        }
+    });
+
+    // sort the words by list (counting sort)
+    vector<uint64_t> list_offsets(n_lists + 1, 0);
+    for (long long i = 0; i < vocab_size; ++i) list_offsets[word_lists[i] + 1]++;
+    for (int l = 0; l < n_lists; ++l) list_offsets[l + 1] += list_offsets[l];
+
+    vector<uint32_t> ids(vocab_size), positions(vocab_size);
+    vector<uint8_t> sorted_codes(all_codes.size());
+    vector<uint64_t> next(list_offsets.begin(), list_offsets.end() - 1);
+    for (long long i = 0; i < vocab_size; ++i) {
+        uint64_t pos = next[word_lists[i]]++;
+        ids[pos] = i;
+        positions[i] = pos;
+        std::copy(all_codes.begin() + i * m, all_codes.begin() + (i + 1) * m, sorted_codes.begin() + pos * m);
+    }
+
+    // save the index
+    ofstream outfile(filename, ios::binary | ios::out);
+    check_is_open(outfile, filename);
+
+    vector<const HuffmanNode*> nodes(model.vocabulary.size());
+    for (auto it = model.vocabulary.begin(); it != model.vocabulary.end(); ++it) {
+        nodes[it->second.index] = &it->second;
+    }
+
+    PQHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PQ_MAGIC, sizeof(PQ_MAGIC));
+    header.version = PQ_VERSION;
+    header.header_size = sizeof(PQHeader);
+    header.dimension = d;
+    header.subquantizers = m;
+    header.centroids = PQ_CENTROIDS;
+    header.lists = n_lists;
+    header.vocab_size = vocab_size;
+
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header)); // written again at the end
+
+    writeFlatVocabulary(outfile, nodes, false, header.words_offset, header.sorted_offset, header.strings_offset);
+
+    header.codebooks_offset = alignFlat(outfile);
+    for (auto it = codebooks.begin(); it != codebooks.end(); ++it) {
+        outfile.write(reinterpret_cast<const char*>(it->row(0)), sizeof(float) * it->rows() * it->cols());
+    }
+    header.coarse_offset = writeSection(outfile, coarse.row(0), static_cast<size_t>(coarse.rows()) * coarse.cols());
+    header.list_offsets_offset = writeSection(outfile, list_offsets.data(), list_offsets.size());
+    header.ids_offset = writeSection(outfile, ids.data(), ids.size());
+    header.positions_offset = writeSection(outfile, positions.data(), positions.size());
+    header.codes_offset = writeSection(outfile, sorted_codes.data(), sorted_codes.size());
+    header.file_size = outfile.tellp();
+
+    outfile.seekp(0);
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    if (!outfile) {
+        throw runtime_error("couldn't write file " + filename);
+    }
+}
+
+void PQIndex::open(const string& filename) {
+    file.open(filename);
+
+    header = reinterpret_cast<const PQHeader*>(file.data());
+    if (file.size() < sizeof(PQHeader) || memcmp(header->magic, PQ_MAGIC, sizeof(PQ_MAGIC)) != 0) {
+        file.close();
+        throw runtime_error("not a PQ index file: " + filename);
+    }
+    if (header->version > PQ_VERSION || header->centroids != PQ_CENTROIDS) {
+        file.close();
+        throw runtime_error("unsupported version of the PQ index format: " + filename);
+    }
+    if (header->file_size != file.size()) {
+        file.close();
+        throw runtime_error("truncated PQ index file: " + filename);
+    }
+
+    // the sections are read without bound checks
+    uint64_t size = file.size(), vocab_size = header->vocab_size;
+    uint64_t d = header->dimension, m = header->subquantizers;
+    bool valid = d > 0 && m > 0 && d % m == 0 && header->lists > 0
+        && flatVocabularyFits(vocab_size, header->words_offset, header->sorted_offset, header->strings_offset, size)
+        && flatSectionFits(header->codebooks_offset, m * PQ_CENTROIDS, d / m * sizeof(float), size)
+        && flatSectionFits(header->coarse_offset, header->lists, d * sizeof(float), size)
+        && flatSectionFits(header->list_offsets_offset, header->lists + 1ULL, sizeof(uint64_t), size)
+        && flatSectionFits(header->ids_offset, vocab_size, sizeof(uint32_t), size)
+        && flatSectionFits(header->positions_offset, vocab_size, sizeof(uint32_t), size)
+        && flatSectionFits(header->codes_offset, vocab_size, m, size);
+    if (valid) { // the lists cover the positions [0, vocab_size), in order
+        const uint64_t* offsets = reinterpret_cast<const uint64_t*>(file.data() + header->list_offsets_offset);
+        valid = offsets[0] == 0 && offsets[header->lists] == vocab_size;
+        for (uint32_t l = 0; l < header->lists && valid; ++l) valid = offsets[l] <= offsets[l + 1];
+    }
+    if (!valid) {
+        file.close();
+        throw runtime_error("invalid PQ index file (sections out of the file): " + filename);
+    }
+
+    words = reinterpret_cast<const FlatWord*>(file.data() + header->words_offset);
+    sorted = reinterpret_cast<const uint32_t*>(file.data() + header->sorted_offset);
+    strings = file.data() + header->strings_offset;
+    codebooks = reinterpret_cast<const float*>(file.data() + header->codebooks_offset);
+    coarse = reinterpret_cast<const float*>(file.data() + header->coarse_offset);
+    list_offsets = reinterpret_cast<const uint64_t*>(file.data() + header->list_offsets_offset);
+    ids = reinterpret_cast<const uint32_t*>(file.data() + header->ids_offset);
+    positions = reinterpret_cast<const uint32_t*>(file.data() + header->positions_offset);
+    codes = reinterpret_cast<const uint8_t*>(file.data() + header->codes_offset);
+}
+
+int PQIndex::index(const string& word) const {
+    return findWord(words, sorted, strings, header->vocab_size, word);
+}
+
+vec PQIndex::reconstruct(int index) const {
+    uint64_t pos = positions[index];
+    int list = std::upper_bound(list_offsets, list_offsets + header->lists + 1, pos) - list_offsets - 1;
+
+    int d = header->dimension;
+    int sub_dimension = subDimension();
+    vec res(coarse + static_cast<size_t>(list) * d, coarse + static_cast<size_t>(list + 1) * d);
+    const uint8_t* code = codes + pos * header->subquantizers;
+    for (int j = 0; j < header->subquantizers; ++j) {
+        const float* c = centroid(j, code[j]);
+        for (int k = 0; k < sub_dimension; ++k) res[j * sub_dimension + k] += c[k];
+    }
+    return res;
+}
+
+vector<pair<string, float>> PQIndex::closest(const string& word, int n, int probes) const {
+    int i = index(word);
+    if (i == -1) {
+        throw runtime_error("OOV word");
+    }
+
+    auto res = closest(reconstruct(i), n + 1, probes);
+    res.erase(std::remove_if(res.begin(), res.end(), [&](const pair<string, float>& p) { return p.first == word; }),
+              res.end());
+    if (res.size() > n) res.resize(n);
+    return res;
+}
+
+vector<pair<string, float>> PQIndex::closest(const vec& v, int n, int probes) const {
+    PROFILE_SCOPE("PQIndex::closest");
+    int d = header->dimension;
+    int m = header->subquantizers;
+    int sub_dimension = subDimension();
+    if (v.size() != d) {
+        throw runtime_error("wrong dimension");
+    }
+
+    vec query = v;
+    float norm = query.norm();
+    if (norm > 0) query /= norm;
+
+    // dot products of the query with all the centroids: the score of a vector is then a sum of m values
+    vector<float> table(static_cast<size_t>(m) * PQ_CENTROIDS);
+    for (int j = 0; j < m; ++j) {
+        for (int c = 0; c < PQ_CENTROIDS; ++c) {
+            table[j * PQ_CENTROIDS + c] = dot(query.data() + j * sub_dimension, centroid(j, c), sub_dimension);
+        }
+    }
+
+    // closest lists
+    int n_lists = header->lists;
+    vector<pair<float, int>> list_scores(n_lists);
+    for (int l = 0; l < n_lists; ++l) {
+        list_scores[l] = {dot(query.data(), coarse + static_cast<size_t>(l) * d, d), l};
+    }
+    probes = probes <= 0 ? n_lists : std::min(probes, n_lists);
+    std::partial_sort(list_scores.begin(), list_scores.begin() + probes, list_scores.end(),
+                      std::greater<pair<float, int>>());
+
+    typedef pair<float, int> Score;
+    std::priority_queue<Score, vector<Score>, std::greater<Score>> heap; // n best scores
+    for (int p = 0; p < probes && n > 0; ++p) {
+        int l = list_scores[p].second;
+        for (uint64_t pos = list_offsets[l]; pos < list_offsets[l + 1]; ++pos) {
+            const uint8_t* code = codes + pos * m;
+            float score = list_scores[p].first;
+            for (int j = 0; j < m; ++j) score += table[j * PQ_CENTROIDS + code[j]];
+
+            if (heap.size() < n) {
+                heap.push({score, static_cast<int>(ids[pos])});
+            } else if (score > heap.top().first) {
+                heap.pop();
+                heap.push({score, static_cast<int>(ids[pos])});
+            }
+        }
+    }
+
+    vector<pair<string, float>> res(heap.size());
+    for (int i = heap.size() - 1; i >= 0; --i, heap.pop()) {
+        res[i] = {word(heap.top().second), heap.top().first};
+    }
+    return res;
+}
+
+vector<pair<string, int>> PQIndex::getWords() const {
+    vector<pair<string, int>> res;
+    for (long long i = 0; i < header->vocab_size; ++i) {
+        res.push_back({word(i), count(i)});
+    }
+    return res;
+}
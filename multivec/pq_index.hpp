@@ -0,0 +1,122 @@
+#pragma once
+#include "flat_model.hpp"
+
+/**
+ * Product quantization index (Jegou et al., 2011): compressed normalized word embeddings, for
+ * nearest neighbor search with little memory (see PQIndex). Built from a model with PQIndex::build.
+ *
+ * Each vector is split into `subquantizers` sub-vectors, and each sub-vector is encoded with one byte:
+ * the index of its closest centroid in the codebook of this sub-space (PQ_CENTROIDS centroids, trained
+ * with k-means). With an inverted file (IVF), the vectors are first assigned to the closest of `lists`
+ * coarse centroids, and the residuals (vector minus coarse centroid) are encoded.
+ *
+ * Layout (native byte order):
+ *   PQHeader     (128 bytes)
+ *   words        FlatWord[vocab_size], in index order (no Huffman codes: code_size is 0)
+ *   sorted       uint32[vocab_size], word indices in lexicographical order
+ *   strings      the words, '\0'-terminated
+ *   codebooks    float32[subquantizers][PQ_CENTROIDS][dimension / subquantizers]
+ *   coarse       float32[lists][dimension], coarse centroids (zeros without IVF, where lists is 1)
+ *   list_offsets uint64[lists + 1], list l is at positions [list_offsets[l], list_offsets[l + 1])
+ *   ids          uint32[vocab_size], word index at each position (words sorted by list)
+ *   positions    uint32[vocab_size], position of each word index (inverse of ids)
+ *   codes        uint8[vocab_size][subquantizers], codes at each position
+ * Each section starts at a multiple of FLAT_ALIGNMENT bytes.
+ */
+
+const char PQ_MAGIC[8] = {'M', 'V', 'P', 'Q', '\0', '\0', '\0', '\0'};
+const uint32_t PQ_VERSION = 1;
+const int PQ_CENTROIDS = 256; // codes are bytes
+
+struct PQHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t dimension;
+    uint32_t subquantizers;
+    uint32_t centroids; // PQ_CENTROIDS
+    uint32_t lists;
+
+    uint64_t vocab_size;
+    uint64_t words_offset;
+    uint64_t sorted_offset;
+    uint64_t strings_offset;
+    uint64_t codebooks_offset;
+    uint64_t coarse_offset;
+    uint64_t list_offsets_offset;
+    uint64_t ids_offset;
+    uint64_t positions_offset;
+    uint64_t codes_offset;
+    uint64_t file_size;
+
+    uint8_t reserved[8]; // for future versions
+};
+
+static_assert(sizeof(PQHeader) == 128, "unexpected size of PQHeader");
+
+struct PQConfig {
+    int subquantizers; // bytes per vector, must divide the dimension (0: dimension / 4, or the closest divisor)
+    int lists; // number of inverted lists (IVF), 0 for exhaustive search
+    int iterations; // k-means iterations
+    long long training_size; // number of vectors (randomly sampled) on which the centroids are trained
+    int threads;
+    bool verbose;
+
+    PQConfig() : subquantizers(0), lists(0), iterations(10), training_size(100000), threads(4), verbose(false) {}
+};
+
+class MonolingualModel;
+
+/**
+ * @brief Read-only product quantization index, mapped in memory (like FlatModel). `closest` uses
+ * asymmetric distances: the query isn't quantized, its dot products with all the centroids are computed
+ * once (lookup table), and the score of a word is a sum of `subquantizers` values of this table.
+ * With IVF, only the words of the `probes` closest lists are scored.
+ *
+ * Scores are approximate cosine similarities (the vectors are normalized before quantization).
+ */
+class PQIndex {
+    MappedFile file;
+    const PQHeader* header;
+
+    const FlatWord* words;
+    const uint32_t* sorted;
+    const char* strings;
+    const float* codebooks;
+    const float* coarse;
+    const uint64_t* list_offsets;
+    const uint32_t* ids;
+    const uint32_t* positions;
+    const uint8_t* codes;
+
+    int subDimension() const { return header->dimension / header->subquantizers; }
+    const float* centroid(int subquantizer, int code) const {
+        return codebooks + (static_cast<size_t>(subquantizer) * PQ_CENTROIDS + code) * subDimension();
+    }
+
+public:
+    PQIndex() : header(0), words(0), sorted(0), strings(0), codebooks(0), coarse(0), list_offsets(0), ids(0),
+                positions(0), codes(0) {}
+    PQIndex(const string& filename) : PQIndex() { open(filename); }
+
+    // trains the codebooks on the input weights of `model`, encodes all the words, and saves the index
+    static void build(const MonolingualModel& model, const string& filename, const PQConfig& config = PQConfig());
+
+    void open(const string& filename);
+
+    int getDimension() const { return header->dimension; }
+    long long size() const { return header->vocab_size; }
+    int subquantizers() const { return header->subquantizers; }
+    int lists() const { return header->lists; }
+
+    int index(const string& word) const; // index of this word, or -1 if it is OOV
+    string word(int index) const { return string(strings + words[index].string_offset, words[index].string_size); }
+    int count(int index) const { return words[index].count; }
+
+    vec reconstruct(int index) const; // approximation of the normalized vector of this word
+
+    // `probes` lists are searched with IVF (0 for all the lists)
+    vector<pair<string, float>> closest(const string& word, int n = 10, int probes = 8) const; // query: reconstructed vector
+    vector<pair<string, float>> closest(const vec& v, int n = 10, int probes = 8) const;
+    vector<pair<string, int>> getWords() const;
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+/**
+ * Hot-path profiling, compiled only with the MULTIVEC_PROFILE CMake option (cmake -DMULTIVEC_PROFILE=ON).
+ *
+ * PROFILE_SCOPE("name") measures the time spent in the enclosing scope, and counts its calls.
+ * Each thread accumulates its own counters (no synchronization), which are merged into a global table
+ * when the thread exits. The table is printed to stderr at the end of the program.
+ *
+ * Without MULTIVEC_PROFILE, PROFILE_SCOPE expands to nothing.
+ */
+#ifdef MULTIVEC_PROFILE
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <algorithm>
+
+namespace profile {
+
+struct Stage {
+    long long calls;
+    long long nanoseconds;
+    int threads; // number of threads that went through this stage
+    Stage() : calls(0), nanoseconds(0), threads(0) {}
+};
+
+class Registry {
+    std::mutex mutex;
+    std::vector<std::string> names;
+    std::vector<Stage> totals;
+
+public:
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    int id(const char* name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find(names.begin(), names.end(), name);
+        if (it != names.end()) return it - names.begin();
+        names.push_back(name);
+        totals.push_back(Stage());
+        return names.size() - 1;
+    }
+
+    void merge(const std::vector<Stage>& stages) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < stages.size(); ++i) {
+            if (stages[i].calls == 0) continue;
+            totals[i].calls += stages[i].calls;
+            totals[i].nanoseconds += stages[i].nanoseconds;
+            totals[i].threads += 1;
+        }
+    }
+
+    ~Registry() { // at exit, after the thread-local counters of the main thread are merged
+        std::vector<int> order;
+        for (int i = 0; i < names.size(); ++i) order.push_back(i);
+        std::sort(order.begin(), order.end(), [&](int i, int j) { return totals[i].nanoseconds > totals[j].nanoseconds; });
+
+        fprintf(stderr, "\n%-36s %14s %12s %12s %8s\n", "stage", "calls", "time (s)", "ns/call", "threads");
+        for (auto it = order.begin(); it != order.end(); ++it) {
+            const Stage& stage = totals[*it];
+            if (stage.calls == 0) continue;
+            fprintf(stderr, "%-36s %14lld %12.3f %12.1f %8d\n", names[*it].c_str(), stage.calls,
+                    stage.nanoseconds / 1e9, static_cast<double>(stage.nanoseconds) / stage.calls, stage.threads);
+        }
+    }
+};
+
+struct ThreadCounters {
+    std::vector<Stage> stages;
+
+    Stage& get(int id) {
+        if (id >= stages.size()) stages.resize(id + 1);
+        return stages[id];
+    }
+
+    ~ThreadCounters() {
+        Registry::instance().merge(stages);
+    }
+};
+
+inline ThreadCounters& threadCounters() {
+    thread_local ThreadCounters counters;
+    return counters;
+}
+
+class ScopedTimer {
+    int id;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    ScopedTimer(int id) : id(id), start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        auto end = std::chrono::steady_clock::now();
+        Stage& stage = threadCounters().get(id); // not kept during the scope: nested timers may resize the vector
+        stage.calls += 1;
+        stage.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+};
+
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) \
+    static const int PROFILE_CONCAT(profile_id_, __LINE__) = profile::Registry::instance().id(name); \
+    profile::ScopedTimer PROFILE_CONCAT(profile_timer_, __LINE__)(PROFILE_CONCAT(profile_id_, __LINE__))
+
+#else
+
+#define PROFILE_SCOPE(name)
+
+#endif
@@ -0,0 +1,436 @@
+#include "quantized.hpp"
+#include "monolingual.hpp"
+#include <cstring>
+#include <queue>
+#include <mutex>
+
+// AVX2 kernels, selected at runtime (the rest of the code is compiled for the baseline architecture)
+#if !defined(MULTIVEC_NO_SIMD) && defined(__GNUC__) && defined(__x86_64__)
+#define MULTIVEC_AVX2
+#include <immintrin.h>
+#endif
+
+uint16_t floatToHalf(float value) {
+    uint32_t x;
+    memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t mantissa = x & 0x7fffff;
+    int exponent = static_cast<int>((x >> 23) & 0xff) - 127 + 15;
+
+    if (exponent == 128 + 15) { // infinity or NaN
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    } else if (exponent >= 31) { // overflow
+        return sign | 0x7c00;
+    } else if (exponent <= 0) { // subnormal (or zero)
+        if (exponent < -10) return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) ++half;
+        return sign | half;
+    }
+
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) ++half; // may carry into the exponent, which is correct
+    return half;
+}
+
+float halfToFloat(uint16_t value) {
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t x;
+
+    if (exponent == 0) { // subnormal (or zero)
+        float f = mantissa * 5.9604645e-8f; // 2^-24
+        return sign ? -f : f;
+    } else if (exponent == 31) {
+        x = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+namespace {
+
+// fp16 to float32 for all the 65536 values (the portable kernel would spend most of its time converting)
+const float* halfTable() {
+    static vector<float> table;
+    static std::once_flag flag;
+    std::call_once(flag, [] {
+        table.resize(1 << 16);
+        for (size_t i = 0; i < table.size(); ++i) table[i] = halfToFloat(i);
+    });
+    return table.data();
+}
+
+int32_t dotInt8(const int8_t* x, const int8_t* y, int size) {
+    int32_t sum = 0;
+    for (int i = 0; i < size; ++i) sum += x[i] * y[i];
+    return sum;
+}
+
+float dotHalf(const uint16_t* x, const float* y, int size) {
+    const float* table = halfTable();
+    float sum = 0;
+    for (int i = 0; i < size; ++i) sum += table[x[i]] * y[i];
+    return sum;
+}
+
+#ifdef MULTIVEC_AVX2
+// `size` is a multiple of 32, values are in [-127, 127] (no overflow of the 16-bit sums of maddubs)
+__attribute__((target("avx2")))
+int32_t dotInt8AVX2(const int8_t* x, const int8_t* y, int size) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < size; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + i));
+        // maddubs multiplies unsigned by signed bytes: |a| * (b * sign(a)) == a * b
+        __m256i products = _mm256_maddubs_epi16(_mm256_sign_epi8(a, a), _mm256_sign_epi8(b, a));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+    }
+    __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    sum128 = _mm_hadd_epi32(sum128, sum128);
+    sum128 = _mm_hadd_epi32(sum128, sum128);
+    return _mm_cvtsi128_si32(sum128);
+}
+
+// `size` is a multiple of 16
+__attribute__((target("avx2,f16c,fma")))
+float dotHalfAVX2(const uint16_t* x, const float* y, int size) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    for (int i = 0; i < size; i += 16) {
+        __m256 a0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+        __m256 a1 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i + 8)));
+        sum0 = _mm256_fmadd_ps(a0, _mm256_loadu_ps(y + i), sum0);
+        sum1 = _mm256_fmadd_ps(a1, _mm256_loadu_ps(y + i + 8), sum1);
+    }
+    __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 sum128 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    sum128 = _mm_hadd_ps(sum128, sum128);
+    sum128 = _mm_hadd_ps(sum128, sum128);
+    return _mm_cvtss_f32(sum128);
+}
+
+bool hasAVX2() {
+    static bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c") && __builtin_cpu_supports("fma");
+    return avx2;
+}
+#endif
+
+int8_t quantizeValue(float value, float scale) {
+    return static_cast<int8_t>(std::max(-127.0f, std::min(127.0f, std::round(value / scale))));
+}
+
+float maxAbs(const float* data, int size) {
+    float res = 0;
+    for (int i = 0; i < size; ++i) res = std::max(res, std::abs(data[i]));
+    return res;
+}
+
+}
+
+bool QuantizedModel::simd() {
+#ifdef MULTIVEC_AVX2
+    return hasAVX2();
+#else
+    return false;
+#endif
+}
+
+bool QuantizedModel::isQuantized(const string& filename) {
+    ifstream infile(filename, ios::binary);
+    char magic[sizeof(QUANTIZED_MAGIC)] = {0};
+    infile.read(magic, sizeof(magic));
+    return infile && memcmp(magic, QUANTIZED_MAGIC, sizeof(magic)) == 0;
+}
+
+void QuantizedModel::open(const string& filename) {
+    file.open(filename);
+
+    header = reinterpret_cast<const QuantizedHeader*>(file.data());
+    if (file.size() < sizeof(QuantizedHeader) || memcmp(header->magic, QUANTIZED_MAGIC, sizeof(QUANTIZED_MAGIC)) != 0) {
+        file.close();
+        throw runtime_error("not a quantized model file: " + filename);
+    }
+    if (header->version > QUANTIZED_VERSION) {
+        file.close();
+        throw runtime_error("unsupported version of the quantized model format: " + filename);
+    }
+    if (header->file_size != file.size()) {
+        file.close();
+        throw runtime_error("truncated quantized model file: " + filename);
+    }
+    if (header->type != QUANTIZED_INT8 && header->type != QUANTIZED_FP16) {
+        file.close();
+        throw runtime_error("unknown type of quantized vectors: " + filename);
+    }
+
+    // the sections are read without bound checks, and the rows by blocks of QUANTIZED_ROW_ALIGNMENT bytes
+    uint64_t size = file.size(), vocab_size = header->vocab_size;
+    uint64_t value_size = header->type == QUANTIZED_INT8 ? sizeof(int8_t) : sizeof(uint16_t);
+    if (header->dimension == 0 || header->stride % QUANTIZED_ROW_ALIGNMENT != 0
+        || header->stride < header->dimension * value_size
+        || !flatVocabularyFits(vocab_size, header->words_offset, header->sorted_offset, header->strings_offset, size)
+        || !flatSectionFits(header->data_offset, vocab_size, header->stride, size)
+        || (header->type == QUANTIZED_INT8 && !flatSectionFits(header->scales_offset, vocab_size, sizeof(float), size))
+        || !flatSectionFits(header->norms_offset, vocab_size, sizeof(float), size)) {
+        file.close();
+        throw runtime_error("invalid quantized model file (sections out of the file): " + filename);
+    }
+
+    words = reinterpret_cast<const FlatWord*>(file.data() + header->words_offset);
+    sorted = reinterpret_cast<const uint32_t*>(file.data() + header->sorted_offset);
+    strings = file.data() + header->strings_offset;
+    scales = reinterpret_cast<const float*>(file.data() + header->scales_offset);
+    norms = reinterpret_cast<const float*>(file.data() + header->norms_offset);
+    data = file.data() + header->data_offset;
+    rescoring = 0;
+}
+
+void QuantizedModel::setRescoring(const FlatModel* model) {
+    if (model && (model->size() != size() || (size() > 0 && model->wordVec(0, header->policy).size() != getDimension()))) {
+        throw runtime_error("the flat model doesn't match the quantized model");
+    }
+    rescoring = model;
+}
+
+int QuantizedModel::index(const string& word) const {
+    return findWord(words, sorted, strings, header->vocab_size, word);
+}
+
+vec QuantizedModel::wordVec(int index) const {
+    int d = header->dimension;
+    vec res(d);
+    if (header->type == QUANTIZED_INT8) {
+        const int8_t* values = reinterpret_cast<const int8_t*>(row(index));
+        for (int c = 0; c < d; ++c) res[c] = scales[index] * values[c];
+    } else {
+        const uint16_t* values = reinterpret_cast<const uint16_t*>(row(index));
+        for (int c = 0; c < d; ++c) res[c] = halfToFloat(values[c]);
+    }
+    return res;
+}
+
+vec QuantizedModel::wordVec(const string& word) const {
+    int i = index(word);
+    if (i == -1) {
+        throw runtime_error("out of vocabulary");
+    }
+    return wordVec(i);
+}
+
+/**
+ * @brief Query vector in the format of the dot product: int8 values with their scale (and the same
+ * padding as the rows), or float32 values for fp16 rows.
+ */
+vector<char> QuantizedModel::quantize(const vec& v, float& scale) const {
+    int d = header->dimension;
+    vector<char> res(header->type == QUANTIZED_INT8 ? header->stride : header->stride / 2 * sizeof(float), 0);
+
+    if (header->type == QUANTIZED_INT8) {
+        scale = maxAbs(v.data(), d) / 127;
+        int8_t* values = reinterpret_cast<int8_t*>(res.data());
+        for (int c = 0; c < d && scale > 0; ++c) values[c] = quantizeValue(v[c], scale);
+    } else {
+        scale = 1;
+        memcpy(res.data(), v.data(), d * sizeof(float));
+    }
+    return res;
+}
+
+float QuantizedModel::dot(const char* query, float query_scale, int index) const {
+    if (header->type == QUANTIZED_INT8) {
+        const int8_t* x = reinterpret_cast<const int8_t*>(row(index));
+        const int8_t* y = reinterpret_cast<const int8_t*>(query);
+#ifdef MULTIVEC_AVX2
+        if (hasAVX2()) return dotInt8AVX2(x, y, header->stride) * query_scale * scales[index];
+#endif
+        return dotInt8(x, y, header->dimension) * query_scale * scales[index];
+    } else {
+        const uint16_t* x = reinterpret_cast<const uint16_t*>(row(index));
+        const float* y = reinterpret_cast<const float*>(query);
+#ifdef MULTIVEC_AVX2
+        if (hasAVX2()) return dotHalfAVX2(x, y, header->stride / 2);
+#endif
+        return dotHalf(x, y, header->dimension);
+    }
+}
+
+float QuantizedModel::similarity(const string& word1, const string& word2) const {
+    int index1 = index(word1);
+    int index2 = index(word2);
+
+    if (index1 == -1 || index2 == -1) {
+        return 0.0;
+    } else if (index1 == index2) {
+        return 1.0;
+    } else if (norms[index1] == 0 || norms[index2] == 0) {
+        return 0.0;
+    }
+
+    float scale;
+    vector<char> query = quantize(wordVec(index1), scale);
+    return dot(query.data(), scale, index2) / (norms[index1] * norms[index2]);
+}
+
+vector<pair<string, float>> QuantizedModel::closest(const string& word, int n, int rescore) const {
+    int i = index(word);
+    if (i == -1) {
+        throw runtime_error("OOV word");
+    }
+
+    vec v = rescoring ? rescoring->wordVec(i, header->policy) : wordVec(i);
+    auto res = closest(v, n + 1, rescore > 0 ? rescore + 1 : 0);
+    res.erase(std::remove_if(res.begin(), res.end(), [&](const pair<string, float>& p) { return p.first == word; }),
+              res.end());
+    if (res.size() > n) res.resize(n);
+    return res;
+}
+
+/**
+ * @brief The `n` closest words to `v` by cosine similarity, computed on the quantized rows. With a
+ * rescoring model (see setRescoring), the `rescore` best candidates are then sorted by their exact
+ * similarity, which gives the same results as float32 when `rescore` is large enough (e.g., 4n).
+ */
+vector<pair<string, float>> QuantizedModel::closest(const vec& v, int n, int rescore) const {
+    PROFILE_SCOPE("QuantizedModel::closest");
+    if (v.size() != getDimension()) {
+        throw runtime_error("wrong dimension");
+    }
+
+    int k = rescoring ? std::max(n, rescore) : n;
+    k = static_cast<int>(std::min(static_cast<long long>(k), size()));
+
+    float norm = v.norm();
+    float scale;
+    vector<char> query = quantize(v, scale);
+
+    // k best scores (min-heap)
+    typedef pair<float, int> Score;
+    std::priority_queue<Score, vector<Score>, std::greater<Score>> heap;
+    for (long long i = 0; i < size() && k > 0; ++i) {
+        float score = norms[i] == 0 || norm == 0 ? 0 : dot(query.data(), scale, i) / (norm * norms[i]);
+        if (heap.size() < k) {
+            heap.push({score, static_cast<int>(i)});
+        } else if (score > heap.top().first) {
+            heap.pop();
+            heap.push({score, static_cast<int>(i)});
+        }
+    }
+
+    vector<Score> scores;
+    for (; !heap.empty(); heap.pop()) scores.push_back(heap.top());
+
+    if (rescoring) {
+        for (auto it = scores.begin(); it != scores.end(); ++it) {
+            it->first = cosineSimilarity(v, rescoring->wordVec(it->second, header->policy));
+        }
+    }
+
+    std::sort(scores.begin(), scores.end(), std::greater<Score>());
+    if (scores.size() > n) scores.resize(n);
+
+    vector<pair<string, float>> res;
+    for (auto it = scores.begin(); it != scores.end(); ++it) {
+        res.push_back({word(it->second), it->first});
+    }
+    return res;
+}
+
+vector<pair<string, int>> QuantizedModel::getWords() const {
+    vector<pair<string, int>> res;
+    for (long long i = 0; i < header->vocab_size; ++i) {
+        res.push_back({word(i), count(i)});
+    }
+    return res;
+}
+
+/**
+ * @brief Save the word embeddings (with this saving policy) in the quantized format, with 8-bit
+ * integers (one scale per row) or 16-bit floats (`fp16`). See QuantizedModel.
+ */
+void MonolingualModel::saveQuantized(const string& filename, bool fp16, int policy) const {
+    if (config->verbose)
+        std::cout << "Saving " << (fp16 ? "fp16" : "int8") << " embeddings to " << filename << std::endl;
+
+    checkPolicy(policy);
+    ofstream outfile(filename, ios::binary | ios::out);
+    check_is_open(outfile, filename);
+
+    vector<const HuffmanNode*> nodes(vocabulary.size());
+    for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
+        nodes[it->second.index] = &it->second;
+    }
+
+    int d = wordVecSize(policy);
+    size_t row_size = fp16 ? d * sizeof(uint16_t) : d;
+
+    QuantizedHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, QUANTIZED_MAGIC, sizeof(QUANTIZED_MAGIC));
+    header.version = QUANTIZED_VERSION;
+    header.header_size = sizeof(QuantizedHeader);
+    header.type = fp16 ? QUANTIZED_FP16 : QUANTIZED_INT8;
+    header.policy = policy;
+    header.dimension = d;
+    header.stride = (row_size + QUANTIZED_ROW_ALIGNMENT - 1) / QUANTIZED_ROW_ALIGNMENT * QUANTIZED_ROW_ALIGNMENT;
+    header.vocab_size = nodes.size();
+
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header)); // written again at the end
+
+    writeFlatVocabulary(outfile, nodes, false, header.words_offset, header.sorted_offset, header.strings_offset);
+
+    vector<float> scales(nodes.size(), 1), norms(nodes.size());
+    vector<char> row(header.stride);
+    vector<float> buffer(d);
+    header.data_offset = alignFlat(outfile);
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const float* v = wordVecData(i, policy, buffer.data());
+        std::fill(row.begin(), row.end(), 0);
+        double norm = 0;
+
+        if (fp16) {
+            uint16_t* values = reinterpret_cast<uint16_t*>(row.data());
+            for (int c = 0; c < d; ++c) {
+                values[c] = floatToHalf(v[c]);
+                float x = halfToFloat(values[c]);
+                norm += x * x;
+            }
+        } else {
+            int8_t* values = reinterpret_cast<int8_t*>(row.data());
+            scales[i] = maxAbs(v, d) / 127;
+            for (int c = 0; c < d && scales[i] > 0; ++c) {
+                values[c] = quantizeValue(v[c], scales[i]);
+                norm += static_cast<double>(values[c]) * values[c];
+            }
+            norm *= scales[i] * scales[i];
+        }
+        norms[i] = sqrt(norm);
+        outfile.write(row.data(), row.size());
+    }
+
+    if (!fp16) {
+        header.scales_offset = alignFlat(outfile);
+        outfile.write(reinterpret_cast<const char*>(scales.data()), sizeof(float) * scales.size());
+    }
+    header.norms_offset = alignFlat(outfile);
+    outfile.write(reinterpret_cast<const char*>(norms.data()), sizeof(float) * norms.size());
+    header.file_size = outfile.tellp();
+
+    outfile.seekp(0);
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    if (!outfile) {
+        throw runtime_error("couldn't write file " + filename);
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "flat_model.hpp"
+
+/**
+ * Quantized vectors format: word embeddings with 8-bit integers or 16-bit floats instead of float32,
+ * for serving (see QuantizedModel). Saved with MonolingualModel::saveQuantized.
+ *
+ * Layout (native byte order):
+ *   QuantizedHeader (128 bytes)
+ *   words           FlatWord[vocab_size], in index order (no Huffman codes: code_size is 0)
+ *   sorted          uint32[vocab_size], word indices in lexicographical order
+ *   strings         the words, '\0'-terminated
+ *   data            int8[vocab_size][stride] or fp16[vocab_size][stride / 2], rows padded with zeros
+ *   scales          float32[vocab_size], int8 only: row i is scales[i] * data[i]
+ *   norms           float32[vocab_size], norm of each (dequantized) row
+ * Each section starts at a multiple of FLAT_ALIGNMENT bytes, and rows are aligned on 32 bytes (AVX2).
+ */
+
+const char QUANTIZED_MAGIC[8] = {'M', 'V', 'Q', 'U', 'A', 'N', 'T', '\0'};
+const uint32_t QUANTIZED_VERSION = 1;
+const uint32_t QUANTIZED_ROW_ALIGNMENT = 32;
+
+enum QuantizedType : uint32_t { QUANTIZED_INT8 = 1, QUANTIZED_FP16 = 2 };
+
+struct QuantizedHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t type; // QuantizedType
+    uint32_t policy; // saving policy of the vectors (see MonolingualModel::wordVec)
+    uint32_t dimension;
+    uint32_t stride; // size of a row in bytes
+
+    uint64_t vocab_size;
+    uint64_t words_offset;
+    uint64_t sorted_offset;
+    uint64_t strings_offset;
+    uint64_t data_offset;
+    uint64_t scales_offset;
+    uint64_t norms_offset;
+    uint64_t file_size;
+
+    uint8_t reserved[32]; // for future versions
+};
+
+static_assert(sizeof(QuantizedHeader) == 128, "unexpected size of QuantizedHeader");
+
+uint16_t floatToHalf(float value); // IEEE 754 binary16, round to nearest even
+float halfToFloat(uint16_t value);
+
+/**
+ * @brief Read-only quantized word embeddings, mapped in memory (like FlatModel). Similarities are
+ * computed directly on the quantized rows (with AVX2 when the CPU supports it). Rows take 4x (int8)
+ * or 2x (fp16) less memory than float32, and are scanned correspondingly faster.
+ *
+ * `closest` can rescore its best candidates with the exact float32 vectors of a flat model
+ * (see `setRescoring`), which only reads the rows of these candidates.
+ */
+class QuantizedModel {
+    MappedFile file;
+    const QuantizedHeader* header;
+
+    const FlatWord* words;
+    const uint32_t* sorted;
+    const char* strings;
+    const float* scales;
+    const float* norms;
+    const char* data;
+
+    const FlatModel* rescoring;
+
+    const char* row(int index) const { return data + static_cast<size_t>(index) * header->stride; }
+    vector<char> quantize(const vec& v, float& scale) const; // query vector, in the format of the rows
+    float dot(const char* query, float query_scale, int index) const; // dot product with a quantized query
+
+public:
+    QuantizedModel() : header(0), words(0), sorted(0), strings(0), scales(0), norms(0), data(0), rescoring(0) {}
+    QuantizedModel(const string& filename) : QuantizedModel() { open(filename); }
+
+    void open(const string& filename);
+    static bool isQuantized(const string& filename); // checks the magic number of this file
+    static bool simd(); // true if the AVX2 implementation is used
+
+    /**
+     * @brief Rescore the best candidates of `closest` with the float32 vectors of `model` (not owned),
+     * which must be the flat model from which these vectors were quantized. Null to disable.
+     */
+    void setRescoring(const FlatModel* model);
+
+    int getDimension() const { return header->dimension; }
+    long long size() const { return header->vocab_size; }
+    QuantizedType getType() const { return static_cast<QuantizedType>(header->type); }
+    const QuantizedHeader& getHeader() const { return *header; }
+
+    int index(const string& word) const; // index of this word, or -1 if it is OOV
+    string word(int index) const { return string(strings + words[index].string_offset, words[index].string_size); }
+    int count(int index) const { return words[index].count; }
+
+    vec wordVec(int index) const; // dequantized vector
+    vec wordVec(const string& word) const;
+
+    float similarity(const string& word1, const string& word2) const;
+    // `rescore` candidates (if larger than n) are rescored with float32 vectors (see setRescoring)
+    vector<pair<string, float>> closest(const string& word, int n = 10, int rescore = 0) const;
+    vector<pair<string, float>> closest(const vec& v, int n = 10, int rescore = 0) const;
+    vector<pair<string, int>> getWords() const;
+};
@@ -0,0 +1,176 @@
+#include "monolingual.hpp"
+
+/**
+ * @brief Cost of the operations on state that is shared by the training threads, with `n_threads`
+ * threads running the same operation concurrently (nanoseconds per operation, in each thread).
+ */
+struct ContentionProbe {
+    float shared_rand;   // multivec::rand (one generator shared by all threads)
+    float private_rand;  // same generator, with a state per thread (no sharing)
+    float shared_counter; // unsynchronized increments of a shared counter (like words_processed)
+
+    ContentionProbe(int n_threads);
+};
+
+static float timeThreads(int n_threads, long long iterations, const std::function<void(long long)>& body) {
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    vector<thread> threads;
+    for (int i = 0; i < n_threads; ++i) {
+        threads.push_back(thread(body, iterations));
+    }
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+        it->join();
+    }
+    high_resolution_clock::time_point end = high_resolution_clock::now();
+    return duration_cast<duration<float, std::nano>>(end - start).count() / iterations;
+}
+
+ContentionProbe::ContentionProbe(int n_threads) {
+    const long long iterations = 20000000;
+    volatile unsigned long long sink;
+    volatile long long counter = 0;
+
+    shared_rand = timeThreads(n_threads, iterations, [&](long long n) {
+        unsigned long long sum = 0;
+        for (long long i = 0; i < n; ++i) sum += multivec::rand();
+        sink = sum;
+    });
+    private_rand = timeThreads(n_threads, iterations, [&](long long n) {
+        unsigned long long next_random = n, sum = 0;
+        for (long long i = 0; i < n; ++i) {
+            next_random = next_random * static_cast<unsigned long long>(25214903917) + 11;
+            sum += next_random >> 16;
+        }
+        sink = sum;
+    });
+    shared_counter = timeThreads(n_threads, iterations, [&](long long n) {
+        for (long long i = 0; i < n; ++i) counter = counter + 1;
+    });
+}
+
+/**
+ * @brief Thread-scaling benchmark. Trains a new model on `training_file` with 1, 2, 4... up to
+ * `max_threads` threads, and reports for each thread count:
+ * - the training speed (words/sec), speed-up and parallel efficiency relatively to one thread;
+ * - the quality of the model (mean loss on config->heldout_file, or on the training file), and its
+ *   drift relatively to one thread (Hogwild updates are lost or overwritten when threads race).
+ *   The initialization and the sampling differ between runs: the 1-thread model is trained several
+ *   times, and the spread of its loss (noise floor) tells which drifts are significant;
+ * - the cost of the shared state: multivec::rand and the words_processed counter.
+ * Finally, the rows that receive the most updates (i.e., the cache lines that the threads compete
+ * for) are estimated from the vocabulary counts, subsampling and unigram distribution.
+ *
+ * The model of the last run is kept.
+ */
+void MonolingualModel::scalingBenchmark(const string& training_file, int max_threads, ostream& output) {
+    if (max_threads < 1) {
+        throw runtime_error("the scaling benchmark needs at least 1 thread");
+    }
+
+    // no held-out evaluation or early stopping during training: runs must be comparable
+    string heldout_file = config->heldout_file;
+    config->heldout_file.clear();
+    const string& eval_file = heldout_file.empty() ? training_file : heldout_file;
+
+    readVocab(training_file);
+
+    vector<int> thread_counts;
+    for (int n = 1; n < max_threads; n *= 2) thread_counts.push_back(n);
+    thread_counts.push_back(max_threads);
+
+    struct Run { int threads; float words_per_sec; float loss; ContentionProbe probe; };
+    vector<Run> runs;
+    const int baseline_runs = 3;
+    vector<float> baseline_losses;
+
+    for (auto it = thread_counts.begin(); it != thread_counts.end(); ++it) {
+        config->threads = *it;
+        int repeats = *it == 1 ? baseline_runs : 1;
+        float words_per_sec = 0, loss = 0; // means of the repeated runs
+
+        for (int i = 0; i < repeats; ++i) {
+            initNet();
+            train(training_file, false);
+
+            float run_loss = heldoutLoss(eval_file);
+            if (*it == 1) baseline_losses.push_back(run_loss);
+            words_per_sec += words_processed / training_time / repeats;
+            loss += run_loss / repeats;
+        }
+        runs.push_back({*it, words_per_sec, loss, ContentionProbe(*it)});
+    }
+
+    config->heldout_file = heldout_file;
+
+    const Run& base = runs.front();
+    output << std::endl << "Thread scaling (loss on " << eval_file << ")" << std::endl;
+    output << std::setw(8) << "threads" << std::setw(14) << "words/sec" << std::setw(10) << "speed-up"
+           << std::setw(12) << "efficiency" << std::setw(10) << "loss" << std::setw(10) << "drift" << std::endl;
+    for (auto it = runs.begin(); it != runs.end(); ++it) {
+        float speedup = it->words_per_sec / base.words_per_sec;
+        output << std::setw(8) << it->threads << std::setw(14) << static_cast<long long>(it->words_per_sec)
+               << std::setw(10) << std::setprecision(3) << speedup
+               << std::setw(11) << std::setprecision(3) << 100 * speedup / it->threads << "%"
+               << std::setw(10) << std::setprecision(4) << it->loss
+               << std::setw(9) << std::setprecision(3) << 100 * (it->loss - base.loss) / base.loss << "%" << std::endl;
+    }
+
+    auto range = std::minmax_element(baseline_losses.begin(), baseline_losses.end());
+    output << "Noise floor: " << std::setprecision(3) << 100 * (*range.second - *range.first) / base.loss
+           << "% (loss spread of " << baseline_losses.size() << " runs with 1 thread, whose mean is the reference"
+           << " of the drift): smaller drifts are not significant" << std::endl;
+
+    output << std::endl << "Shared state (ns per operation in each thread, when all threads run it)" << std::endl;
+    output << std::setw(8) << "threads" << std::setw(16) << "multivec::rand" << std::setw(16) << "private rand"
+           << std::setw(16) << "shared counter" << std::endl;
+    for (auto it = runs.begin(); it != runs.end(); ++it) {
+        output << std::setw(8) << it->threads << std::setw(16) << std::setprecision(3) << it->probe.shared_rand
+               << std::setw(16) << it->probe.private_rand << std::setw(16) << it->probe.shared_counter << std::endl;
+    }
+
+    // each thread adds its word count to words_processed every 10000 words
+    output << std::endl << "Updates of words_processed (per second, by all threads)" << std::endl;
+    output << std::setw(8) << "threads" << std::setw(16) << "updates/sec" << std::endl;
+    for (auto it = runs.begin(); it != runs.end(); ++it) {
+        output << std::setw(8) << it->threads << std::setw(16) << std::setprecision(4) << it->words_per_sec / 10000
+               << std::endl;
+    }
+
+    // expected share of the updates received by each row: input rows are updated in proportion to the
+    // (subsampled) word counts, output rows also when they are drawn as negative samples
+    vector<const HuffmanNode*> nodes;
+    vector<double> kept; // expected count after subsampling
+    double total_kept = 0, total_unigram = 0;
+    for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
+        double count = it->second.count;
+        if (config->subsampling > 0) {
+            double f = count / vocab_word_count;
+            count *= std::min(1.0, (1 + sqrt(f / config->subsampling)) * config->subsampling / f);
+        }
+        nodes.push_back(&it->second);
+        kept.push_back(count);
+        total_kept += count;
+        total_unigram += pow(it->second.count, 0.75);
+    }
+
+    vector<pair<double, int>> rows; // (output share, node)
+    for (int i = 0; i < nodes.size(); ++i) {
+        double output_share = (kept[i] / total_kept + config->negative * pow(nodes[i]->count, 0.75) / total_unigram)
+                              / (1 + config->negative);
+        rows.push_back({output_share, i});
+    }
+    int n_rows = std::min(10, static_cast<int>(rows.size()));
+    std::partial_sort(rows.begin(), rows.begin() + n_rows, rows.end(), std::greater<pair<double, int>>());
+
+    output << std::endl << "Most updated rows (expected share of all the updates)" << std::endl;
+    output << std::setw(20) << "word" << std::setw(12) << "input" << std::setw(12) << "output" << std::endl;
+    for (int i = 0; i < n_rows; ++i) {
+        int k = rows[i].second;
+        output << std::setw(20) << nodes[k]->word
+               << std::setw(11) << std::setprecision(3) << 100 * kept[k] / total_kept << "%"
+               << std::setw(11) << std::setprecision(3) << 100 * rows[i].first << "%" << std::endl;
+    }
+    if (config->hierarchical_softmax) {
+        output << "(hierarchical softmax: the root of the Huffman tree is updated for every word)" << std::endl;
+    }
+}
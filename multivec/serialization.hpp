@@ -1,5 +1,6 @@
 #pragma once
-#include "bilingual.hpp"
+#include "multilingual.hpp"
+#include <type_traits>
 
 template<typename T>
 inline void save(ofstream& outfile, T x) {
@@ -20,47 +21,75 @@ inline void save(ofstream& outfile, const string& s) {
 inline void load(ifstream& infile, string& s) {
     size_t size = 0;
     load(infile, size);
-    char* temp = new char[size + 1];
-    temp[size] = '\0';
-    infile.read(temp, size);
-    s = temp;
-    delete [] temp;
+    s.resize(size);
+    if (size > 0) infile.read(&s[0], size);
 }
 
+/**
+ * Vectors of basic types (and `vec`) are written and read as a single contiguous block,
+ * other vectors element by element. The format is the same in both cases: the size
+ * followed by the elements.
+ */
 template<typename T>
-inline void save(ofstream& outfile, const std::vector<T>& v) {
-    save(outfile, v.size());
+inline void saveElements(ofstream& outfile, const std::vector<T>& v, std::true_type) {
+    outfile.write(reinterpret_cast<const char*>(v.data()), sizeof(T) * v.size());
+}
+
+template<typename T>
+inline void saveElements(ofstream& outfile, const std::vector<T>& v, std::false_type) {
     for (size_t i = 0; i < v.size(); ++i) {
         save(outfile, v[i]);
     }
 }
 
+template<typename T>
+inline void loadElements(ifstream& infile, std::vector<T>& v, size_t size, std::true_type) {
+    v.resize(size);
+    infile.read(reinterpret_cast<char*>(v.data()), sizeof(T) * size);
+}
+
+template<typename T>
+inline void loadElements(ifstream& infile, std::vector<T>& v, size_t size, std::false_type) {
+    v.reserve(size);
+    for (size_t i = 0; i < size && infile; ++i) {
+        T x;
+        load(infile, x);
+        v.push_back(std::move(x));
+    }
+}
+
+template<typename T>
+inline void save(ofstream& outfile, const std::vector<T>& v) {
+    save(outfile, v.size());
+    saveElements(outfile, v, std::is_arithmetic<T>());
+}
+
 template<typename T>
 inline void load(ifstream& infile, std::vector<T>& v) {
     size_t size = 0;
     v.clear();
     load(infile, size);
-    for (size_t i = 0; i < size; ++i) {
-        T x;
-        load(infile, x);
-        v.push_back(x);
-    }
+    loadElements(infile, v, size, std::is_arithmetic<T>());
 }
 
 inline void save(ofstream& outfile, const vec& v) {
     save(outfile, v.size());
-    for (size_t i = 0; i < v.size(); ++i) {
-        save(outfile, v[i]);
-    }
+    outfile.write(reinterpret_cast<const char*>(v.data()), sizeof(float) * v.size());
 }
 
 inline void load(ifstream& infile, vec& v) {
     size_t size = 0;
     load(infile, size);
     v = vec(size);
-    for (size_t i = 0; i < size; ++i) {
-        load(infile, v[i]);
-    }
+    infile.read(reinterpret_cast<char*>(v.data()), sizeof(float) * size);
+}
+
+// skips a vector of basic types (or a vec) saved by `save`
+template<typename T>
+inline void skip(ifstream& infile) {
+    size_t size = 0;
+    load(infile, size);
+    infile.seekg(sizeof(T) * size, ios::cur);
 }
 
 inline void save(ofstream& outfile, const Config& cfg) {
@@ -75,7 +104,9 @@ inline void save(ofstream& outfile, const Config& cfg) {
     save(outfile, cfg.threads);
     save(outfile, cfg.skip_gram);
     save(outfile, cfg.negative);
-    save(outfile, cfg.sent_vector);
+    // sent_vector, dbow and dbow_words in one byte (older versions wrote only sent_vector, as a bool)
+    uint8_t sent_flags = cfg.sent_vector | cfg.dbow << 1 | cfg.dbow_words << 2;
+    save(outfile, sent_flags);
 }
 
 inline void load(ifstream& infile, Config& cfg) {
@@ -90,7 +121,11 @@ inline void load(ifstream& infile, Config& cfg) {
    load(infile, cfg.threads);
    load(infile, cfg.skip_gram);
    load(infile, cfg.negative);
-   load(infile, cfg.sent_vector);
+   uint8_t sent_flags = 0;
+   load(infile, sent_flags);
+   cfg.sent_vector = sent_flags & 1;
+   cfg.dbow = sent_flags & 2;
+   cfg.dbow_words = sent_flags & 4;
 }
 
 inline void save(ofstream& outfile, const BilingualConfig& cfg) {
@@ -135,23 +170,48 @@ inline void save(ofstream& outfile, const MonolingualModel& model) {
     save(outfile, model.sent_weights);
 }
 
-inline void load(ifstream& infile, MonolingualModel& model) {
+/**
+ * @brief Load a model. With `query_only`, the sections that are only needed for training
+ * (Huffman codes, output weights and sentence weights) are skipped.
+ */
+inline void load(ifstream& infile, MonolingualModel& model, bool query_only) {
+    model.clearIndex(); // built for the previous weights
     load(infile, *model.config);
 
     size_t vocabulary_size = 0;
     load(infile, vocabulary_size);
     model.vocabulary.clear();
+    model.vocabulary.reserve(vocabulary_size);
 
     for (size_t i = 0; i < vocabulary_size; ++i) {
         HuffmanNode node(0, ""); // empty constructor creates UNK node
-        load(infile, node);
+        if (query_only) {
+            load(infile, node.index);
+            load(infile, node.count);
+            load(infile, node.word);
+            skip<int>(infile); // code
+            skip<int>(infile); // parents
+        } else {
+            load(infile, node);
+        }
         model.vocabulary.insert({node.word, node});
     }
 
     load(infile, model.input_weights);
-    load(infile, model.output_weights);
-    load(infile, model.output_weights_hs);
-    load(infile, model.sent_weights);
+    if (query_only) {
+        model.output_weights.clear();
+        model.output_weights_hs.clear();
+        model.sent_weights.clear();
+        // the rest of the file (output and sentence weights) is read by initTraining, if needed
+    } else {
+        load(infile, model.output_weights);
+        load(infile, model.output_weights_hs);
+        load(infile, model.sent_weights);
+    }
+}
+
+inline void load(ifstream& infile, MonolingualModel& model) {
+    load(infile, model, false);
 }
 
 inline void save(ofstream& outfile, const BilingualModel& model) {
@@ -165,3 +225,26 @@ inline void load(ifstream& infile, BilingualModel& model) {
     load(infile, model.src_model);
     load(infile, model.trg_model);
 }
+
+inline void save(ofstream& outfile, const MultilingualModel& model) {
+    save(outfile, *model.config);
+    save(outfile, model.languages);
+    for (auto it = model.models.begin(); it != model.models.end(); ++it) {
+        save(outfile, **it);
+    }
+}
+
+inline void load(ifstream& infile, MultilingualModel& model) {
+    load(infile, *model.config);
+
+    vector<string> languages;
+    load(infile, languages);
+    model.languages.clear();
+    model.models.clear();
+    model.corpora.clear();
+
+    for (auto it = languages.begin(); it != languages.end(); ++it) {
+        int lang = model.addLanguage(*it);
+        load(infile, *model.models[lang]);
+    }
+}
@@ -9,11 +9,15 @@
 #include <fstream>
 #include <sstream>
 #include <thread>
+#include <atomic>
+#include <memory> // unique_ptr
 #include <assert.h>
 #include <iomanip> // setprecision, setw, left
 #include <chrono>
 #include <iterator>
+#include <functional> // ref, cref
 #include "vec.hpp"
+#include "profile.hpp"
 
 using namespace std;
 using namespace std::chrono;
@@ -49,6 +53,11 @@ inline vector<string> split(const string& sequence) {
     return words;
 }
 
+inline bool read_line(istream& input, string& line) { // getline, with profiling
+    PROFILE_SCOPE("read");
+    return static_cast<bool>(getline(input, line));
+}
+
 inline void check_is_open(ifstream& infile, const string& filename) {
     if (!infile.is_open()) {
         throw runtime_error("couldn't open file " + filename);
@@ -74,10 +83,14 @@ namespace multivec {
      *
      * @return next random number
      */
+    inline unsigned long long rand(unsigned long long& state) { // same generator, with a private state
+        state = state * static_cast<unsigned long long>(25214903917) + 11;
+        return state >> 16; // with this generator, the most significant bits are bits 47...16
+    }
+
     inline unsigned long long rand() {
         static unsigned long long next_random(time(NULL)); // in C++11 the thread_local keyword would solve the thread safety problem.
-        next_random = next_random * static_cast<unsigned long long>(25214903917) + 11; // unsafe, but we don't care
-        return next_random >> 16; // with this generator, the most significant bits are bits 47...16
+        return rand(next_random); // unsafe, but we don't care
     }
 
     inline float randf() {
@@ -141,6 +154,23 @@ struct Config {
     bool skip_gram; // set to true to use skip-gram model instead of CBOW
     int negative; // number of negative samples used for the negative sampling training algorithm
     bool sent_vector; // includes sentence vectors in the training
+    bool dbow; // distributed bag of words paragraph vector (PV-DBOW) instead of PV-DM
+    bool dbow_words; // in DBOW mode, also train word vectors
+    float online_tolerance; // online paragraph vector stops when an iteration's relative update is below this (not serialized)
+    string sent_weights_file; // if set, batch sentence vectors are stored in this memory-mapped file, instead of the model (not serialized)
+    bool adagrad; // per-row AdaGrad: the learning rate of each embedding is scaled by its squared gradient history (not serialized)
+    // held-out evaluation and early stopping, not serialized
+    string heldout_file; // held-out corpus, whose loss is evaluated during training
+    long long heldout_words; // number of words processed between two evaluations (0 for once per epoch)
+    float heldout_tolerance; // training stops when the held-out loss improves by less than this (relative), 0 to disable
+    string metrics_file; // training metrics are written to this file as JSON lines (see metrics.hpp), not serialized
+    float metrics_interval; // seconds between two metrics reports (not serialized)
+    // data-parallel training with several processes (see cluster.hpp), not serialized
+    string cluster_address; // address of the first process: "host:port" or "unix:path"
+    int cluster_size; // number of processes (1 to disable)
+    int cluster_rank; // rank of this process, in [0, cluster_size)
+    long long sync_words; // number of words processed by a process between two synchronizations
+    int index_ef; // candidates explored by closest with an HNSW index: higher recall, but slower (not serialized)
 
     Config() :
         learning_rate(0.05),
@@ -154,7 +184,18 @@ struct Config {
         hierarchical_softmax(false),
         skip_gram(false),
         negative(5),
-        sent_vector(false)
+        sent_vector(false),
+        dbow(false),
+        dbow_words(false),
+        online_tolerance(1e-03),
+        adagrad(false),
+        heldout_words(0),
+        heldout_tolerance(1e-03),
+        metrics_interval(5),
+        cluster_size(1),
+        cluster_rank(0),
+        sync_words(1000000),
+        index_ef(100)
         {}
 
     virtual void print() const {
@@ -170,6 +211,20 @@ struct Config {
         std::cout << "HS:          " << hierarchical_softmax << std::endl;
         std::cout << "negative:    " << negative << std::endl;
         std::cout << "sent vector: " << sent_vector << std::endl;
+        std::cout << "AdaGrad:     " << adagrad << std::endl;
+        if (!heldout_file.empty()) {
+            std::cout << "held-out:    " << heldout_file << std::endl;
+            std::cout << "tolerance:   " << heldout_tolerance << std::endl;
+        }
+        if (cluster_size > 1) {
+            std::cout << "cluster:     " << cluster_address << " (" << cluster_rank << "/" << cluster_size << ")" << std::endl;
+            std::cout << "sync words:  " << sync_words << std::endl;
+        }
+        if (sent_vector) {
+            std::cout << "DBOW:        " << dbow << std::endl;
+            if (dbow) std::cout << "DBOW words:  " << dbow_words << std::endl;
+            if (!sent_weights_file.empty()) std::cout << "sent file:   " << sent_weights_file << std::endl;
+        }
     }
 };
 
@@ -51,6 +51,7 @@ public:
     Vec(size_type n) : _data(n) {}
     Vec(size_type n, float val) : _data(n, val) {}
     Vec(Vec::container_type v) : _data(v) {}
+    Vec(const value_type* first, const value_type* last) : _data(first, last) {}
 
     friend std::ostream& operator<<(std::ostream &o, Vec const& self) {
         std::ostringstream ss;
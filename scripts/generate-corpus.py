@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+from __future__ import division, print_function
+import argparse
+import bisect
+import math
+import random
+import sys
+
+
+help_msg = """\
+Generate a synthetic corpus, whose word frequencies follow a Zipf distribution.
+The output is deterministic for a given seed and set of parameters.
+
+With --parallel, also generate a target side: each source word has a fixed
+translation (a different Zipf rank in the target vocabulary), some words are
+dropped or inserted, and neighboring words are swapped.
+"""
+
+
+class Zipf(object):
+    def __init__(self, vocab_size, exponent):
+        self.cum_weights = []
+        total = 0
+        for rank in range(1, vocab_size + 1):
+            total += 1 / rank ** exponent
+            self.cum_weights.append(total)
+
+    def sample(self, rand):
+        return bisect.bisect(self.cum_weights, rand.random() * self.cum_weights[-1])
+
+
+def poisson(rand, mean):
+    if mean > 30:  # normal approximation
+        return int(round(rand.gauss(mean, math.sqrt(mean))))
+    k, p, limit = 0, 1, math.exp(-mean)
+    while True:
+        p *= rand.random()
+        if p <= limit:
+            return k
+        k += 1
+
+
+def sentence_length(rand, args):
+    if args.length_dist == 'fixed':
+        length = args.mean_length
+    elif args.length_dist == 'uniform':
+        length = rand.randint(args.min_length, 2 * args.mean_length - args.min_length)
+    else:
+        length = poisson(rand, args.mean_length)
+    return max(args.min_length, min(args.max_length, length))
+
+
+def translate(rand, sentence, translations, zipf, args):
+    target = []
+    for word in sentence:
+        if rand.random() >= args.drop_prob:
+            target.append(translations[word])
+        if rand.random() < args.insert_prob:
+            target.append(zipf.sample(rand))
+    for i in range(len(target) - 1):
+        if rand.random() < args.swap_prob:
+            target[i], target[i + 1] = target[i + 1], target[i]
+    return target or [translations[sentence[0]]]
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description=help_msg, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('output', help='output file (source side)')
+    parser.add_argument('--parallel', metavar='FILE', help='also write a target side to this file')
+    parser.add_argument('--tokens', type=int, default=1000000, help='number of tokens (source side)')
+    parser.add_argument('--vocab-size', type=int, default=50000)
+    parser.add_argument('--exponent', type=float, default=1.0, help='exponent of the Zipf distribution')
+    parser.add_argument('--length-dist', choices=['poisson', 'uniform', 'fixed'], default='poisson',
+                        help='distribution of the sentence lengths')
+    parser.add_argument('--mean-length', type=int, default=20)
+    parser.add_argument('--min-length', type=int, default=1)
+    parser.add_argument('--max-length', type=int, default=100)
+    parser.add_argument('--drop-prob', type=float, default=0.05, help='probability of dropping a translation')
+    parser.add_argument('--insert-prob', type=float, default=0.05,
+                        help='probability of inserting a random target word')
+    parser.add_argument('--swap-prob', type=float, default=0.1, help='probability of swapping two target words')
+    parser.add_argument('--src-prefix', default='w')
+    parser.add_argument('--trg-prefix', default='v')
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    if not 1 <= args.min_length <= args.mean_length <= args.max_length:
+        sys.exit('error: the sentence lengths must satisfy 1 <= min-length <= mean-length <= max-length')
+
+    rand = random.Random(args.seed)
+    zipf = Zipf(args.vocab_size, args.exponent)
+
+    # translations are close in frequency: a random permutation of the ranks inside blocks of 10
+    translations = list(range(args.vocab_size))
+    for i in range(0, args.vocab_size, 10):
+        block = translations[i:i + 10]
+        rand.shuffle(block)
+        translations[i:i + 10] = block
+
+    src_file = open(args.output, 'w')
+    trg_file = open(args.parallel, 'w') if args.parallel else None
+
+    tokens = 0
+    while tokens < args.tokens:
+        length = min(sentence_length(rand, args), args.tokens - tokens)
+        sentence = [zipf.sample(rand) for _ in range(length)]
+        tokens += length
+
+        src_file.write(' '.join(args.src_prefix + str(w) for w in sentence) + '\n')
+        if trg_file:
+            target = translate(rand, sentence, translations, zipf, args)
+            trg_file.write(' '.join(args.trg_prefix + str(w) for w in target) + '\n')
+
+    src_file.close()
+    if trg_file:
+        trg_file.close()